@@ -3,6 +3,7 @@ from toygrad_cpu import Tensor, Shape
 
 faulthandler.enable()
 t1 = Tensor.randn([2, 3, 4])
+t1.requires_grad = True
 t2 = Tensor.randn([2, 3, 4])
 t3 = t1.max(1)
 t4 = t3.sum()
@@ -15,6 +15,10 @@ namespace Toygrad::Error {
     const std::string Message::backpropFromNull = "Cannot backpropagate from a tensor without any gradient";
     const std::string Message::tensorGraphUninitialized =
             "Cannot backpropagate because tensor graph is not initialized";
+    const std::string Message::tensorUnrealized = "Cannot read a tensor that has not been forwarded";
+    const std::string Message::moduleUncaptured = "Cannot replay a module that has not been captured";
+    const std::string Message::emptyTensorList = "Cannot combine an empty list of tensors";
+    const std::string Message::sliceOwnerExpired = "Cannot allocate a slice of a tensor that has been destroyed";
 
     std::string Message::invalidDim(int dim, const Shape &shape) {
         return "Invalid dimension " + std::to_string(dim) + " of shape " + shape.toStr();
@@ -32,4 +36,22 @@ namespace Toygrad::Error {
     std::string Message::invalidInputSize(size_t actual, size_t expected) {
         return "Expected input of size " + std::to_string(expected) + " but got " + std::to_string(actual);
     }
+
+    std::string Message::dtypeUnsupported(DType dtype) {
+        return "Operation is not supported for elements of type " + Tensor::dtype2Str[dtype];
+    }
+
+    std::string Message::dtypesMismatched(const std::string &opNameStr, DType dtype1, DType dtype2) {
+        return "Data types mismatched during " + opNameStr + ": " + Tensor::dtype2Str[dtype1] + " and " +
+               Tensor::dtype2Str[dtype2];
+    }
+
+    std::string Message::invalidEinsum(const std::string &subscripts) {
+        return "Invalid einsum subscripts " + subscripts;
+    }
+
+    std::string Message::invalidWindow(const Shape &shape, size_t kernelSize, size_t stride, size_t padding) {
+        return "Invalid window of size " + std::to_string(kernelSize) + " with stride " + std::to_string(stride) +
+               " and padding " + std::to_string(padding) + " over shape " + shape.toStr();
+    }
 }
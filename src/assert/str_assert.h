@@ -7,9 +7,11 @@
 #include <iostream>
 #include <cassert>
 #include "tensors/shape.h"
+#include "tensors/dtype.h"
 
 namespace Toygrad::Error {
     using Tensor::Shape;
+    using Tensor::DType;
 
     struct Message {
         static const std::string gradOnScalarOnly;
@@ -19,6 +21,10 @@ namespace Toygrad::Error {
         static const std::string invalidShapePerm;
         static const std::string backpropFromNull;
         static const std::string tensorGraphUninitialized;
+        static const std::string tensorUnrealized;
+        static const std::string moduleUncaptured;
+        static const std::string emptyTensorList;
+        static const std::string sliceOwnerExpired;
 
         static std::string invalidDim(int dim, const Shape &shape);
 
@@ -27,6 +33,14 @@ namespace Toygrad::Error {
         static std::string shapesMismatched(const std::string &opNameStr, const Shape &shape1, const Shape &shape2);
 
         static std::string invalidInputSize(size_t actual, size_t expected);
+
+        static std::string dtypeUnsupported(DType dtype);
+
+        static std::string dtypesMismatched(const std::string &opNameStr, DType dtype1, DType dtype2);
+
+        static std::string invalidEinsum(const std::string &subscripts);
+
+        static std::string invalidWindow(const Shape &shape, size_t kernelSize, size_t stride, size_t padding);
     };
 
     inline bool str_assert(bool assertion, const std::string &message) {
@@ -19,7 +19,24 @@ namespace Toygrad::Tensor {
         size_t step;
     };
 
+    // Elementwise function applied by a fused operation to its result before it is stored
+    enum class Activation {
+        NONE, RELU, SIGMOID
+    };
+
+    // Order of the dimensions of images and signals, batch x channels x height x width or batch x height x width x
+    // channels, 1D signals have no height
+    enum class Layout {
+        CHANNELS_FIRST, CHANNELS_LAST
+    };
+
+    // Reduction applied by pooling to each window
+    enum class Pooling {
+        MAX, AVG
+    };
+
     class TensorGraph;
+    class TensorPlan;
     class TensorDraw;
     class TensorIter;
     class ConstTensorIter;
@@ -28,6 +45,7 @@ namespace Toygrad::Tensor {
     struct LeafOp;
     struct UnOp;
     struct BinOp;
+    struct MultiOp;
     struct IndexOp;
     struct ConstOp;
     struct ArangeOp;
@@ -53,6 +71,7 @@ namespace Toygrad::Tensor {
     struct SqOp;
     struct SqrtOp;
     struct AliasOp;
+    struct ReshapeOp;
     struct EqOp;
     struct NeqOp;
     struct LessOp;
@@ -66,7 +85,17 @@ namespace Toygrad::Tensor {
     struct SigmoidOp;
     struct SoftmaxOp;
     struct CopyOp;
+    struct CatOp;
+    struct CastOp;
     struct MatmulOp;
+    struct Int8MatmulOp;
+    struct Int4MatmulOp;
+    struct FusedLinearOp;
+    struct ConvOp;
+    struct PoolOp;
+    struct Int8Matrix;
+    struct Int4Matrix;
+    struct CachedValues;
 
     using TensorPtr = std::shared_ptr<Tensor>;
     using ConstTensorPtr = std::shared_ptr<const Tensor>;
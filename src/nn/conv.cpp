@@ -0,0 +1,11 @@
+#include "conv.h"
+
+namespace Toygrad::NN {
+    Tensor::TensorPtr Conv1d::F(const std::vector<Tensor::TensorPtr> &x) {
+        return x[0]->conv1d(A, b, stride, padding, layout);
+    }
+
+    Tensor::TensorPtr Conv2d::F(const std::vector<Tensor::TensorPtr> &x) {
+        return x[0]->conv2d(A, b, stride, padding, layout);
+    }
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include "nn.h"
+
+namespace Toygrad::NN {
+    class Conv1d : public Module {
+        Tensor::TensorPtr A;
+        Tensor::TensorPtr b;
+        size_t stride;
+        size_t padding;
+        Tensor::Layout layout;
+
+    public:
+        /**
+         * Creates a 1D convolution layer over signals of shape batch x channels x length, or batch x length x
+         * channels when channels are last.
+         * @param inChannels the number of input channels.
+         * @param outChannels the number of output channels.
+         * @param kernelSize the size of the kernel.
+         * @param stride the step between the positions the kernel is applied at.
+         * @param padding the number of zeros on each end.
+         * @param layout the order of the dimensions of the inputs and the outputs.
+         */
+        Conv1d(size_t inChannels, size_t outChannels, size_t kernelSize, size_t stride = 1, size_t padding = 0,
+               Tensor::Layout layout = Tensor::Layout::CHANNELS_FIRST): stride(stride), padding(padding),
+                                                                        layout(layout) {
+            A = layout == Tensor::Layout::CHANNELS_FIRST
+                    ? Tensor::Tensor::randn({outChannels, inChannels, kernelSize})
+                    : Tensor::Tensor::randn({outChannels, kernelSize, inChannels});
+            b = Tensor::Tensor::randn({outChannels});
+
+            A->setRequiresGrad(true);
+            b->setRequiresGrad(true);
+        }
+
+        Tensor::TensorPtr F(const std::vector<Tensor::TensorPtr> &x) override;
+    };
+
+    class Conv2d : public Module {
+        Tensor::TensorPtr A;
+        Tensor::TensorPtr b;
+        size_t stride;
+        size_t padding;
+        Tensor::Layout layout;
+
+    public:
+        /**
+         * Creates a 2D convolution layer with square kernels over images of shape batch x channels x height x width,
+         * or batch x height x width x channels when channels are last.
+         * @param inChannels the number of input channels.
+         * @param outChannels the number of output channels.
+         * @param kernelSize the height and width of the kernel.
+         * @param stride the step between the positions the kernel is applied at.
+         * @param padding the number of zeros on each side.
+         * @param layout the order of the dimensions of the inputs and the outputs.
+         */
+        Conv2d(size_t inChannels, size_t outChannels, size_t kernelSize, size_t stride = 1, size_t padding = 0,
+               Tensor::Layout layout = Tensor::Layout::CHANNELS_FIRST): stride(stride), padding(padding),
+                                                                        layout(layout) {
+            A = layout == Tensor::Layout::CHANNELS_FIRST
+                    ? Tensor::Tensor::randn({outChannels, inChannels, kernelSize, kernelSize})
+                    : Tensor::Tensor::randn({outChannels, kernelSize, kernelSize, inChannels});
+            b = Tensor::Tensor::randn({outChannels});
+
+            A->setRequiresGrad(true);
+            b->setRequiresGrad(true);
+        }
+
+        Tensor::TensorPtr F(const std::vector<Tensor::TensorPtr> &x) override;
+    };
+}
@@ -5,7 +5,28 @@
 #include "linear.h"
 
 namespace Toygrad::NN {
+    Tensor::TensorPtr activate(const Tensor::TensorPtr &y, Tensor::Activation activation) {
+        switch (activation) {
+            case Tensor::Activation::RELU:
+                return y->relu();
+            case Tensor::Activation::SIGMOID:
+                return y->sigmoid();
+            default:
+                return y;
+        }
+    }
+
     Tensor::TensorPtr Linear::F(const std::vector<Tensor::TensorPtr> &x) {
-        return x[0]->matmul(A)->add(b);
+        auto input = x[0]->to(dtype);
+        const Tensor::Shape &shape = input->getShape();
+        size_t inputSize = shape[shape.getNumDims() - 1];
+
+        // Leading dimensions, e.g. the positions of a sequence, are folded into the rows of one fused product
+        if (input->canReshapeWithoutCopy({input->getNumel() / inputSize, inputSize})) {
+            return input->linear(A, b, activation);
+        }
+
+        // Otherwise every matrix of the batch is multiplied by the weight broadcast with zero strides
+        return activate(input->matmul(A)->add(b), activation);
     }
 }
@@ -6,14 +6,39 @@
 #include "nn.h"
 
 namespace Toygrad::NN {
+    // Applies an activation as a separate operation, for layers that cannot fuse it into their product
+    Tensor::TensorPtr activate(const Tensor::TensorPtr &y, Tensor::Activation activation);
+
     class Linear : public Module {
         Tensor::TensorPtr A;
         Tensor::TensorPtr b;
+        // Type in which the weights and the input activations saved for backward are stored
+        Tensor::DType dtype;
+        Tensor::Activation activation;
+
+        friend class QLinear;
+        friend class Int4Linear;
 
     public:
-        Linear(size_t inputSize, size_t outputSize) {
-            A = Tensor::Tensor::randn({inputSize, outputSize});
+        /**
+         * Creates a linear layer.
+         * @param inputSize the number of input features.
+         * @param outputSize the number of output features.
+         * @param dtype the storage type of the weights and the inputs, e.g. BFLOAT16 or FLOAT16 to halve their memory,
+         * products are still accumulated in float32.
+         * @param activation the activation applied to the outputs as they are computed, e.g. RELU instead of a
+         * separate relu after the layer.
+         */
+        Linear(size_t inputSize, size_t outputSize, Tensor::DType dtype = Tensor::DType::FLOAT32,
+               Tensor::Activation activation = Tensor::Activation::NONE): dtype(dtype), activation(activation) {
+            // Reduced precision weights are converted once when the layer is created
+            A = dtype == Tensor::DType::FLOAT32
+                    ? Tensor::Tensor::randn({inputSize, outputSize})
+                    : Tensor::Tensor::randn({inputSize, outputSize}, false)->to(dtype, false);
             b = Tensor::Tensor::randn({outputSize});
+
+            A->setRequiresGrad(true);
+            b->setRequiresGrad(true);
         }
 
         Tensor::TensorPtr F(const std::vector<Tensor::TensorPtr> &x) override;
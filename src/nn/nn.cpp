@@ -14,10 +14,19 @@ namespace Toygrad::NN {
             }
 
             output = F(input);
+
+            if (checkpoint) {
+                Tensor::TensorGraph::checkpoint(output.get(), input);
+            }
         } else {
             assert(Error::str_assert(x.size() == input.size(),
                 Error::Message::invalidInputSize(x.size(), input.size())));
 
+            if (plan != nullptr) {
+                // Stop sharing memory with the inputs of the last replay before overwriting them
+                plan->unbind();
+            }
+
             for (size_t i = 0; i < x.size(); i++) {
                 x[i]->forward();
                 input[i] = x[i]->copy(false, input[i]);
@@ -27,4 +36,22 @@ namespace Toygrad::NN {
         output->forward();
         return output;
     }
+
+    void Module::setCheckpoint(bool checkpoint) {
+        this->checkpoint = checkpoint;
+
+        if (output != nullptr) {
+            Tensor::TensorGraph::checkpoint(output.get(), input, checkpoint);
+        }
+    }
+
+    void Module::capture(const std::vector<Tensor::TensorPtr> &x) {
+        forward(x);
+        plan = std::make_unique<Tensor::TensorPlan>(output, input);
+    }
+
+    Tensor::TensorPtr Module::replay(const std::vector<Tensor::TensorPtr> &x) {
+        assert(Error::str_assert(plan != nullptr, Error::Message::moduleUncaptured));
+        return plan->replay(x);
+    }
 }
@@ -3,18 +3,40 @@
 //
 
 #pragma once
-#include "tensors/tensor_graph.h"
+#include "tensors/tensor_plan.h"
 
 namespace Toygrad::NN {
     class Module {
         std::vector<Tensor::TensorPtr> input;
         Tensor::TensorPtr output = nullptr;
+        std::unique_ptr<Tensor::TensorPlan> plan = nullptr;
+        bool checkpoint = false;
 
     public:
         virtual ~Module() = default;
 
         Tensor::TensorPtr forward(const std::vector<Tensor::TensorPtr> &x);
 
+        /**
+         * Records the module's graph for inputs of the given shapes so later batches can be run with replay.
+         * @param x the realized input tensors.
+         */
+        void capture(const std::vector<Tensor::TensorPtr> &x);
+
+        /**
+         * Runs the captured graph on new inputs of the captured shapes.
+         * @param x the realized input tensors.
+         * @return the output tensor.
+         */
+        Tensor::TensorPtr replay(const std::vector<Tensor::TensorPtr> &x);
+
+        /**
+         * Sets whether the module's activations are checkpointed, i.e. discarded after forward propagation and
+         * recomputed from the module's input during backward propagation.
+         * @param checkpoint whether the module is checkpointed.
+         */
+        void setCheckpoint(bool checkpoint);
+
         virtual Tensor::TensorPtr F(const std::vector<Tensor::TensorPtr> &x) = 0;
     };
 }
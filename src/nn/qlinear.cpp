@@ -0,0 +1,66 @@
+#include "qlinear.h"
+#include "tensors/kernels.h"
+
+namespace Toygrad::NN {
+    // Compares the outputs of a quantized module and a float layer on the same inputs
+    static QuantizationError measureError(Module &module, Linear &linear, const std::vector<Tensor::TensorPtr> &x) {
+        QuantizationError error;
+        double diffNorm = 0;
+        double norm = 0;
+
+        for (auto &sample: x) {
+            auto expected = linear.forward({sample})->copy(false);
+            auto actual = module.forward({sample});
+
+            for (size_t i = 0; i < expected->getNumel(); i++) {
+                Tensor::real y = (*expected->getVec())[i];
+                Tensor::real diff = (*actual->getVec())[actual->getShape().offset + i] - y;
+                error.maxAbsError = std::max(error.maxAbsError, std::abs(diff));
+                diffNorm += diff * diff;
+                norm += y * y;
+            }
+        }
+
+        error.relError = norm > 0 ? static_cast<Tensor::real>(std::sqrt(diffNorm / norm)) : 0;
+        return error;
+    }
+
+    QLinear::QLinear(const Linear &linear): b(linear.b), activation(linear.activation) {
+        linear.A->forward();
+        const Tensor::Shape &shape = linear.A->getShape();
+        const Tensor::Dims &strides = shape.getStrides();
+        auto weights = std::make_shared<Tensor::Int8Matrix>();
+        Tensor::Workspace workspace;
+        // One row per output feature, i.e. the columns of A
+        Tensor::quantizeRows(*linear.A->getVec(), shape.offset, {strides[1], strides[0]}, shape[1], shape[0], *weights,
+                             workspace);
+        A = weights;
+    }
+
+    QuantizationError QLinear::calibrate(Linear &linear, const std::vector<Tensor::TensorPtr> &x) {
+        return measureError(*this, linear, x);
+    }
+
+    Tensor::TensorPtr QLinear::F(const std::vector<Tensor::TensorPtr> &x) {
+        return activate(x[0]->matmulInt8(A, b), activation);
+    }
+
+    Int4Linear::Int4Linear(const Linear &linear, size_t groupSize): b(linear.b), activation(linear.activation) {
+        linear.A->forward();
+        const Tensor::Shape &shape = linear.A->getShape();
+        const Tensor::Dims &strides = shape.getStrides();
+        auto weights = std::make_shared<Tensor::Int4Matrix>();
+        Tensor::Workspace workspace;
+        Tensor::quantizeRowsInt4(*linear.A->getVec(), shape.offset, {strides[1], strides[0]}, shape[1], shape[0],
+                                 groupSize, *weights, workspace);
+        A = weights;
+    }
+
+    QuantizationError Int4Linear::calibrate(Linear &linear, const std::vector<Tensor::TensorPtr> &x) {
+        return measureError(*this, linear, x);
+    }
+
+    Tensor::TensorPtr Int4Linear::F(const std::vector<Tensor::TensorPtr> &x) {
+        return activate(x[0]->matmulInt4(A, b), activation);
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include "linear.h"
+#include "tensors/quant.h"
+
+namespace Toygrad::NN {
+    // Difference between the outputs of a quantized layer and the float layer it was quantized from
+    struct QuantizationError {
+        // Largest absolute difference between two output elements
+        Tensor::real maxAbsError = 0;
+        // Norm of the differences divided by the norm of the float outputs
+        Tensor::real relError = 0;
+    };
+
+    // Linear layer for inference whose weights are quantized to int8 per output feature and whose inputs are quantized
+    // to int8 per row as they arrive
+    class QLinear : public Module {
+        std::shared_ptr<const Tensor::Int8Matrix> A;
+        Tensor::TensorPtr b;
+        Tensor::Activation activation;
+
+    public:
+        /**
+         * Quantizes the weights of a trained linear layer, the bias is kept in float32 and the activation is applied
+         * to the dequantized outputs.
+         * @param linear the float layer.
+         */
+        explicit QLinear(const Linear &linear);
+
+        /**
+         * Measures the accuracy of the quantized layer against the float layer it was created from on sample inputs.
+         * @param linear the float layer.
+         * @param x the sample inputs of the same shape.
+         * @return the error over all samples.
+         */
+        QuantizationError calibrate(Linear &linear, const std::vector<Tensor::TensorPtr> &x);
+
+        Tensor::TensorPtr F(const std::vector<Tensor::TensorPtr> &x) override;
+    };
+
+    // Linear layer for inference whose weights are quantized to 4 bits per group of input features of each output
+    // feature, which takes an eighth of the memory of float32 weights
+    class Int4Linear : public Module {
+        std::shared_ptr<const Tensor::Int4Matrix> A;
+        Tensor::TensorPtr b;
+        Tensor::Activation activation;
+
+    public:
+        /**
+         * Quantizes the weights of a trained linear layer, the bias is kept in float32 and the activation is applied
+         * to the dequantized outputs.
+         * @param linear the float layer.
+         * @param groupSize the number of consecutive input features that share a scale and a zero point.
+         */
+        explicit Int4Linear(const Linear &linear, size_t groupSize = 32);
+
+        /**
+         * Measures the accuracy of the quantized layer against the float layer it was created from on sample inputs.
+         * @param linear the float layer.
+         * @param x the sample inputs of the same shape.
+         * @return the error over all samples.
+         */
+        QuantizationError calibrate(Linear &linear, const std::vector<Tensor::TensorPtr> &x);
+
+        Tensor::TensorPtr F(const std::vector<Tensor::TensorPtr> &x) override;
+    };
+}
@@ -7,33 +7,161 @@
 #include "tensors/ops.h"
 
 using namespace Toygrad::Tensor;
+using namespace pybind11::literals;
 
 PYBIND11_MODULE(toygrad_cpu, m) {
     init_vec_module(m);
     init_shape_module(m);
     init_tensor_module(m);
-    init_tensor_module(m);
+    init_grad_mode_module(m);
+}
+
+// Python context manager for inference mode
+struct PyNoGrad {
+    bool prevEnabled = true;
+};
+
+// Numpy type of a data type, bfloat16 and bitmasks have none
+static py::dtype toNumpyDType(DType dtype) {
+    switch (dtype) {
+        case DType::FLOAT32:
+            return py::dtype::of<float>();
+        case DType::FLOAT64:
+            return py::dtype::of<double>();
+        case DType::INT32:
+            return py::dtype::of<int32_t>();
+        case DType::INT64:
+            return py::dtype::of<int64_t>();
+        case DType::BOOL:
+            return py::dtype::of<bool>();
+        case DType::FLOAT16:
+            return py::dtype("float16");
+        default:
+            throw py::type_error(Toygrad::Error::Message::dtypeUnsupported(dtype));
+    }
+}
+
+// Data type of a numpy type in the native byte order, returns false for the types that have none
+static bool fromNumpyDType(const py::dtype &dtype, DType &out) {
+    for (DType candidate: {DType::FLOAT32, DType::FLOAT64, DType::INT32, DType::INT64, DType::BOOL, DType::FLOAT16}) {
+        py::dtype numpyDType = toNumpyDType(candidate);
+
+        if (dtype.kind() == numpyDType.kind() && dtype.itemsize() == numpyDType.itemsize() &&
+            dtype.attr("isnative").cast<bool>()) {
+            out = candidate;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Describes the elements of a realized tensor where they are, with strides converted from elements to bytes. The
+// elements are writable so the tensor is marked as modified, later writes must call mark_modified again.
+static py::buffer_info getBufferInfo(Tensor &tensor) {
+    std::shared_ptr<Vec> vec = tensor.getVec();
+
+    if (vec == nullptr) {
+        throw py::value_error(Toygrad::Error::Message::tensorUnrealized);
+    }
+
+    tensor.markModified();
+
+    const Shape &shape = tensor.getShape();
+    py::dtype dtype = toNumpyDType(vec->dtype);
+    auto itemSize = static_cast<py::ssize_t>(dtype.itemsize());
+    std::vector<py::ssize_t> view, strides;
+
+    for (size_t i = 0; i < shape.getNumDims(); i++) {
+        view.push_back(static_cast<py::ssize_t>(shape[i]));
+        strides.push_back(static_cast<py::ssize_t>(shape.getStrides()[i]) * itemSize);
+    }
+
+    return {vec->getElmPtr(shape.offset), itemSize, std::string(1, dtype.char_()),
+            static_cast<py::ssize_t>(shape.getNumDims()), view, strides};
+}
+
+// Views a realized tensor as a numpy array without copying, the array keeps the tensor's buffer alive
+static py::array toNumpy(Tensor &tensor) {
+    py::buffer_info info = getBufferInfo(tensor);
+    py::capsule base(new std::shared_ptr<Vec>(tensor.getVec()), [](void *vec) {
+        delete static_cast<std::shared_ptr<Vec> *>(vec);
+    });
+    return {toNumpyDType(tensor.getVec()->dtype), info.shape, info.strides, info.ptr, base};
+}
+
+// Creates a tensor that borrows the memory of a numpy array with its strides. Arrays of other types are converted to
+// float32 and read-only arrays or arrays whose strides are negative or not whole elements are adopted as contiguous
+// copies.
+static TensorPtr fromNumpy(py::array array) {
+    DType dtype;
+
+    if (!fromNumpyDType(array.dtype(), dtype)) {
+        array = py::array_t<float, py::array::c_style | py::array::forcecast>::ensure(array);
+        dtype = DType::FLOAT32;
+    }
+
+    auto itemSize = static_cast<py::ssize_t>(array.itemsize());
+    bool borrowable = array.writeable();
+
+    for (py::ssize_t i = 0; i < array.ndim(); i++) {
+        borrowable = borrowable && array.strides(i) >= 0 && array.strides(i) % itemSize == 0;
+    }
+
+    if (!borrowable) {
+        array = py::module_::import("numpy").attr("array")(array, "copy"_a = true, "order"_a = "C");
+    }
+
+    // A 0-d array becomes a tensor of shape (1)
+    std::vector<size_t> view = {1}, strides = {1};
+    size_t size = array.size() == 0 ? 0 : 1;
+
+    if (array.ndim() > 0) {
+        view.clear();
+        strides.clear();
+
+        for (py::ssize_t i = 0; i < array.ndim(); i++) {
+            view.push_back(static_cast<size_t>(array.shape(i)));
+            strides.push_back(static_cast<size_t>(array.strides(i) / itemSize));
+            size += array.size() == 0 ? 0 : (view.back() - 1) * strides.back();
+        }
+    }
+
+    // The array is released with the GIL held when the last tensor viewing it is destroyed
+    std::shared_ptr<void> owner(new py::object(array), [](void *object) {
+        py::gil_scoped_acquire gil;
+        delete static_cast<py::object *>(object);
+    });
+    auto vec = std::make_shared<Vec>(size, dtype, static_cast<std::byte *>(array.mutable_data()), owner);
+    return Tensor::fromBuffer(vec, Shape(0, view, strides));
 }
 
 void init_vec_module(py::module_ &m) {
-    py::class_<Vec>(m, "Vec")
+    py::class_<Vec>(m, "Vec", py::buffer_protocol())
             .def(py::init<size_t>())
             .def(py::init<size_t, real>())
             .def(py::init<Vec &>())
             .def("__setitem__", [](const Vec &self, size_t index, real val) {
                 self[index] = val;
             })
-            .def("__getitem__", [](const Vec &self, size_t index) { return self[index]; });
+            .def("__getitem__", [](const Vec &self, size_t index) { return self[index]; })
+            .def_buffer([](const Vec &self) -> py::buffer_info {
+                py::dtype dtype = toNumpyDType(self.dtype);
+                return {self.getElmPtr(0), dtype.itemsize(), std::string(1, dtype.char_()),
+                        static_cast<py::ssize_t>(self.size)};
+            });
 }
 
 void init_shape_module(py::module_ &m) {
     py::class_<Shape>(m, "Shape")
             .def_readonly("offset", &Shape::offset)
-            .def_readonly("view", &Shape::view)
-            .def_readonly("strides", &Shape::strides)
-            .def(py::init<size_t, const std::vector<size_t> &, const std::vector<size_t> &>())
-            .def(py::init<size_t, const std::vector<size_t> &>())
-            .def(py::init<const std::vector<size_t> &>())
+            .def_property_readonly("view", [](const Shape &self) { return self.getView().toVec(); })
+            .def_property_readonly("strides", [](const Shape &self) { return self.getStrides().toVec(); })
+            .def(py::init([](size_t offset, const std::vector<size_t> &view, const std::vector<size_t> &strides) {
+                return Shape(offset, view, strides);
+            }))
+            .def(py::init([](size_t offset, const std::vector<size_t> &view) { return Shape(offset, view); }))
+            .def(py::init([](const std::vector<size_t> &view) { return Shape(view); }))
             .def("__len__", [](const Shape &self) { return self.getNumDims(); })
             .def("__getitem__", [](Shape &self, unsigned index) { return self[index]; });
 }
@@ -41,16 +169,68 @@ void init_shape_module(py::module_ &m) {
 void init_nn_module(py::module &m) {
 }
 
+void init_grad_mode_module(py::module_ &m) {
+    m.def("is_grad_enabled", &GradMode::isEnabled);
+    m.def("set_grad_enabled", &GradMode::setEnabled);
+    py::class_<PyNoGrad>(m, "no_grad")
+            .def(py::init<>())
+            .def("__enter__", [](PyNoGrad &self) {
+                self.prevEnabled = GradMode::isEnabled();
+                GradMode::setEnabled(false);
+            })
+            .def("__exit__", [](PyNoGrad &self, const py::object &, const py::object &, const py::object &) {
+                GradMode::setEnabled(self.prevEnabled);
+            });
+}
+
 void init_tensor_module(py::module_ &m) {
-    py::class_<Tensor, std::shared_ptr<Tensor> >(m, "Tensor")
+    py::enum_<DType>(m, "DType")
+            .value("float32", DType::FLOAT32)
+            .value("float64", DType::FLOAT64)
+            .value("int32", DType::INT32)
+            .value("int64", DType::INT64)
+            .value("bool", DType::BOOL)
+            .value("float16", DType::FLOAT16)
+            .value("bfloat16", DType::BFLOAT16)
+            .value("bitmask", DType::BITMASK);
+
+    py::enum_<Activation>(m, "Activation")
+            .value("none", Activation::NONE)
+            .value("relu", Activation::RELU)
+            .value("sigmoid", Activation::SIGMOID);
+
+    py::enum_<Layout>(m, "Layout")
+            .value("channels_first", Layout::CHANNELS_FIRST)
+            .value("channels_last", Layout::CHANNELS_LAST);
+
+    py::class_<Tensor, std::shared_ptr<Tensor> >(m, "Tensor", py::buffer_protocol())
+            .def_buffer(&getBufferInfo)
+            .def_static("from_numpy", &fromNumpy)
+            .def("numpy", &toNumpy)
+            .def("__array__", [](Tensor &self, const py::object &dtype, const py::object &copy) {
+                py::array array = toNumpy(self);
+
+                if (!copy.is_none() && copy.cast<bool>()) {
+                    array = array.attr("copy")();
+                }
+
+                return dtype.is_none() ? array : py::array(array.attr("astype")(dtype, "copy"_a = false));
+            }, py::arg("dtype") = py::none(), py::arg("copy") = py::none())
             .def("shape", &Tensor::getShape)
+            .def_property_readonly("dtype", &Tensor::getDType)
+            .def("to", [](Tensor &self, DType dtype) { return self.to(dtype); })
             .def("grad", &Tensor::getGrad)
+            .def("version", &Tensor::getVersion)
+            .def("mark_dirty", &Tensor::markDirty)
+            .def("mark_modified", &Tensor::markModified)
+            .def_property("requires_grad", &Tensor::getRequiresGrad, &Tensor::setRequiresGrad)
             .def("__str__", [](const Tensor &self) {
                 std::stringstream stream;
                 stream << self << std::endl;
                 return stream.str();
             })
             .def("is_contiguous", [](Tensor &self) { return self.isContiguous(); })
+            .def("contiguous", [](Tensor &self) { return self.contiguous(); })
             .def("broadcast_to", [](Tensor &self, const Shape &shape) {
                 return self.broadcastTo(shape);
             })
@@ -137,6 +317,21 @@ void init_tensor_module(py::module_ &m) {
             .def_static("randint", [](const std::vector<size_t> &view, int64_t min, int64_t max) {
                 return Tensor::randint(view, min, max);
             })
+            .def_static("cat", [](const std::vector<TensorPtr> &tensors, size_t dim) {
+                return Tensor::cat(tensors, dim);
+            })
+            .def_static("stack", [](const std::vector<TensorPtr> &tensors, size_t dim) {
+                return Tensor::stack(tensors, dim);
+            })
+            .def_static("where", [](const TensorPtr &mask, const TensorPtr &x, const TensorPtr &y) {
+                return Tensor::where(mask, x, y);
+            })
+            .def("masked_select", [](const Tensor &self, const Tensor &mask) {
+                return self.maskedSelect(mask);
+            })
+            .def("can_reshape_without_copy", [](const Tensor &self, const std::vector<size_t> &view) {
+                return self.canReshapeWithoutCopy(view);
+            })
             .def("reshape", [](Tensor &self, const Shape &shape) {
                 return self.reshape(shape);
             })
@@ -171,6 +366,26 @@ void init_tensor_module(py::module_ &m) {
             .def("matmul", [](Tensor &self, Tensor &rhs) {
                 return self.matmul(rhs);
             })
+            .def("linear", [](Tensor &self, const TensorPtr &weight, const TensorPtr &bias, Activation activation) {
+                return self.linear(weight, bias, activation);
+            })
+            .def_static("einsum", [](const std::string &subscripts, const std::vector<TensorPtr> &operands) {
+                return Tensor::einsum(subscripts, operands);
+            })
+            .def("conv1d", [](Tensor &self, const TensorPtr &weight, const TensorPtr &bias, size_t stride,
+                              size_t padding, Layout layout) {
+                return self.conv1d(weight, bias, stride, padding, layout);
+            })
+            .def("conv2d", [](Tensor &self, const TensorPtr &weight, const TensorPtr &bias, size_t stride,
+                              size_t padding, Layout layout) {
+                return self.conv2d(weight, bias, stride, padding, layout);
+            })
+            .def("max_pool2d", [](Tensor &self, size_t kernelSize, size_t stride, size_t padding, Layout layout) {
+                return self.maxPool2d(kernelSize, stride, padding, layout);
+            })
+            .def("avg_pool2d", [](Tensor &self, size_t kernelSize, size_t stride, size_t padding, Layout layout) {
+                return self.avgPool2d(kernelSize, stride, padding, layout);
+            })
             .def("__pow__", [](Tensor &self, real c) {
                 return self.pow(c);
             })
@@ -234,6 +449,42 @@ void init_tensor_module(py::module_ &m) {
             .def("__ge__", [](Tensor &self, real c) {
                 return self.geq(c);
             })
+            .def("eq", [](Tensor &self, Tensor &rhs, DType dtype) {
+                return self.eq(rhs, true, nullptr, dtype);
+            })
+            .def("eq", [](Tensor &self, real c, DType dtype) {
+                return self.eq(c, true, nullptr, dtype);
+            })
+            .def("ne", [](Tensor &self, Tensor &rhs, DType dtype) {
+                return self.neq(rhs, true, nullptr, dtype);
+            })
+            .def("ne", [](Tensor &self, real c, DType dtype) {
+                return self.neq(c, true, nullptr, dtype);
+            })
+            .def("lt", [](Tensor &self, Tensor &rhs, DType dtype) {
+                return self.lt(rhs, true, nullptr, dtype);
+            })
+            .def("lt", [](Tensor &self, real c, DType dtype) {
+                return self.lt(c, true, nullptr, dtype);
+            })
+            .def("gt", [](Tensor &self, Tensor &rhs, DType dtype) {
+                return self.gt(rhs, true, nullptr, dtype);
+            })
+            .def("gt", [](Tensor &self, real c, DType dtype) {
+                return self.gt(c, true, nullptr, dtype);
+            })
+            .def("le", [](Tensor &self, Tensor &rhs, DType dtype) {
+                return self.leq(rhs, true, nullptr, dtype);
+            })
+            .def("le", [](Tensor &self, real c, DType dtype) {
+                return self.leq(c, true, nullptr, dtype);
+            })
+            .def("ge", [](Tensor &self, Tensor &rhs, DType dtype) {
+                return self.geq(rhs, true, nullptr, dtype);
+            })
+            .def("ge", [](Tensor &self, real c, DType dtype) {
+                return self.geq(c, true, nullptr, dtype);
+            })
             .def("__iadd__", [](Tensor &self, Tensor &rhs) {
                 return self.addAssign(rhs);
             })
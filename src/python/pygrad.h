@@ -4,6 +4,7 @@
 
 #pragma once
 #include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
 #include <pybind11/stl.h>
 
 namespace py = pybind11;
@@ -11,4 +12,5 @@ namespace py = pybind11;
 void init_vec_module(py::module_ &);
 void init_shape_module(py::module_ &);
 void init_tensor_module(py::module_ &);
-void init_nn_module(py::module &);
\ No newline at end of file
+void init_nn_module(py::module &);
+void init_grad_mode_module(py::module_ &);
\ No newline at end of file
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+namespace Toygrad::Tensor {
+    // Small vector of dimension sizes or strides. Up to inlineCapacity values are stored inside the object so copying
+    // a shape does not allocate, tensors with more dimensions fall back to a heap buffer.
+    class Dims {
+    public:
+        static constexpr size_t inlineCapacity = 8;
+        using iterator = size_t *;
+        using const_iterator = const size_t *;
+        using reverse_iterator = std::reverse_iterator<iterator>;
+        using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+    private:
+        size_t inlineData[inlineCapacity] = {};
+        std::unique_ptr<size_t[]> heapData = nullptr;
+        size_t numDims = 0;
+        size_t capacity = inlineCapacity;
+
+        size_t *data() { return heapData == nullptr ? inlineData : heapData.get(); }
+
+        const size_t *data() const { return heapData == nullptr ? inlineData : heapData.get(); }
+
+        void reserve(size_t newCapacity) {
+            if (newCapacity <= capacity) {
+                return;
+            }
+
+            newCapacity = std::max(newCapacity, 2 * capacity);
+            auto newData = std::make_unique<size_t[]>(newCapacity);
+            std::copy_n(data(), numDims, newData.get());
+            heapData = std::move(newData);
+            capacity = newCapacity;
+        }
+
+    public:
+        constexpr Dims() = default;
+
+        explicit Dims(size_t numDims, size_t value = 0) {
+            resize(numDims, value);
+        }
+
+        Dims(std::initializer_list<size_t> values) {
+            assign(values.begin(), values.end());
+        }
+
+        Dims(const std::vector<size_t> &values) {
+            assign(values.begin(), values.end());
+        }
+
+        Dims(const Dims &dims) {
+            assign(dims.begin(), dims.end());
+        }
+
+        Dims &operator=(const Dims &rhs) {
+            if (this != &rhs) {
+                numDims = 0;
+                assign(rhs.begin(), rhs.end());
+            }
+
+            return *this;
+        }
+
+        template<class Iter>
+        void assign(Iter first, Iter last) {
+            size_t n = std::distance(first, last);
+            reserve(n);
+            std::copy(first, last, data());
+            numDims = n;
+        }
+
+        void resize(size_t n, size_t value = 0) {
+            reserve(n);
+
+            if (n > numDims) {
+                std::fill(data() + numDims, data() + n, value);
+            }
+
+            numDims = n;
+        }
+
+        void push_back(size_t value) {
+            reserve(numDims + 1);
+            data()[numDims++] = value;
+        }
+
+        iterator insert(const_iterator pos, size_t value) {
+            size_t idx = pos - data();
+            reserve(numDims + 1);
+            std::copy_backward(data() + idx, data() + numDims, data() + numDims + 1);
+            data()[idx] = value;
+            numDims++;
+            return data() + idx;
+        }
+
+        iterator erase(const_iterator pos) {
+            size_t idx = pos - data();
+            std::copy(data() + idx + 1, data() + numDims, data() + idx);
+            numDims--;
+            return data() + idx;
+        }
+
+        size_t size() const { return numDims; }
+
+        bool empty() const { return numDims == 0; }
+
+        size_t &operator[](size_t idx) { return data()[idx]; }
+
+        size_t operator[](size_t idx) const { return data()[idx]; }
+
+        std::vector<size_t> toVec() const { return {begin(), end()}; }
+
+        bool operator==(const Dims &rhs) const {
+            return std::equal(begin(), end(), rhs.begin(), rhs.end());
+        }
+
+        bool operator!=(const Dims &rhs) const {
+            return !(*this == rhs);
+        }
+
+        iterator begin() { return data(); }
+
+        iterator end() { return data() + numDims; }
+
+        const_iterator begin() const { return data(); }
+
+        const_iterator end() const { return data() + numDims; }
+
+        const_iterator cbegin() const { return begin(); }
+
+        const_iterator cend() const { return end(); }
+
+        reverse_iterator rbegin() { return reverse_iterator(end()); }
+
+        reverse_iterator rend() { return reverse_iterator(begin()); }
+
+        const_reverse_iterator crbegin() const { return const_reverse_iterator(cend()); }
+
+        const_reverse_iterator crend() const { return const_reverse_iterator(cbegin()); }
+    };
+}
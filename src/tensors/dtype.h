@@ -0,0 +1,203 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+
+namespace Toygrad::Tensor {
+    enum class DType {
+        FLOAT32, FLOAT64, INT32, INT64, BOOL, FLOAT16, BFLOAT16,
+        // One bit per element packed into bytes, used for masks
+        BITMASK
+    };
+
+    inline std::unordered_map<DType, std::string> dtype2Str = {
+        {DType::FLOAT32, "FLOAT32"}, {DType::FLOAT64, "FLOAT64"}, {DType::INT32, "INT32"}, {DType::INT64, "INT64"},
+        {DType::BOOL, "BOOL"}, {DType::FLOAT16, "FLOAT16"}, {DType::BFLOAT16, "BFLOAT16"},
+        {DType::BITMASK, "BITMASK"}
+    };
+
+    // IEEE 754 half precision number stored as raw bits, arithmetic goes through float
+    struct Half {
+        uint16_t bits = 0;
+
+        Half() = default;
+
+        Half(float x): bits(fromFloat(x)) {
+        }
+
+        operator float() const {
+            return toFloat(bits);
+        }
+
+        // Rounds to the nearest half, ties to even
+        static uint16_t fromFloat(float x) {
+            uint32_t f;
+            std::memcpy(&f, &x, sizeof(f));
+            auto sign = static_cast<uint16_t>((f >> 16) & 0x8000);
+            f &= 0x7fffffff;
+
+            if (f >= 0x7f800000) {
+                // Infinity stays infinity and NaN stays a quiet NaN
+                return sign | 0x7c00 | (f > 0x7f800000 ? 0x200 : 0);
+            }
+
+            if (f >= 0x477ff000) {
+                // Rounds past the largest half, 65504
+                return sign | 0x7c00;
+            }
+
+            if (f < 0x38800000) {
+                // Below the smallest normal half, adding 0.5 aligns the float's last bit with the half's
+                float y;
+                std::memcpy(&y, &f, sizeof(y));
+                y += 0.5f;
+                std::memcpy(&f, &y, sizeof(f));
+                return sign | static_cast<uint16_t>(f - 0x3f000000);
+            }
+
+            // Rebiases the exponent from 127 to 15 and rounds away the 13 extra mantissa bits
+            f += 0xc8000fff + ((f >> 13) & 1);
+            return sign | static_cast<uint16_t>(f >> 13);
+        }
+
+        static float toFloat(uint16_t h) {
+            uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+            uint32_t exp = (h >> 10) & 0x1f;
+            uint32_t mant = h & 0x3ff;
+            uint32_t f;
+
+            if (exp == 0x1f) {
+                f = sign | 0x7f800000 | (mant << 13);
+            } else if (exp == 0) {
+                // Subnormal halves are exact multiples of 2^-24
+                float y = static_cast<float>(mant) * 0x1p-24f;
+                std::memcpy(&f, &y, sizeof(f));
+                f |= sign;
+            } else {
+                f = sign | ((exp + 112) << 23) | (mant << 13);
+            }
+
+            float x;
+            std::memcpy(&x, &f, sizeof(x));
+            return x;
+        }
+    };
+
+    // Brain floating point number, the upper half of a float
+    struct BFloat16 {
+        uint16_t bits = 0;
+
+        BFloat16() = default;
+
+        BFloat16(float x): bits(fromFloat(x)) {
+        }
+
+        operator float() const {
+            return toFloat(bits);
+        }
+
+        // Rounds to the nearest bfloat16, ties to even
+        static uint16_t fromFloat(float x) {
+            uint32_t f;
+            std::memcpy(&f, &x, sizeof(f));
+
+            if ((f & 0x7fffffff) > 0x7f800000) {
+                return static_cast<uint16_t>((f >> 16) | 0x40);
+            }
+
+            f += 0x7fff + ((f >> 16) & 1);
+            return static_cast<uint16_t>(f >> 16);
+        }
+
+        static float toFloat(uint16_t b) {
+            uint32_t f = static_cast<uint32_t>(b) << 16;
+            float x;
+            std::memcpy(&x, &f, sizeof(x));
+            return x;
+        }
+    };
+
+    /**
+     * Calls a function templated on the C++ type that stores the given data type, e.g.
+     * dispatch(dtype, [&]<class T>() { ... }). Kernels use it to pick the instantiation for a tensor's data type.
+     * Bitmasks have no element type, they are dispatched as their bytes and must be handled by the caller.
+     * @param dtype the data type.
+     * @param f the templated function.
+     * @return the result of the function.
+     */
+    template<class F>
+    decltype(auto) dispatch(DType dtype, F &&f) {
+        switch (dtype) {
+            case DType::FLOAT64:
+                return f.template operator()<double>();
+            case DType::INT32:
+                return f.template operator()<int32_t>();
+            case DType::INT64:
+                return f.template operator()<int64_t>();
+            case DType::BOOL:
+                return f.template operator()<bool>();
+            case DType::FLOAT16:
+                return f.template operator()<Half>();
+            case DType::BFLOAT16:
+                return f.template operator()<BFloat16>();
+            case DType::BITMASK:
+                return f.template operator()<uint8_t>();
+            default:
+                return f.template operator()<float>();
+        }
+    }
+
+    inline size_t getDTypeSize(DType dtype) {
+        return dispatch(dtype, []<class T>() { return sizeof(T); });
+    }
+
+    // Number of bytes taken by the given number of elements
+    inline size_t getNumBytes(DType dtype, size_t numel) {
+        return dtype == DType::BITMASK ? (numel + 7) / 8 : numel * getDTypeSize(dtype);
+    }
+
+    inline bool isFloatingPoint(DType dtype) {
+        return dtype == DType::FLOAT32 || dtype == DType::FLOAT64 || dtype == DType::FLOAT16 ||
+               dtype == DType::BFLOAT16;
+    }
+
+    /**
+     * Reads an element of a mask, which is true when the element is nonzero.
+     * @param data the first byte of the mask's memory.
+     * @param dtype the data type of the mask.
+     * @param idx the index of the element.
+     * @return whether the element is set.
+     */
+    inline bool readMask(const std::byte *data, DType dtype, size_t idx) {
+        if (dtype == DType::BITMASK) {
+            return (std::to_integer<uint8_t>(data[idx / 8]) >> (idx % 8)) & 1;
+        }
+
+        return dispatch(dtype, [&]<class T>() {
+            return static_cast<float>(reinterpret_cast<const T *>(data)[idx]) != 0.f;
+        });
+    }
+
+    /**
+     * Writes an element of a mask.
+     * @param data the first byte of the mask's memory.
+     * @param dtype the data type of the mask.
+     * @param idx the index of the element.
+     * @param value whether the element is set.
+     */
+    inline void writeMask(std::byte *data, DType dtype, size_t idx, bool value) {
+        if (dtype == DType::BITMASK) {
+            auto bit = static_cast<std::byte>(1 << (idx % 8));
+            data[idx / 8] = value ? data[idx / 8] | bit : data[idx / 8] & ~bit;
+            return;
+        }
+
+        dispatch(dtype, [&]<class T>() {
+            reinterpret_cast<T *>(data)[idx] = static_cast<T>(value);
+        });
+    }
+}
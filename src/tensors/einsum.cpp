@@ -0,0 +1,330 @@
+#include <algorithm>
+#include <cctype>
+#include <limits>
+#include <unordered_map>
+#include "tensor.h"
+
+namespace Toygrad::Tensor {
+    // Operand of an einsum with one label per dimension, a scalar has no labels and the shape (1)
+    struct EinsumTerm {
+        TensorPtr tensor;
+        std::string labels;
+    };
+
+    using LabelSizes = std::unordered_map<char, size_t>;
+    using ContractionPath = std::vector<std::pair<size_t, size_t> >;
+
+    // Operand counts up to which every contraction order is tried, larger ones are ordered greedily
+    constexpr size_t optimalPathMaxOperands = 5;
+
+    // Labels of both terms, in order of appearance, that the rest of the expression still needs
+    static std::string getKeptLabels(const std::string &lhs, const std::string &rhs, const std::string &needed) {
+        std::string labels;
+
+        for (char label: lhs + rhs) {
+            if (needed.find(label) != std::string::npos && labels.find(label) == std::string::npos) {
+                labels += label;
+            }
+        }
+
+        return labels;
+    }
+
+    // Labels of the output and of every term but the two given ones
+    static std::string getNeededLabels(const std::vector<std::string> &terms, size_t i, size_t j,
+                                       const std::string &output) {
+        std::string needed = output;
+
+        for (size_t t = 0; t < terms.size(); t++) {
+            if (t != i && t != j) {
+                needed += terms[t];
+            }
+        }
+
+        return needed;
+    }
+
+    // Number of multiply-adds of a pairwise contraction, one per combination of the labels of both terms
+    static double getContractionCost(const std::string &lhs, const std::string &rhs, const LabelSizes &sizes) {
+        double cost = 1;
+        std::string labels;
+
+        for (char label: lhs + rhs) {
+            if (labels.find(label) == std::string::npos) {
+                labels += label;
+                cost *= static_cast<double>(sizes.at(label));
+            }
+        }
+
+        return cost;
+    }
+
+    // Tries every pair to contract next and returns the cheapest total cost of contracting the remaining terms,
+    // contracted terms are removed and their result is appended as in numpy's contraction paths
+    static double findOptimalPath(const std::vector<std::string> &terms, const std::string &output,
+                                  const LabelSizes &sizes, ContractionPath &path) {
+        if (terms.size() <= 1) {
+            return 0;
+        }
+
+        double bestCost = std::numeric_limits<double>::infinity();
+
+        for (size_t i = 0; i < terms.size(); i++) {
+            for (size_t j = i + 1; j < terms.size(); j++) {
+                std::vector<std::string> next;
+
+                for (size_t t = 0; t < terms.size(); t++) {
+                    if (t != i && t != j) {
+                        next.push_back(terms[t]);
+                    }
+                }
+
+                next.push_back(getKeptLabels(terms[i], terms[j], getNeededLabels(terms, i, j, output)));
+                ContractionPath rest;
+                double cost = getContractionCost(terms[i], terms[j], sizes) +
+                              findOptimalPath(next, output, sizes, rest);
+
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    path = {{i, j}};
+                    path.insert(path.end(), rest.begin(), rest.end());
+                }
+            }
+        }
+
+        return bestCost;
+    }
+
+    // Repeatedly contracts the pair that costs the fewest multiply-adds, preferring the smaller result on ties
+    static ContractionPath findGreedyPath(std::vector<std::string> terms, const std::string &output,
+                                          const LabelSizes &sizes) {
+        ContractionPath path;
+
+        while (terms.size() > 1) {
+            std::pair<size_t, size_t> best;
+            double bestCost = std::numeric_limits<double>::infinity();
+            double bestSize = 0;
+            std::string bestLabels;
+
+            for (size_t i = 0; i < terms.size(); i++) {
+                for (size_t j = i + 1; j < terms.size(); j++) {
+                    std::string labels = getKeptLabels(terms[i], terms[j], getNeededLabels(terms, i, j, output));
+                    double cost = getContractionCost(terms[i], terms[j], sizes);
+                    double size = getContractionCost(labels, "", sizes);
+
+                    if (cost < bestCost || (cost == bestCost && size < bestSize)) {
+                        best = {i, j};
+                        bestCost = cost;
+                        bestSize = size;
+                        bestLabels = labels;
+                    }
+                }
+            }
+
+            terms.erase(terms.begin() + static_cast<int64_t>(best.second));
+            terms.erase(terms.begin() + static_cast<int64_t>(best.first));
+            terms.push_back(bestLabels);
+            path.push_back(best);
+        }
+
+        return path;
+    }
+
+    // Permutes the dimensions of a term to the given order of its labels, a term already in order is returned as is
+    static TensorPtr permuteTerm(const EinsumTerm &term, const std::string &labels, bool lazy) {
+        if (term.labels == labels) {
+            return term.tensor;
+        }
+
+        std::vector<size_t> shapePerm;
+
+        for (char label: labels) {
+            shapePerm.push_back(term.labels.find(label));
+        }
+
+        return term.tensor->perm(shapePerm, lazy);
+    }
+
+    // Reshapes a tensor unless it already has the given dimensions, no dimensions stand for a scalar
+    static TensorPtr reshapeTo(const TensorPtr &tensor, std::vector<size_t> view, bool lazy) {
+        if (view.empty()) {
+            view.push_back(1);
+        }
+
+        if (tensor->getShape().getView() == Dims(view)) {
+            return tensor;
+        }
+
+        return tensor->reshape(view, lazy);
+    }
+
+    // Sums the dimensions of a term whose labels are not needed
+    static EinsumTerm reduceTerm(const EinsumTerm &term, const std::string &needed, bool lazy) {
+        EinsumTerm result = term;
+
+        for (size_t i = term.labels.size(); i > 0; i--) {
+            if (needed.find(term.labels[i - 1]) != std::string::npos) {
+                continue;
+            }
+
+            result.tensor = result.labels.size() == 1 ? result.tensor->sum(-1, lazy)
+                                                      : result.tensor->sum(static_cast<int64_t>(i - 1), lazy);
+            result.labels.erase(i - 1, 1);
+        }
+
+        return result;
+    }
+
+    // Contracts two terms with one batched matmul. The labels both terms keep become batch dimensions, those only one
+    // term has become the rows or the columns and the shared labels nothing else needs are summed by the product.
+    static EinsumTerm contractTerms(const EinsumTerm &lhs, const EinsumTerm &rhs, const std::string &needed,
+                                    const LabelSizes &sizes, bool lazy) {
+        EinsumTerm left = reduceTerm(lhs, needed + rhs.labels, lazy);
+        EinsumTerm right = reduceTerm(rhs, needed + lhs.labels, lazy);
+        std::string batch, rows, shared, cols;
+
+        for (char label: left.labels) {
+            if (right.labels.find(label) == std::string::npos) {
+                rows += label;
+            } else if (needed.find(label) != std::string::npos) {
+                batch += label;
+            } else {
+                shared += label;
+            }
+        }
+
+        for (char label: right.labels) {
+            if (left.labels.find(label) == std::string::npos) {
+                cols += label;
+            }
+        }
+
+        auto getSize = [&](const std::string &labels) {
+            size_t size = 1;
+
+            for (char label: labels) {
+                size *= sizes.at(label);
+            }
+
+            return size;
+        };
+
+        // Dimensions of the same kind are merged, which only copies when the permuted operand cannot be viewed so
+        std::vector<size_t> view;
+
+        for (char label: batch) {
+            view.push_back(sizes.at(label));
+        }
+
+        std::vector<size_t> lhsView = view;
+        lhsView.insert(lhsView.end(), {getSize(rows), getSize(shared)});
+        std::vector<size_t> rhsView = view;
+        rhsView.insert(rhsView.end(), {getSize(shared), getSize(cols)});
+        auto lhsMatrix = reshapeTo(permuteTerm(left, batch + rows + shared, lazy), lhsView, lazy);
+        auto rhsMatrix = reshapeTo(permuteTerm(right, batch + shared + cols, lazy), rhsView, lazy);
+        auto product = lhsMatrix->matmul(rhsMatrix, lazy);
+
+        for (char label: rows + cols) {
+            view.push_back(sizes.at(label));
+        }
+
+        return {reshapeTo(product, view, lazy), batch + rows + cols};
+    }
+
+    TensorPtr Tensor::einsum(const std::string &subscripts, const std::vector<TensorPtr> &operands, bool lazy) {
+        std::string spec;
+
+        for (char c: subscripts) {
+            if (c != ' ') {
+                spec += c;
+            }
+        }
+
+        size_t arrow = spec.find("->");
+        std::string inputs = spec.substr(0, arrow);
+        std::vector<EinsumTerm> terms;
+        LabelSizes sizes;
+        // Shape of the first operand with a label, reported when a later operand gives the label another size
+        [[maybe_unused]] auto getLabelShape = [&terms](char label) {
+            auto iter = std::ranges::find_if(terms, [label](const EinsumTerm &term) {
+                return term.labels.find(label) != std::string::npos;
+            });
+            return iter == terms.end() ? Shape() : iter->tensor->getShape();
+        };
+
+        for (size_t beg = 0, i = 0; beg <= inputs.size(); i++) {
+            size_t end = std::min(inputs.find(',', beg), inputs.size());
+            assert(Error::str_assert(i < operands.size(), Error::Message::invalidEinsum(subscripts)));
+            EinsumTerm term = {operands[i], inputs.substr(beg, end - beg)};
+            const Shape &shape = term.tensor->getShape();
+            assert(Error::str_assert(term.labels.size() == shape.getNumDims() ||
+                (term.labels.empty() && shape.getSize() == 1 && shape.getNumDims() == 1),
+                Error::Message::invalidEinsum(subscripts)));
+
+            for (size_t d = 0; d < term.labels.size(); d++) {
+                char label = term.labels[d];
+                // Repeated labels within an operand, i.e. diagonals, are not supported
+                assert(Error::str_assert(std::isalpha(label) && term.labels.find(label) == d,
+                    Error::Message::invalidEinsum(subscripts)));
+                assert(Error::str_assert(!sizes.contains(label) || sizes[label] == shape[d],
+                    Error::Message::shapesMismatched("einsum", shape, getLabelShape(label))));
+                sizes[label] = shape[d];
+            }
+
+            terms.push_back(term);
+            beg = end + 1;
+        }
+
+        assert(Error::str_assert(terms.size() == operands.size(), Error::Message::invalidEinsum(subscripts)));
+        std::string output;
+
+        if (arrow != std::string::npos) {
+            output = spec.substr(arrow + 2);
+
+            for (size_t i = 0; i < output.size(); i++) {
+                assert(Error::str_assert(sizes.contains(output[i]) && output.find(output[i]) == i,
+                    Error::Message::invalidEinsum(subscripts)));
+            }
+        } else {
+            // Without an output the labels that appear once are kept in alphabetical order
+            for (auto &[label, size]: sizes) {
+                if (std::ranges::count(inputs, label) == 1) {
+                    output += label;
+                }
+            }
+
+            std::ranges::sort(output);
+        }
+
+        std::vector<std::string> labels;
+
+        for (auto &term: terms) {
+            labels.push_back(term.labels);
+        }
+
+        ContractionPath path;
+
+        if (terms.size() <= optimalPathMaxOperands) {
+            findOptimalPath(labels, output, sizes, path);
+        } else {
+            path = findGreedyPath(labels, output, sizes);
+        }
+
+        for (auto [i, j]: path) {
+            labels.clear();
+
+            for (auto &term: terms) {
+                labels.push_back(term.labels);
+            }
+
+            EinsumTerm result = contractTerms(terms[i], terms[j], getNeededLabels(labels, i, j, output), sizes,
+                                              lazy);
+            terms.erase(terms.begin() + static_cast<int64_t>(j));
+            terms.erase(terms.begin() + static_cast<int64_t>(i));
+            terms.push_back(result);
+        }
+
+        EinsumTerm result = reduceTerm(terms[0], output, lazy);
+        return permuteTerm(result, output, lazy);
+    }
+}
@@ -0,0 +1,5 @@
+#include "grad_mode.h"
+
+namespace Toygrad::Tensor {
+    thread_local bool GradMode::enabled = true;
+}
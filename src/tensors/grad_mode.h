@@ -0,0 +1,40 @@
+#pragma once
+
+namespace Toygrad::Tensor {
+    // Thread-local switch for the bookkeeping needed by backward propagation
+    class GradMode {
+        static thread_local bool enabled;
+
+    public:
+        /**
+         * Checks if ops created on the current thread record what backward propagation needs.
+         * @return true if gradient bookkeeping is enabled and false otherwise.
+         */
+        static bool isEnabled() { return enabled; }
+
+        /**
+         * Enables or disables gradient bookkeeping on the current thread.
+         * @param flag whether gradient bookkeeping is enabled.
+         */
+        static void setEnabled(bool flag) { enabled = flag; }
+    };
+
+    // Inference mode for the lifetime of the guard: tensors created in the scope record no edges, skip gradient
+    // allocation and have their memory released as soon as the ops consuming them have been forwarded
+    class NoGradGuard {
+        bool prevEnabled;
+
+    public:
+        NoGradGuard(): prevEnabled(GradMode::isEnabled()) {
+            GradMode::setEnabled(false);
+        }
+
+        NoGradGuard(const NoGradGuard &guard) = delete;
+
+        ~NoGradGuard() {
+            GradMode::setEnabled(prevEnabled);
+        }
+
+        NoGradGuard &operator=(const NoGradGuard &guard) = delete;
+    };
+}
@@ -0,0 +1,1185 @@
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include "kernels.h"
+#include "parallel.h"
+
+#if defined(__F16C__) || defined(__AVX2__) || defined(__AVX512BF16__) || defined(__AVX512VNNI__)
+#include <immintrin.h>
+#endif
+
+namespace Toygrad::Tensor {
+    // Side of the square tiles used for transposes, 32 x 32 floats of both buffers fit in L1
+    constexpr size_t tileSize = 32;
+    // Minimum number of elements worth giving to a thread
+    constexpr size_t grainSize = 1 << 16;
+    // Number of output columns accumulated by a task of the skinny kernel, gemvMaxRows rows of them fit in L1
+    constexpr size_t gemvBlockSize = 256;
+    // Rows of both operands and columns they share in the tiles of gemm, a tile of each operand and the sums of a task
+    // fit in L1
+    constexpr size_t gemmTileRows = 32;
+    constexpr size_t gemmTileDepth = 128;
+    // Largest number of products per output, i.e. input channels x kernel height x kernel width, that convolutions
+    // compute directly instead of through im2col and gemm
+    constexpr size_t convDirectMaxDepth = 64;
+    // Number of output channels accumulated together by a task of the direct convolution, and of outputs of a row
+    // accumulated at a time so that the sums of a task fit on its stack
+    constexpr size_t convBlockSize = 8;
+    constexpr size_t convRowTile = 256;
+    // Number of left rows and of unpacked weights of a group handled at a time by a task of the int4 gemm
+    constexpr size_t int4Tile = 64;
+    // Smallest output height and width convolved with F(4x4, 3x3) rather than F(2x2, 3x3)
+    constexpr size_t winogradLargeTileMinSize = 8;
+    // Transforms of Winograd F(2x2, 3x3) and F(4x4, 3x3) stored row-major: B^T maps input tiles, G maps kernels and
+    // A^T maps products back to output tiles
+    constexpr real winogradBT2[] = {
+        1, 0, -1, 0,
+        0, 1, 1, 0,
+        0, -1, 1, 0,
+        0, 1, 0, -1
+    };
+    constexpr real winogradG2[] = {
+        1, 0, 0,
+        0.5f, 0.5f, 0.5f,
+        0.5f, -0.5f, 0.5f,
+        0, 0, 1
+    };
+    constexpr real winogradAT2[] = {
+        1, 1, 1, 0,
+        0, 1, -1, -1
+    };
+    constexpr real winogradBT4[] = {
+        4, 0, -5, 0, 1, 0,
+        0, -4, -4, 1, 1, 0,
+        0, 4, -4, -1, 1, 0,
+        0, -2, -1, 2, 1, 0,
+        0, 2, -1, -2, 1, 0,
+        0, 4, 0, -5, 0, 1
+    };
+    constexpr real winogradG4[] = {
+        1.f / 4, 0, 0,
+        -1.f / 6, -1.f / 6, -1.f / 6,
+        -1.f / 6, 1.f / 6, -1.f / 6,
+        1.f / 24, 1.f / 12, 1.f / 6,
+        1.f / 24, -1.f / 12, 1.f / 6,
+        0, 0, 1
+    };
+    constexpr real winogradAT4[] = {
+        1, 1, 1, 1, 1, 0,
+        0, 1, -1, 2, -2, 0,
+        0, 1, 1, 4, 4, 0,
+        0, 1, -1, 8, -8, 1
+    };
+
+    struct CopyPlan {
+        Dims view;
+        Dims srcStrides;
+        Dims dstStrides;
+    };
+
+    // Orders the dimensions so the destination is written in increasing order, then drops size-1 dimensions and
+    // merges the dimensions that are contiguous in both buffers
+    static CopyPlan initPlan(const Dims &srcStrides, const Dims &dstStrides, const Dims &view) {
+        Dims order(view.size());
+        std::iota(order.begin(), order.end(), 0);
+
+        // Insertion sort keeps equal strides in order without the buffer of std::stable_sort, shapes have few
+        // dimensions
+        for (size_t i = 1; i < order.size(); i++) {
+            for (size_t j = i; j > 0 && dstStrides[order[j - 1]] < dstStrides[order[j]]; j--) {
+                std::swap(order[j - 1], order[j]);
+            }
+        }
+
+        CopyPlan plan;
+
+        for (size_t dim: order) {
+            if (view[dim] == 1) {
+                continue;
+            }
+
+            size_t last = plan.view.size() - 1;
+
+            if (!plan.view.empty() && plan.srcStrides[last] == srcStrides[dim] * view[dim] &&
+                plan.dstStrides[last] == dstStrides[dim] * view[dim]) {
+                plan.view[last] *= view[dim];
+                plan.srcStrides[last] = srcStrides[dim];
+                plan.dstStrides[last] = dstStrides[dim];
+            } else {
+                plan.view.push_back(view[dim]);
+                plan.srcStrides.push_back(srcStrides[dim]);
+                plan.dstStrides.push_back(dstStrides[dim]);
+            }
+        }
+
+        return plan;
+    }
+
+    // Computes the offsets of the idx-th position over the given outer dimensions
+    static void outerOffsets(const CopyPlan &plan, const Dims &outer, size_t idx, size_t &srcOffset,
+                             size_t &dstOffset) {
+        srcOffset = 0;
+        dstOffset = 0;
+
+        for (size_t k = outer.size(); k > 0; k--) {
+            size_t dim = outer[k - 1];
+            size_t i = idx % plan.view[dim];
+            idx /= plan.view[dim];
+            srcOffset += i * plan.srcStrides[dim];
+            dstOffset += i * plan.dstStrides[dim];
+        }
+    }
+
+    // Converts a row of contiguous elements eight at a time with the conversion instructions the build targets, e.g.
+    // F16C for halves and AVX512-BF16 for bfloat16, and one at a time in software otherwise. Both round to nearest
+    // even, AVX512-BF16 additionally flushes subnormal inputs to zero.
+    template<class Src, class Dst>
+    static void convertRow(const Src *src, Dst *dst, size_t n) {
+        size_t i = 0;
+#ifdef __F16C__
+        if constexpr (std::is_same_v<Src, Half> && std::is_same_v<Dst, float>) {
+            for (; i + 8 <= n; i += 8) {
+                __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+                _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(h));
+            }
+        } else if constexpr (std::is_same_v<Src, float> && std::is_same_v<Dst, Half>) {
+            for (; i + 8 <= n; i += 8) {
+                __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), h);
+            }
+        }
+#endif
+#ifdef __AVX2__
+        if constexpr (std::is_same_v<Src, BFloat16> && std::is_same_v<Dst, float>) {
+            // A bfloat16 is the upper half of a float
+            for (; i + 8 <= n; i += 8) {
+                __m256i w = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i)));
+                _mm256_storeu_ps(dst + i, _mm256_castsi256_ps(_mm256_slli_epi32(w, 16)));
+            }
+        }
+#endif
+#if defined(__AVX512BF16__) && defined(__AVX512VL__)
+        if constexpr (std::is_same_v<Src, float> && std::is_same_v<Dst, BFloat16>) {
+            for (; i + 8 <= n; i += 8) {
+                __m128bh b = _mm256_cvtneps_pbh(_mm256_loadu_ps(src + i));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), std::bit_cast<__m128i>(b));
+            }
+        }
+#endif
+
+        for (; i < n; i++) {
+            dst[i] = static_cast<Dst>(src[i]);
+        }
+    }
+
+    template<class Src, class Dst>
+    static void copyKernel(const Src *src, const Dims &srcStrides, Dst *dst, const Dims &dstStrides,
+                           const Dims &view) {
+        if (std::ranges::find(view, 0) != view.end()) {
+            return;
+        }
+
+        CopyPlan plan = initPlan(srcStrides, dstStrides, view);
+
+        if (plan.view.empty()) {
+            *dst = static_cast<Dst>(*src);
+            return;
+        }
+
+        // b is the dimension written contiguously and a the one read most contiguously
+        size_t b = plan.view.size() - 1;
+        size_t a = std::ranges::min_element(plan.srcStrides) - plan.srcStrides.begin();
+        Dims outer;
+        size_t numOuter = 1;
+
+        for (size_t dim = 0; dim < plan.view.size(); dim++) {
+            if (dim != b && (dim != a || plan.srcStrides[a] >= plan.srcStrides[b])) {
+                outer.push_back(dim);
+                numOuter *= plan.view[dim];
+            }
+        }
+
+        size_t cols = plan.view[b];
+        size_t srcStrideB = plan.srcStrides[b];
+        size_t dstStrideB = plan.dstStrides[b];
+
+        if (outer.size() == plan.view.size() - 1) {
+            // Both buffers are read and written most contiguously along b so copy row by row
+            parallelFor(0, numOuter, std::max<size_t>(grainSize / cols, 1), [&](size_t lo, size_t hi) {
+                size_t srcOffset, dstOffset;
+
+                for (size_t row = lo; row < hi; row++) {
+                    outerOffsets(plan, outer, row, srcOffset, dstOffset);
+
+                    if (srcStrideB == 1 && dstStrideB == 1) {
+                        if constexpr (std::is_same_v<Src, Dst>) {
+                            std::copy_n(src + srcOffset, cols, dst + dstOffset);
+                        } else {
+                            convertRow(src + srcOffset, dst + dstOffset, cols);
+                        }
+
+                        continue;
+                    }
+
+                    for (size_t j = 0; j < cols; j++) {
+                        dst[dstOffset + j * dstStrideB] = static_cast<Dst>(src[srcOffset + j * srcStrideB]);
+                    }
+                }
+            });
+
+            return;
+        }
+
+        // Transpose of a and b in tiles, each task covers one band of rows of a
+        size_t rows = plan.view[a];
+        size_t srcStrideA = plan.srcStrides[a];
+        size_t dstStrideA = plan.dstStrides[a];
+        size_t numBands = (rows + tileSize - 1) / tileSize;
+
+        parallelFor(0, numOuter * numBands, std::max<size_t>(grainSize / (tileSize * cols), 1),
+                    [&](size_t lo, size_t hi) {
+                        size_t srcOffset, dstOffset;
+
+                        for (size_t task = lo; task < hi; task++) {
+                            outerOffsets(plan, outer, task / numBands, srcOffset, dstOffset);
+                            size_t rowBeg = task % numBands * tileSize;
+                            size_t rowEnd = std::min(rowBeg + tileSize, rows);
+
+                            for (size_t colBeg = 0; colBeg < cols; colBeg += tileSize) {
+                                size_t colEnd = std::min(colBeg + tileSize, cols);
+
+                                for (size_t i = rowBeg; i < rowEnd; i++) {
+                                    const Src *srcRow = src + srcOffset + i * srcStrideA;
+                                    Dst *dstRow = dst + dstOffset + i * dstStrideA;
+
+                                    for (size_t j = colBeg; j < colEnd; j++) {
+                                        dstRow[j * dstStrideB] = static_cast<Dst>(srcRow[j * srcStrideB]);
+                                    }
+                                }
+                            }
+                        }
+                    });
+    }
+
+    void stridedCopy(const real *src, const Dims &srcStrides, real *dst, const Dims &dstStrides, const Dims &view) {
+        copyKernel(src, srcStrides, dst, dstStrides, view);
+    }
+
+    // Copies through the mask accessors, which address single bits of bitmasks
+    static void maskKernel(const Vec &src, size_t srcOffset, const Dims &srcStrides, Vec &dst, size_t dstOffset,
+                           const Dims &dstStrides, const Dims &view) {
+        CopyPlan plan = initPlan(srcStrides, dstStrides, view);
+        Dims outer(plan.view.size());
+        std::iota(outer.begin(), outer.end(), 0);
+        size_t numel = std::accumulate(view.begin(), view.end(), size_t(1), std::multiplies<>());
+        size_t srcIdx, dstIdx;
+
+        for (size_t i = 0; i < numel; i++) {
+            outerOffsets(plan, outer, i, srcIdx, dstIdx);
+            writeMask(dst.buff.get(), dst.dtype, dstOffset + dstIdx,
+                      readMask(src.buff.get(), src.dtype, srcOffset + srcIdx));
+        }
+    }
+
+    void stridedCast(const Vec &src, size_t srcOffset, const Dims &srcStrides, Vec &dst, size_t dstOffset,
+                     const Dims &dstStrides, const Dims &view) {
+        if (src.dtype == DType::BITMASK || dst.dtype == DType::BITMASK) {
+            maskKernel(src, srcOffset, srcStrides, dst, dstOffset, dstStrides, view);
+            return;
+        }
+
+        dispatch(src.dtype, [&]<class Src>() {
+            dispatch(dst.dtype, [&]<class Dst>() {
+                copyKernel(src.getData<Src>() + srcOffset, srcStrides, dst.getData<Dst>() + dstOffset, dstStrides,
+                           view);
+            });
+        });
+    }
+
+    Vec &Workspace::get(size_t size, DType dtype) {
+        auto fits = [&](const std::unique_ptr<Vec> &buffer) { return buffer->size == size && buffer->dtype == dtype; };
+
+        // A call that skips a buffer, e.g. when a cached value is found instead of computed, shifts the ones after it,
+        // which are then found further on instead of being allocated again
+        if (auto it = std::find_if(buffers.begin() + next, buffers.end(), fits); it != buffers.end()) {
+            std::iter_swap(buffers.begin() + next, it);
+        } else if (next < buffers.size()) {
+            buffers[next] = std::make_unique<Vec>(size, dtype);
+        } else {
+            buffers.push_back(std::make_unique<Vec>(size, dtype));
+        }
+
+        return *buffers[next++];
+    }
+
+    // Returns the rows of a matrix as contiguous float32 rows, converting and packing them into a buffer of the
+    // workspace unless they already are
+    static const real *loadPanel(const Vec &vec, size_t offset, const Dims &strides, size_t rows, size_t cols,
+                                 Workspace &workspace, size_t &ld) {
+        if (vec.dtype == DType::FLOAT32 && (strides[1] == 1 || cols <= 1)) {
+            ld = strides[0];
+            return vec.getData<real>() + offset;
+        }
+
+        Vec &buffer = workspace.get(rows * cols);
+        stridedCast(vec, offset, strides, buffer, 0, {cols, 1}, {rows, cols});
+        ld = cols;
+        return buffer.getData<real>();
+    }
+
+    // Returns a block of rows x cols elements of a matrix starting at offset as float32 rows, pointing into the matrix
+    // when its rows already are and converting the block into tile otherwise, so that reduced precision operands are
+    // converted a tile at a time as they are multiplied instead of into a float32 copy of the whole matrix
+    static const real *loadTile(const Vec &vec, size_t offset, const Dims &strides, size_t rows, size_t cols,
+                                real *tile, size_t &ld) {
+        if (vec.dtype == DType::FLOAT32 && (strides[1] == 1 || cols <= 1)) {
+            ld = strides[0];
+            return vec.getData<real>() + offset;
+        }
+
+        ld = cols;
+
+        if (vec.dtype == DType::BITMASK) {
+            for (size_t i = 0; i < rows; i++) {
+                for (size_t j = 0; j < cols; j++) {
+                    tile[i * cols + j] = readMask(vec.buff.get(), vec.dtype, offset + i * strides[0] + j * strides[1]);
+                }
+            }
+
+            return tile;
+        }
+
+        dispatch(vec.dtype, [&]<class T>() {
+            const T *src = vec.getData<T>() + offset;
+
+            for (size_t i = 0; i < rows; i++) {
+                if (strides[1] == 1) {
+                    convertRow(src + i * strides[0], tile + i * cols, cols);
+                    continue;
+                }
+
+                for (size_t j = 0; j < cols; j++) {
+                    tile[i * cols + j] = static_cast<real>(src[i * strides[0] + j * strides[1]]);
+                }
+            }
+        });
+
+        return tile;
+    }
+
+    // Writes a sum of gemm to its output element through the epilogue
+    static void store(real sum, size_t j, real &out, const Epilogue &epilogue) {
+        if (epilogue.bias != nullptr) {
+            sum += epilogue.bias[j * epilogue.biasStride];
+        }
+
+        if (epilogue.activation == Activation::RELU) {
+            sum = std::max(sum, 0.f);
+        } else if (epilogue.activation == Activation::SIGMOID) {
+            sum = 1.f / (1.f + exp(-sum));
+        }
+
+        out = epilogue.accumulate ? out + sum : sum;
+    }
+
+    // Multiplies at most gemvMaxRows left rows by a right matrix whose rows are contiguous along the output columns,
+    // e.g. the weight of a linear layer. Each task owns a block of output columns and reads every row of its block of
+    // the right matrix once, converting it to float32 if needed, for all the left rows, which are converted a tile at a
+    // time.
+    template<class T>
+    static void skinnyKernel(const Vec &lhs, size_t lhsOffset, const Dims &lhsStrides, const T *b, size_t ldb,
+                             real *out, const Dims &outStrides, size_t m, size_t n, size_t k,
+                             const Epilogue &epilogue) {
+        size_t numBlocks = (n + gemvBlockSize - 1) / gemvBlockSize;
+        size_t grain = std::max<size_t>(grainSize / std::max<size_t>(gemvBlockSize * k, 1), 1);
+
+        parallelFor(0, numBlocks, grain, [&](size_t lo, size_t hi) {
+            real acc[gemvMaxRows][gemvBlockSize];
+            real converted[gemvBlockSize];
+            real aTile[gemvMaxRows * gemvBlockSize];
+
+            for (size_t block = lo; block < hi; block++) {
+                size_t beg = block * gemvBlockSize;
+                size_t len = std::min(gemvBlockSize, n - beg);
+
+                for (size_t i = 0; i < m; i++) {
+                    std::fill_n(acc[i], len, 0);
+                }
+
+                for (size_t pBeg = 0; pBeg < k; pBeg += gemvBlockSize) {
+                    size_t depth = std::min(gemvBlockSize, k - pBeg);
+                    size_t lda;
+                    const real *a = loadTile(lhs, lhsOffset + pBeg * lhsStrides[1], lhsStrides, m, depth, aTile, lda);
+
+                    for (size_t p = 0; p < depth; p++) {
+                        const real *bRow = converted;
+
+                        if constexpr (std::is_same_v<T, real>) {
+                            bRow = b + (pBeg + p) * ldb + beg;
+                        } else {
+                            convertRow(b + (pBeg + p) * ldb + beg, converted, len);
+                        }
+
+                        for (size_t i = 0; i < m; i++) {
+                            real aElm = a[i * lda + p];
+                            real *accRow = acc[i];
+
+                            for (size_t j = 0; j < len; j++) {
+                                accRow[j] += aElm * bRow[j];
+                            }
+                        }
+                    }
+                }
+
+                for (size_t i = 0; i < m; i++) {
+                    for (size_t j = 0; j < len; j++) {
+                        store(acc[i][j], beg + j, out[i * outStrides[0] + (beg + j) * outStrides[1]], epilogue);
+                    }
+                }
+            }
+        });
+    }
+
+    void gemm(const Vec &lhs, size_t lhsOffset, const Dims &lhsStrides, const Vec &rhs, size_t rhsOffset,
+              const Dims &rhsStrides, real *out, const Dims &outStrides, size_t m, size_t n, size_t k,
+              const Epilogue &epilogue) {
+        // Batches of a few rows, e.g. online inference, stream the right matrix in its natural layout instead of
+        // packing a transposed copy of it for a handful of dot products per element
+        if (m <= gemvMaxRows && (rhsStrides[0] == 1 || n == 1) && rhs.dtype != DType::BITMASK) {
+            dispatch(rhs.dtype, [&]<class T>() {
+                skinnyKernel(lhs, lhsOffset, lhsStrides, rhs.getData<T>() + rhsOffset, rhsStrides[1], out,
+                             outStrides, m, n, k, epilogue);
+            });
+            return;
+        }
+
+        // Each task computes a tile of the output, accumulating the products of the tiles of both operands along
+        // their shared columns so that only a tile of each is converted at a time. Every sum still adds its products
+        // in column order.
+        size_t numRowTiles = (m + gemmTileRows - 1) / gemmTileRows;
+        size_t numColTiles = (n + gemmTileRows - 1) / gemmTileRows;
+        size_t grain = std::max<size_t>(grainSize / std::max<size_t>(gemmTileRows * gemmTileRows * k, 1), 1);
+
+        parallelFor(0, numRowTiles * numColTiles, grain, [&](size_t lo, size_t hi) {
+            real aTile[gemmTileRows * gemmTileDepth];
+            real bTile[gemmTileRows * gemmTileDepth];
+            real acc[gemmTileRows * gemmTileRows];
+
+            for (size_t task = lo; task < hi; task++) {
+                size_t iBeg = task / numColTiles * gemmTileRows;
+                size_t jBeg = task % numColTiles * gemmTileRows;
+                size_t rows = std::min(gemmTileRows, m - iBeg);
+                size_t cols = std::min(gemmTileRows, n - jBeg);
+                std::fill_n(acc, rows * gemmTileRows, 0);
+
+                for (size_t pBeg = 0; pBeg < k; pBeg += gemmTileDepth) {
+                    size_t depth = std::min(gemmTileDepth, k - pBeg);
+                    size_t lda, ldb;
+                    const real *a = loadTile(lhs, lhsOffset + iBeg * lhsStrides[0] + pBeg * lhsStrides[1], lhsStrides,
+                                             rows, depth, aTile, lda);
+                    const real *b = loadTile(rhs, rhsOffset + jBeg * rhsStrides[0] + pBeg * rhsStrides[1], rhsStrides,
+                                             cols, depth, bTile, ldb);
+
+                    for (size_t i = 0; i < rows; i++) {
+                        for (size_t j = 0; j < cols; j++) {
+                            const real *aRow = a + i * lda;
+                            const real *bRow = b + j * ldb;
+                            real sum = acc[i * gemmTileRows + j];
+
+                            for (size_t p = 0; p < depth; p++) {
+                                sum += aRow[p] * bRow[p];
+                            }
+
+                            acc[i * gemmTileRows + j] = sum;
+                        }
+                    }
+                }
+
+                for (size_t i = 0; i < rows; i++) {
+                    for (size_t j = 0; j < cols; j++) {
+                        store(acc[i * gemmTileRows + j], jBeg + j,
+                              out[(iBeg + i) * outStrides[0] + (jBeg + j) * outStrides[1]], epilogue);
+                    }
+                }
+            }
+        });
+    }
+
+    void quantizeRows(const Vec &vec, size_t offset, const Dims &strides, size_t rows, size_t cols, Int8Matrix &out,
+                      Workspace &workspace) {
+        size_t ld;
+        const real *data = loadPanel(vec, offset, strides, rows, cols, workspace, ld);
+        out.rows = rows;
+        out.cols = cols;
+        out.values.resize(rows * cols);
+        out.scales.resize(rows);
+
+        parallelFor(0, rows, std::max<size_t>(grainSize / std::max<size_t>(cols, 1), 1), [&](size_t lo, size_t hi) {
+            for (size_t i = lo; i < hi; i++) {
+                const real *row = data + i * ld;
+                real maxAbs = 0;
+
+                for (size_t j = 0; j < cols; j++) {
+                    maxAbs = std::max(maxAbs, std::abs(row[j]));
+                }
+
+                out.scales[i] = maxAbs / 127;
+                real invScale = maxAbs > 0 ? 127 / maxAbs : 0;
+
+                for (size_t j = 0; j < cols; j++) {
+                    long q = std::lrint(row[j] * invScale);
+                    out.values[i * cols + j] = static_cast<int8_t>(std::clamp(q, -127L, 127L));
+                }
+            }
+        });
+    }
+
+    // Dot product of two int8 rows accumulated exactly in int32
+    static int32_t dotInt8(const int8_t *a, const int8_t *b, size_t k) {
+        size_t p = 0;
+        int32_t sum = 0;
+#if defined(__AVX512VNNI__) && defined(__AVX512BW__)
+        // dpbusd multiplies unsigned by signed bytes so a is shifted by 128, whose products with b are subtracted after
+        __m512i acc = _mm512_setzero_si512();
+        __m512i bSum = _mm512_setzero_si512();
+        const __m512i shift = _mm512_set1_epi8(static_cast<char>(0x80));
+        const __m512i ones = _mm512_set1_epi8(1);
+
+        for (; p + 64 <= k; p += 64) {
+            __m512i va = _mm512_xor_si512(_mm512_loadu_si512(a + p), shift);
+            __m512i vb = _mm512_loadu_si512(b + p);
+            acc = _mm512_dpbusd_epi32(acc, va, vb);
+            bSum = _mm512_dpbusd_epi32(bSum, ones, vb);
+        }
+
+        sum = _mm512_reduce_add_epi32(acc) - 128 * _mm512_reduce_add_epi32(bSum);
+#elif defined(__AVX2__)
+        // Bytes are widened to 16 bits so that pairs of products cannot saturate as they would with pmaddubsw
+        __m256i acc = _mm256_setzero_si256();
+
+        for (; p + 16 <= k; p += 16) {
+            __m256i va = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(a + p)));
+            __m256i vb = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(b + p)));
+            acc = _mm256_add_epi32(acc, _mm256_madd_epi16(va, vb));
+        }
+
+        __m128i half = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+        half = _mm_hadd_epi32(half, half);
+        half = _mm_hadd_epi32(half, half);
+        sum = _mm_cvtsi128_si32(half);
+#endif
+
+        for (; p < k; p++) {
+            sum += static_cast<int32_t>(a[p]) * b[p];
+        }
+
+        return sum;
+    }
+
+    void gemmInt8(const Int8Matrix &lhs, const Int8Matrix &rhs, const real *bias, real *out, const Dims &outStrides) {
+        size_t k = lhs.cols;
+        size_t n = rhs.rows;
+        size_t grain = std::max<size_t>(grainSize / std::max<size_t>(n * k, 1), 1);
+
+        parallelFor(0, lhs.rows, grain, [&](size_t lo, size_t hi) {
+            for (size_t i = lo; i < hi; i++) {
+                const int8_t *aRow = lhs.values.data() + i * k;
+
+                for (size_t j = 0; j < n; j++) {
+                    int32_t sum = dotInt8(aRow, rhs.values.data() + j * k, k);
+                    real y = static_cast<real>(sum) * lhs.scales[i] * rhs.scales[j];
+                    out[i * outStrides[0] + j * outStrides[1]] = bias == nullptr ? y : y + bias[j];
+                }
+            }
+        });
+    }
+
+    void quantizeRowsInt4(const Vec &vec, size_t offset, const Dims &strides, size_t rows, size_t cols,
+                          size_t groupSize, Int4Matrix &out, Workspace &workspace) {
+        size_t ld;
+        const real *data = loadPanel(vec, offset, strides, rows, cols, workspace, ld);
+        out.rows = rows;
+        out.cols = cols;
+        out.groupSize = groupSize;
+        size_t numGroups = out.getNumGroups();
+        size_t rowBytes = out.getRowBytes();
+        out.values.assign(rows * rowBytes, 0);
+        out.scales.resize(rows * numGroups);
+        out.zeros.resize(rows * numGroups);
+
+        parallelFor(0, rows, std::max<size_t>(grainSize / std::max<size_t>(cols, 1), 1), [&](size_t lo, size_t hi) {
+            for (size_t i = lo; i < hi; i++) {
+                const real *row = data + i * ld;
+                uint8_t *packed = out.values.data() + i * rowBytes;
+
+                for (size_t g = 0; g < numGroups; g++) {
+                    size_t beg = g * groupSize;
+                    size_t end = std::min(beg + groupSize, cols);
+                    auto [min, max] = std::minmax_element(row + beg, row + end);
+                    // A constant group keeps a unit scale so that its value is still recovered
+                    real scale = *max > *min ? (*max - *min) / 15 : 1;
+                    real zero = -*min / scale;
+                    out.scales[i * numGroups + g] = scale;
+                    out.zeros[i * numGroups + g] = zero;
+
+                    for (size_t p = beg; p < end; p++) {
+                        long q = std::clamp(std::lrint(row[p] / scale + zero), 0L, 15L);
+                        packed[p / 2] |= static_cast<uint8_t>(q << (p % 2 * 4));
+                    }
+                }
+            }
+        });
+    }
+
+    void gemmInt4(const Vec &lhs, size_t lhsOffset, const Dims &lhsStrides, size_t m, const Int4Matrix &rhs,
+                  const real *bias, real *out, const Dims &outStrides, Workspace &workspace) {
+        size_t k = rhs.cols;
+        size_t groupSize = rhs.groupSize;
+        size_t numGroups = rhs.getNumGroups();
+        size_t lda;
+        const real *a = loadPanel(lhs, lhsOffset, lhsStrides, m, k, workspace, lda);
+        // Sum of each group of each left row, which the zero points multiply
+        real *groupSums = workspace.get(m * numGroups).getData<real>();
+        std::fill_n(groupSums, m * numGroups, 0);
+
+        for (size_t i = 0; i < m; i++) {
+            for (size_t p = 0; p < k; p++) {
+                groupSums[i * numGroups + p / groupSize] += a[i * lda + p];
+            }
+        }
+
+        size_t grain = std::max<size_t>(grainSize / std::max<size_t>(m * k, 1), 1);
+
+        parallelFor(0, rhs.rows, grain, [&](size_t lo, size_t hi) {
+            real q[int4Tile];
+            real dot[int4Tile];
+            real acc[int4Tile];
+
+            for (size_t j = lo; j < hi; j++) {
+                const uint8_t *packed = rhs.values.data() + j * rhs.getRowBytes();
+
+                for (size_t rowBeg = 0; rowBeg < m; rowBeg += int4Tile) {
+                    size_t rows = std::min(int4Tile, m - rowBeg);
+                    std::fill_n(acc, rows, 0);
+
+                    for (size_t g = 0; g < numGroups; g++) {
+                        size_t beg = g * groupSize;
+                        size_t end = std::min(beg + groupSize, k);
+                        std::fill_n(dot, rows, 0);
+
+                        // The weights of the group are unpacked a tile at a time, each dot still sums them in order
+                        for (size_t tileBeg = beg; tileBeg < end; tileBeg += int4Tile) {
+                            size_t len = std::min(int4Tile, end - tileBeg);
+
+                            for (size_t p = 0; p < len; p++) {
+                                q[p] = static_cast<real>((packed[(tileBeg + p) / 2] >> ((tileBeg + p) % 2 * 4)) & 0xf);
+                            }
+
+                            for (size_t i = 0; i < rows; i++) {
+                                const real *x = a + (rowBeg + i) * lda + tileBeg;
+                                real sum = dot[i];
+
+                                for (size_t p = 0; p < len; p++) {
+                                    sum += x[p] * q[p];
+                                }
+
+                                dot[i] = sum;
+                            }
+                        }
+
+                        real scale = rhs.scales[j * numGroups + g];
+                        real zero = rhs.zeros[j * numGroups + g];
+
+                        for (size_t i = 0; i < rows; i++) {
+                            acc[i] += scale * (dot[i] - zero * groupSums[(rowBeg + i) * numGroups + g]);
+                        }
+                    }
+
+                    for (size_t i = 0; i < rows; i++) {
+                        real y = bias == nullptr ? acc[i] : acc[i] + bias[j];
+                        out[(rowBeg + i) * outStrides[0] + j * outStrides[1]] = y;
+                    }
+                }
+            }
+        });
+    }
+
+    // Strides of the batch, channel, row and column of contiguous images in the given layout, also those of the
+    // output channel, input channel, kernel row and kernel column of convolution weights
+    static Dims getImageStrides(Layout layout, size_t channels, size_t height, size_t width) {
+        if (layout == Layout::CHANNELS_LAST) {
+            return {height * width * channels, 1, width * channels, channels};
+        }
+
+        return {channels * height * width, height * width, width, 1};
+    }
+
+    // Range [lo, hi) of the outputs whose input index pos * stride + k - pad lies within [0, size)
+    static void getValidRange(size_t size, size_t outSize, size_t stride, size_t k, size_t pad, size_t &lo,
+                              size_t &hi) {
+        lo = k >= pad ? 0 : (pad - k + stride - 1) / stride;
+        hi = size + pad > k ? std::min(outSize, (size + pad - k + stride - 1) / stride) : 0;
+        lo = std::min(lo, hi);
+    }
+
+    // Calls f with the offset of every image element in the window of an output, the indices of the padding wrap
+    // around below zero and are skipped
+    template<class F>
+    static void forEachInWindow(const ConvShape &conv, const Dims &xStrides, size_t oh, size_t ow, const F &f) {
+        for (size_t kh = 0; kh < conv.kernelHeight; kh++) {
+            size_t ih = oh * conv.strideHeight + kh - conv.padHeight;
+
+            if (ih >= conv.inHeight) {
+                continue;
+            }
+
+            for (size_t kw = 0; kw < conv.kernelWidth; kw++) {
+                size_t iw = ow * conv.strideWidth + kw - conv.padWidth;
+
+                if (iw < conv.inWidth) {
+                    f(ih * xStrides[2] + iw * xStrides[3]);
+                }
+            }
+        }
+    }
+
+    // Copies the patch of each output position of an image into a row of cols, ordering the elements of the patch
+    // like the weights of an output channel so that multiplying cols by the weights computes the convolution
+    static void im2col(const ConvShape &conv, const real *x, real *cols) {
+        Dims xStrides = getImageStrides(conv.layout, conv.inChannels, conv.inHeight, conv.inWidth);
+        Dims wStrides = getImageStrides(conv.layout, conv.inChannels, conv.kernelHeight, conv.kernelWidth);
+        size_t numPos = conv.outHeight * conv.outWidth;
+        size_t depth = wStrides[0];
+
+        parallelFor(0, numPos, std::max<size_t>(grainSize / depth, 1), [&](size_t lo, size_t hi) {
+            for (size_t pos = lo; pos < hi; pos++) {
+                size_t oh = pos / conv.outWidth;
+                size_t ow = pos % conv.outWidth;
+                real *row = cols + pos * depth;
+
+                for (size_t kh = 0; kh < conv.kernelHeight; kh++) {
+                    for (size_t kw = 0; kw < conv.kernelWidth; kw++) {
+                        size_t ih = oh * conv.strideHeight + kh - conv.padHeight;
+                        size_t iw = ow * conv.strideWidth + kw - conv.padWidth;
+                        bool valid = ih < conv.inHeight && iw < conv.inWidth;
+
+                        for (size_t c = 0; c < conv.inChannels; c++) {
+                            row[c * wStrides[1] + kh * wStrides[2] + kw * wStrides[3]] =
+                                    valid ? x[c * xStrides[1] + ih * xStrides[2] + iw * xStrides[3]] : 0;
+                        }
+                    }
+                }
+            }
+        });
+    }
+
+    // Adds the rows of cols back to the image elements their patches were copied from, channels are split across
+    // threads since each one only adds to its own elements
+    static void col2im(const ConvShape &conv, const real *cols, real *x) {
+        Dims xStrides = getImageStrides(conv.layout, conv.inChannels, conv.inHeight, conv.inWidth);
+        Dims wStrides = getImageStrides(conv.layout, conv.inChannels, conv.kernelHeight, conv.kernelWidth);
+        size_t numPos = conv.outHeight * conv.outWidth;
+        size_t depth = wStrides[0];
+        size_t grain = std::max<size_t>(grainSize / std::max<size_t>(numPos * depth / conv.inChannels, 1), 1);
+
+        parallelFor(0, conv.inChannels, grain, [&](size_t lo, size_t hi) {
+            for (size_t c = lo; c < hi; c++) {
+                for (size_t pos = 0; pos < numPos; pos++) {
+                    const real *row = cols + pos * depth + c * wStrides[1];
+
+                    for (size_t kh = 0; kh < conv.kernelHeight; kh++) {
+                        for (size_t kw = 0; kw < conv.kernelWidth; kw++) {
+                            size_t ih = pos / conv.outWidth * conv.strideHeight + kh - conv.padHeight;
+                            size_t iw = pos % conv.outWidth * conv.strideWidth + kw - conv.padWidth;
+
+                            if (ih < conv.inHeight && iw < conv.inWidth) {
+                                x[c * xStrides[1] + ih * xStrides[2] + iw * xStrides[3]] +=
+                                        row[kh * wStrides[2] + kw * wStrides[3]];
+                            }
+                        }
+                    }
+                }
+            }
+        });
+    }
+
+    // Convolves without im2col. Each task computes a block of output channels for a row of outputs, a tile of the row
+    // at a time, every input element it reads is multiplied by the weights of the whole block and the loop over the
+    // row has no bound checks.
+    static void convDirect(const ConvShape &conv, const real *x, const real *weight, const real *bias, real *out) {
+        Dims xStrides = getImageStrides(conv.layout, conv.inChannels, conv.inHeight, conv.inWidth);
+        Dims wStrides = getImageStrides(conv.layout, conv.inChannels, conv.kernelHeight, conv.kernelWidth);
+        Dims outStrides = getImageStrides(conv.layout, conv.outChannels, conv.outHeight, conv.outWidth);
+        size_t numBlocks = (conv.outChannels + convBlockSize - 1) / convBlockSize;
+        size_t numTasks = conv.batchSize * numBlocks * conv.outHeight;
+        size_t grain = std::max<size_t>(grainSize / std::max<size_t>(convBlockSize * conv.outWidth * wStrides[0], 1),
+                                        1);
+
+        parallelFor(0, numTasks, grain, [&](size_t lo, size_t hi) {
+            // Sums of a tile of the row for each output channel of the block, indexed from the start of the tile
+            real acc[convBlockSize * convRowTile];
+
+            for (size_t task = lo; task < hi; task++) {
+                size_t n = task / (numBlocks * conv.outHeight);
+                size_t beg = task / conv.outHeight % numBlocks * convBlockSize;
+                size_t len = std::min(convBlockSize, conv.outChannels - beg);
+                size_t oh = task % conv.outHeight;
+                const real *image = x + n * xStrides[0];
+                real *outRow = out + n * outStrides[0] + oh * outStrides[2];
+
+                for (size_t tileBeg = 0; tileBeg < conv.outWidth; tileBeg += convRowTile) {
+                    size_t tileEnd = std::min(tileBeg + convRowTile, conv.outWidth);
+
+                    for (size_t o = 0; o < len; o++) {
+                        std::fill_n(acc + o * convRowTile, tileEnd - tileBeg, bias == nullptr ? 0 : bias[beg + o]);
+                    }
+
+                    for (size_t kh = 0; kh < conv.kernelHeight; kh++) {
+                        size_t ih = oh * conv.strideHeight + kh - conv.padHeight;
+
+                        if (ih >= conv.inHeight) {
+                            continue;
+                        }
+
+                        for (size_t kw = 0; kw < conv.kernelWidth; kw++) {
+                            size_t owLo, owHi;
+                            getValidRange(conv.inWidth, conv.outWidth, conv.strideWidth, kw, conv.padWidth, owLo,
+                                          owHi);
+                            owLo = std::max(owLo, tileBeg);
+                            owHi = std::min(owHi, tileEnd);
+
+                            for (size_t c = 0; c < conv.inChannels; c++) {
+                                const real *xRow = image + c * xStrides[1] + ih * xStrides[2];
+                                const real *w = weight + beg * wStrides[0] + c * wStrides[1] + kh * wStrides[2] +
+                                                kw * wStrides[3];
+
+                                for (size_t o = 0; o < len; o++) {
+                                    real wElm = w[o * wStrides[0]];
+                                    real *accRow = acc + o * convRowTile;
+
+                                    for (size_t ow = owLo; ow < owHi; ow++) {
+                                        accRow[ow - tileBeg] += wElm * xRow[(ow * conv.strideWidth + kw - conv.padWidth) *
+                                                                  xStrides[3]];
+                                    }
+                                }
+                            }
+                        }
+                    }
+
+                    for (size_t o = 0; o < len; o++) {
+                        for (size_t ow = tileBeg; ow < tileEnd; ow++) {
+                            outRow[(beg + o) * outStrides[1] + ow * outStrides[3]] =
+                                    acc[o * convRowTile + ow - tileBeg];
+                        }
+                    }
+                }
+            }
+        });
+    }
+
+    void conv2d(const ConvShape &conv, const Vec &x, size_t xOffset, const Vec &weight, size_t weightOffset,
+                const real *bias, real *out, Workspace &workspace) {
+        Dims xStrides = getImageStrides(conv.layout, conv.inChannels, conv.inHeight, conv.inWidth);
+        Dims outStrides = getImageStrides(conv.layout, conv.outChannels, conv.outHeight, conv.outWidth);
+        size_t depth = conv.inChannels * conv.kernelHeight * conv.kernelWidth;
+        size_t numPos = conv.outHeight * conv.outWidth;
+        bool pointwise = conv.kernelHeight == 1 && conv.kernelWidth == 1 && conv.strideHeight == 1 &&
+                         conv.strideWidth == 1 && conv.padHeight == 0 && conv.padWidth == 0;
+
+        if (depth <= convDirectMaxDepth && !pointwise) {
+            convDirect(conv, x.getData<real>() + xOffset, weight.getData<real>() + weightOffset, bias, out);
+            return;
+        }
+
+        // The output positions of an image are the rows of the product and the output channels its columns
+        Dims outMatrixStrides = {outStrides[3], outStrides[1]};
+        Vec *cols = pointwise ? nullptr : &workspace.get(numPos * depth);
+
+        for (size_t n = 0; n < conv.batchSize; n++) {
+            size_t imageOffset = xOffset + n * xStrides[0];
+            real *outImage = out + n * outStrides[0];
+
+            if (pointwise) {
+                // The pixels of the image already are the rows of the product
+                gemm(x, imageOffset, {xStrides[3], xStrides[1]}, weight, weightOffset, {depth, 1}, outImage,
+                     outMatrixStrides, numPos, conv.outChannels, depth, {.bias = bias});
+            } else {
+                im2col(conv, x.getData<real>() + imageOffset, cols->getData<real>());
+                gemm(*cols, 0, {depth, 1}, weight, weightOffset, {depth, 1}, outImage, outMatrixStrides, numPos,
+                     conv.outChannels, depth, {.bias = bias});
+            }
+        }
+    }
+
+    void conv2dBackward(const ConvShape &conv, const Vec &x, size_t xOffset, const Vec &weight, size_t weightOffset,
+                        const Vec &outGrad, size_t outGradOffset, real *xGrad, real *weightGrad, real *biasGrad,
+                        Workspace &workspace) {
+        Dims xStrides = getImageStrides(conv.layout, conv.inChannels, conv.inHeight, conv.inWidth);
+        Dims outStrides = getImageStrides(conv.layout, conv.outChannels, conv.outHeight, conv.outWidth);
+        size_t depth = conv.inChannels * conv.kernelHeight * conv.kernelWidth;
+        size_t numPos = conv.outHeight * conv.outWidth;
+        const real *dy = outGrad.getData<real>() + outGradOffset;
+
+        // db += sum of the output gradient over the images and positions
+        if (biasGrad != nullptr) {
+            size_t grain = std::max<size_t>(grainSize / std::max<size_t>(conv.batchSize * numPos, 1), 1);
+
+            parallelFor(0, conv.outChannels, grain, [&](size_t lo, size_t hi) {
+                for (size_t o = lo; o < hi; o++) {
+                    for (size_t n = 0; n < conv.batchSize; n++) {
+                        for (size_t pos = 0; pos < numPos; pos++) {
+                            biasGrad[o] += dy[n * outStrides[0] + o * outStrides[1] + pos * outStrides[3]];
+                        }
+                    }
+                }
+            });
+        }
+
+        Vec &cols = workspace.get(numPos * depth);
+
+        for (size_t n = 0; n < conv.batchSize; n++) {
+            size_t gradOffset = outGradOffset + n * outStrides[0];
+
+            // dw += dy^T @ cols
+            if (weightGrad != nullptr) {
+                im2col(conv, x.getData<real>() + xOffset + n * xStrides[0], cols.getData<real>());
+                gemm(outGrad, gradOffset, {outStrides[1], outStrides[3]}, cols, 0, {1, depth}, weightGrad, {depth, 1},
+                     conv.outChannels, depth, numPos, {.accumulate = true});
+            }
+
+            // dcols = dy @ w, whose rows are added back to the patches of dx
+            if (xGrad != nullptr) {
+                gemm(outGrad, gradOffset, {outStrides[3], outStrides[1]}, weight, weightOffset, {1, depth},
+                     cols.getData<real>(), {depth, 1}, numPos, depth, conv.outChannels);
+                col2im(conv, cols.getData<real>(), xGrad + n * xStrides[0]);
+            }
+        }
+    }
+
+    void pool2d(const ConvShape &pool, Pooling pooling, const real *x, real *out) {
+        Dims xStrides = getImageStrides(pool.layout, pool.inChannels, pool.inHeight, pool.inWidth);
+        Dims outStrides = getImageStrides(pool.layout, pool.inChannels, pool.outHeight, pool.outWidth);
+        size_t numRows = pool.batchSize * pool.inChannels * pool.outHeight;
+        size_t windowSize = pool.kernelHeight * pool.kernelWidth;
+        size_t grain = std::max<size_t>(grainSize / std::max<size_t>(pool.outWidth * windowSize, 1), 1);
+
+        parallelFor(0, numRows, grain, [&](size_t lo, size_t hi) {
+            for (size_t row = lo; row < hi; row++) {
+                size_t n = row / (pool.inChannels * pool.outHeight);
+                size_t c = row / pool.outHeight % pool.inChannels;
+                size_t oh = row % pool.outHeight;
+                const real *plane = x + n * xStrides[0] + c * xStrides[1];
+
+                for (size_t ow = 0; ow < pool.outWidth; ow++) {
+                    real result = pooling == Pooling::MAX ? -std::numeric_limits<real>::infinity() : 0;
+                    size_t count = 0;
+
+                    forEachInWindow(pool, xStrides, oh, ow, [&](size_t offset) {
+                        result = pooling == Pooling::MAX ? std::max(result, plane[offset]) : result + plane[offset];
+                        count++;
+                    });
+
+                    out[n * outStrides[0] + c * outStrides[1] + oh * outStrides[2] + ow * outStrides[3]] =
+                            pooling == Pooling::AVG ? result / static_cast<real>(count) : result;
+                }
+            }
+        });
+    }
+
+    void pool2dBackward(const ConvShape &pool, Pooling pooling, const real *x, const real *outGrad, real *xGrad) {
+        Dims xStrides = getImageStrides(pool.layout, pool.inChannels, pool.inHeight, pool.inWidth);
+        Dims outStrides = getImageStrides(pool.layout, pool.inChannels, pool.outHeight, pool.outWidth);
+        size_t numPlanes = pool.batchSize * pool.inChannels;
+        size_t windowSize = pool.kernelHeight * pool.kernelWidth;
+        size_t grain = std::max<size_t>(
+            grainSize / std::max<size_t>(pool.outHeight * pool.outWidth * windowSize, 1), 1);
+
+        // Windows overlap when the stride is smaller than the kernel, so threads own whole planes of the gradient
+        parallelFor(0, numPlanes, grain, [&](size_t lo, size_t hi) {
+            for (size_t plane = lo; plane < hi; plane++) {
+                size_t n = plane / pool.inChannels;
+                size_t c = plane % pool.inChannels;
+                size_t xOffset = n * xStrides[0] + c * xStrides[1];
+
+                for (size_t oh = 0; oh < pool.outHeight; oh++) {
+                    for (size_t ow = 0; ow < pool.outWidth; ow++) {
+                        real g = outGrad[n * outStrides[0] + c * outStrides[1] + oh * outStrides[2] +
+                                         ow * outStrides[3]];
+
+                        if (pooling == Pooling::MAX) {
+                            size_t argmax = std::numeric_limits<size_t>::max();
+                            real max = 0;
+
+                            forEachInWindow(pool, xStrides, oh, ow, [&](size_t offset) {
+                                if (argmax == std::numeric_limits<size_t>::max() || x[xOffset + offset] > max) {
+                                    max = x[xOffset + offset];
+                                    argmax = offset;
+                                }
+                            });
+
+                            xGrad[xOffset + argmax] += g;
+                        } else {
+                            size_t count = 0;
+                            forEachInWindow(pool, xStrides, oh, ow, [&](size_t) { count++; });
+                            forEachInWindow(pool, xStrides, oh, ow, [&](size_t offset) {
+                                xGrad[xOffset + offset] += g / static_cast<real>(count);
+                            });
+                        }
+                    }
+                }
+            }
+        });
+    }
+
+    // Multiplies the small matrices of the Winograd transforms, out = lhs @ rhs where lhs is row-major and the element
+    // (p, j) of rhs is at p * rhsRowStride + j * rhsColStride, so that a transform is also read as its transpose
+    static void multiplySmall(const real *lhs, const real *rhs, size_t rhsRowStride, size_t rhsColStride, real *out,
+                              size_t rows, size_t inner, size_t cols) {
+        for (size_t i = 0; i < rows; i++) {
+            for (size_t j = 0; j < cols; j++) {
+                real sum = 0;
+
+                for (size_t p = 0; p < inner; p++) {
+                    sum += lhs[i * inner + p] * rhs[p * rhsRowStride + j * rhsColStride];
+                }
+
+                out[i * cols + j] = sum;
+            }
+        }
+    }
+
+    size_t getWinogradTileSize(const ConvShape &conv) {
+        if (conv.kernelHeight != 3 || conv.kernelWidth != 3 || conv.strideHeight != 1 || conv.strideWidth != 1 ||
+            conv.inChannels * 9 <= convDirectMaxDepth) {
+            return 0;
+        }
+
+        return conv.outHeight >= winogradLargeTileMinSize && conv.outWidth >= winogradLargeTileMinSize ? 4 : 2;
+    }
+
+    void winogradFilter(const ConvShape &conv, size_t tileSize, const real *weight, real *out) {
+        Dims wStrides = getImageStrides(conv.layout, conv.inChannels, conv.kernelHeight, conv.kernelWidth);
+        const real *g = tileSize == 4 ? winogradG4 : winogradG2;
+        size_t alpha = tileSize + 2;
+        size_t numKernels = conv.outChannels * conv.inChannels;
+
+        parallelFor(0, numKernels, std::max<size_t>(grainSize / (alpha * alpha * 3), 1), [&](size_t lo, size_t hi) {
+            real kernel[9], tmp[6 * 3], transformed[6 * 6];
+
+            for (size_t idx = lo; idx < hi; idx++) {
+                size_t o = idx / conv.inChannels;
+                size_t c = idx % conv.inChannels;
+
+                for (size_t kh = 0; kh < 3; kh++) {
+                    for (size_t kw = 0; kw < 3; kw++) {
+                        kernel[kh * 3 + kw] = weight[o * wStrides[0] + c * wStrides[1] + kh * wStrides[2] +
+                                                     kw * wStrides[3]];
+                    }
+                }
+
+                // U = G g G^T
+                multiplySmall(g, kernel, 3, 1, tmp, alpha, 3, 3);
+                multiplySmall(tmp, g, 1, 3, transformed, alpha, 3, alpha);
+
+                for (size_t xi = 0; xi < alpha * alpha; xi++) {
+                    out[(xi * conv.outChannels + o) * conv.inChannels + c] = transformed[xi];
+                }
+            }
+        });
+    }
+
+    void conv2dWinograd(const ConvShape &conv, size_t tileSize, const Vec &x, size_t xOffset, const Vec &filter,
+                        const real *bias, real *out, Workspace &workspace) {
+        Dims xStrides = getImageStrides(conv.layout, conv.inChannels, conv.inHeight, conv.inWidth);
+        Dims outStrides = getImageStrides(conv.layout, conv.outChannels, conv.outHeight, conv.outWidth);
+        const real *bt = tileSize == 4 ? winogradBT4 : winogradBT2;
+        const real *at = tileSize == 4 ? winogradAT4 : winogradAT2;
+        size_t alpha = tileSize + 2;
+        size_t tilesHigh = (conv.outHeight + tileSize - 1) / tileSize;
+        size_t tilesWide = (conv.outWidth + tileSize - 1) / tileSize;
+        size_t tilesPerImage = tilesHigh * tilesWide;
+        size_t numTiles = conv.batchSize * tilesPerImage;
+        size_t grain = std::max<size_t>(grainSize / (alpha * alpha * std::max(conv.inChannels, conv.outChannels)), 1);
+        // V holds the transformed input tiles as one matrix of tiles x input channels per element of a tile and M the
+        // products as matrices of tiles x output channels
+        Vec &v = workspace.get(alpha * alpha * numTiles * conv.inChannels);
+        Vec &m = workspace.get(alpha * alpha * numTiles * conv.outChannels);
+        const real *image = x.getData<real>() + xOffset;
+        real *vData = v.getData<real>();
+        real *mData = m.getData<real>();
+
+        // V = B^T d B for the input tile d of every tile and channel, read past the image and its padding as zeros
+        parallelFor(0, numTiles, grain, [&](size_t lo, size_t hi) {
+            real d[6 * 6], tmp[6 * 6], transformed[6 * 6];
+
+            for (size_t tile = lo; tile < hi; tile++) {
+                size_t n = tile / tilesPerImage;
+                size_t th = tile / tilesWide % tilesHigh;
+                size_t tw = tile % tilesWide;
+
+                for (size_t c = 0; c < conv.inChannels; c++) {
+                    for (size_t i = 0; i < alpha; i++) {
+                        for (size_t j = 0; j < alpha; j++) {
+                            size_t ih = th * tileSize + i - conv.padHeight;
+                            size_t iw = tw * tileSize + j - conv.padWidth;
+                            d[i * alpha + j] = ih < conv.inHeight && iw < conv.inWidth
+                                                   ? image[n * xStrides[0] + c * xStrides[1] + ih * xStrides[2] +
+                                                           iw * xStrides[3]]
+                                                   : 0;
+                        }
+                    }
+
+                    multiplySmall(bt, d, alpha, 1, tmp, alpha, alpha, alpha);
+                    multiplySmall(tmp, bt, 1, alpha, transformed, alpha, alpha, alpha);
+
+                    for (size_t xi = 0; xi < alpha * alpha; xi++) {
+                        vData[(xi * numTiles + tile) * conv.inChannels + c] = transformed[xi];
+                    }
+                }
+            }
+        });
+
+        // M = V U for every element of a tile, the elementwise products of the tiles summed over the input channels
+        for (size_t xi = 0; xi < alpha * alpha; xi++) {
+            gemm(v, xi * numTiles * conv.inChannels, {conv.inChannels, 1}, filter,
+                 xi * conv.outChannels * conv.inChannels, {conv.inChannels, 1},
+                 mData + xi * numTiles * conv.outChannels, {conv.outChannels, 1}, numTiles, conv.outChannels,
+                 conv.inChannels);
+        }
+
+        // Y = A^T M A for every tile and output channel, the outputs past the edges of partial tiles are dropped
+        parallelFor(0, numTiles, grain, [&](size_t lo, size_t hi) {
+            real product[6 * 6], tmp[4 * 6], y[4 * 4];
+
+            for (size_t tile = lo; tile < hi; tile++) {
+                size_t n = tile / tilesPerImage;
+                size_t th = tile / tilesWide % tilesHigh;
+                size_t tw = tile % tilesWide;
+
+                for (size_t o = 0; o < conv.outChannels; o++) {
+                    for (size_t xi = 0; xi < alpha * alpha; xi++) {
+                        product[xi] = mData[(xi * numTiles + tile) * conv.outChannels + o];
+                    }
+
+                    multiplySmall(at, product, alpha, 1, tmp, tileSize, alpha, alpha);
+                    multiplySmall(tmp, at, 1, alpha, y, tileSize, alpha, tileSize);
+
+                    for (size_t i = 0; i < tileSize; i++) {
+                        for (size_t j = 0; j < tileSize; j++) {
+                            size_t oh = th * tileSize + i;
+                            size_t ow = tw * tileSize + j;
+
+                            if (oh < conv.outHeight && ow < conv.outWidth) {
+                                out[n * outStrides[0] + o * outStrides[1] + oh * outStrides[2] + ow * outStrides[3]] =
+                                        y[i * tileSize + j] + (bias == nullptr ? 0 : bias[o]);
+                            }
+                        }
+                    }
+                }
+            }
+        });
+    }
+}
+
@@ -0,0 +1,270 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "dims.h"
+#include "vec.h"
+#include "quant.h"
+
+namespace Toygrad::Tensor {
+    // Largest number of left rows that gemm multiplies by streaming the right matrix in its natural layout
+    constexpr size_t gemvMaxRows = 8;
+
+    // Scratch memory of the kernels and ops, handed out in the order it is asked for. A workspace kept across calls on
+    // the same shapes, e.g. by the steps of a captured plan, returns the buffers of the previous call so that the
+    // calls after the first allocate nothing.
+    class Workspace {
+        std::vector<std::unique_ptr<Vec> > buffers;
+        size_t next = 0;
+
+    public:
+        /**
+         * Gets the next scratch buffer, reusing a buffer of the same size and type that this call has not been handed
+         * yet, i.e. the one the previous call got at the same point. Its elements are left over from earlier calls.
+         * @param size the number of elements.
+         * @param dtype the type of the elements.
+         * @return the buffer.
+         */
+        Vec &get(size_t size, DType dtype = DType::FLOAT32);
+
+        // Hands out the buffers again from the first one, at the start of each call
+        void reset() { next = 0; }
+    };
+
+    /**
+     * Copies an N-dimensional strided block of elements, i.e. dst[index . dstStrides] = src[index . srcStrides] for
+     * every index within view. Dimensions that are contiguous in both buffers are merged first so dense copies run as
+     * plain row copies, and transposes are copied in square tiles that fit in cache so that both the reads and the
+     * writes stay local. Large copies are split across threads.
+     * @param src the first source element.
+     * @param srcStrides the source strides.
+     * @param dst the first destination element.
+     * @param dstStrides the destination strides.
+     * @param view the sizes of the dimensions.
+     */
+    void stridedCopy(const real *src, const Dims &srcStrides, real *dst, const Dims &dstStrides, const Dims &view);
+
+    /**
+     * Copies an N-dimensional strided block of elements like stridedCopy, converting each element from the type of
+     * the source buffer to the type of the destination buffer. The kernel is instantiated for every pair of data
+     * types. Bitmasks are read and written bit by bit on a single thread since neighboring bits share bytes.
+     * @param src the source buffer.
+     * @param srcOffset the index of the first source element.
+     * @param srcStrides the source strides.
+     * @param dst the destination buffer.
+     * @param dstOffset the index of the first destination element.
+     * @param dstStrides the destination strides.
+     * @param view the sizes of the dimensions.
+     */
+    void stridedCast(const Vec &src, size_t srcOffset, const Dims &srcStrides, Vec &dst, size_t dstOffset,
+                     const Dims &dstStrides, const Dims &view);
+
+    // Work done on each output element of gemm while it is still in a register: the bias of its column is added, the
+    // activation is applied and the result is either stored or added to the output
+    struct Epilogue {
+        const real *bias = nullptr;
+        size_t biasStride = 1;
+        Activation activation = Activation::NONE;
+        bool accumulate = false;
+    };
+
+    /**
+     * Multiplies an M x K matrix by the transpose of an N x K matrix, i.e. out[i, j] = sum of lhs[i, p] * rhs[j, p].
+     * Operands of any data type and layout are converted to float32 a tile at a time as they are multiplied, so
+     * reduced precision weights and activations are read from memory at half the bandwidth and no float32 copy of an
+     * operand is made, and products are accumulated in float32. The epilogue is applied to each sum as it is written
+     * so the output is only written once.
+     * @param lhs the left buffer.
+     * @param lhsOffset the index of the first left element.
+     * @param lhsStrides the left row and column strides.
+     * @param rhs the right buffer.
+     * @param rhsOffset the index of the first right element.
+     * @param rhsStrides the right row and column strides.
+     * @param out the first output element.
+     * @param outStrides the output row and column strides.
+     * @param m the number of left rows.
+     * @param n the number of right rows.
+     * @param k the number of columns of both operands.
+     * @param epilogue the bias, activation and accumulation applied to the sums.
+     */
+    void gemm(const Vec &lhs, size_t lhsOffset, const Dims &lhsStrides, const Vec &rhs, size_t rhsOffset,
+              const Dims &rhsStrides, real *out, const Dims &outStrides, size_t m, size_t n, size_t k,
+              const Epilogue &epilogue = {});
+
+    /**
+     * Quantizes each row of a matrix of any data type and layout to int8 values in [-127, 127] with one scale per row,
+     * the largest magnitude of the row mapping to 127.
+     * @param vec the buffer of the matrix.
+     * @param offset the index of the first element.
+     * @param strides the row and column strides.
+     * @param rows the number of rows.
+     * @param cols the number of columns.
+     * @param out the quantized matrix.
+     * @param workspace the scratch memory of the rows converted to float32.
+     */
+    void quantizeRows(const Vec &vec, size_t offset, const Dims &strides, size_t rows, size_t cols, Int8Matrix &out,
+                      Workspace &workspace);
+
+    /**
+     * Multiplies two int8 matrices with the same number of columns, i.e. out[i, j] = sum of lhs[i, p] * rhs[j, p],
+     * accumulating exactly in int32 with VNNI or AVX2 instructions when the build targets them. The sums are
+     * dequantized with both row scales and the bias is added as they are written.
+     * @param lhs the left matrix.
+     * @param rhs the right matrix.
+     * @param bias the bias added to each output row, or nullptr.
+     * @param out the first output element.
+     * @param outStrides the output row and column strides.
+     */
+    void gemmInt8(const Int8Matrix &lhs, const Int8Matrix &rhs, const real *bias, real *out, const Dims &outStrides);
+
+    /**
+     * Quantizes each group of consecutive elements of each row of a matrix of any data type and layout to 4-bit values
+     * in [0, 15], the smallest and largest elements of the group mapping to 0 and 15.
+     * @param vec the buffer of the matrix.
+     * @param offset the index of the first element.
+     * @param strides the row and column strides.
+     * @param rows the number of rows.
+     * @param cols the number of columns.
+     * @param groupSize the number of elements that share a scale and a zero point.
+     * @param out the quantized matrix.
+     * @param workspace the scratch memory of the rows converted to float32.
+     */
+    void quantizeRowsInt4(const Vec &vec, size_t offset, const Dims &strides, size_t rows, size_t cols,
+                          size_t groupSize, Int4Matrix &out, Workspace &workspace);
+
+    /**
+     * Multiplies an M x K matrix by the transpose of 4-bit weights with K columns, i.e. out[i, j] = sum of lhs[i, p] *
+     * rhs[j, p] + bias[j]. Each group of weights is unpacked once into a small buffer that stays in cache while every
+     * row of lhs is multiplied by it, and the zero point is applied to the sum of the group instead of each element.
+     * The weights are streamed once, which is what matters when M is small.
+     * @param lhs the left buffer.
+     * @param lhsOffset the index of the first left element.
+     * @param lhsStrides the left row and column strides.
+     * @param m the number of left rows.
+     * @param rhs the quantized weights.
+     * @param bias the bias added to each output row, or nullptr.
+     * @param out the first output element.
+     * @param outStrides the output row and column strides.
+     * @param workspace the scratch memory of the left rows converted to float32 and of their group sums.
+     */
+    void gemmInt4(const Vec &lhs, size_t lhsOffset, const Dims &lhsStrides, size_t m, const Int4Matrix &rhs,
+                  const real *bias, real *out, const Dims &outStrides, Workspace &workspace);
+
+    // Sizes of a convolution or pooling over a batch of images, 1D signals are images of height 1. Images are stored
+    // contiguously in the given layout and convolution weights as output channels x input channels x kernel height x
+    // kernel width, or with the input channels last for channels last images. Pooling has as many output channels as
+    // input channels.
+    struct ConvShape {
+        size_t batchSize;
+        size_t inChannels;
+        size_t outChannels;
+        size_t inHeight;
+        size_t inWidth;
+        size_t outHeight;
+        size_t outWidth;
+        size_t kernelHeight;
+        size_t kernelWidth;
+        size_t strideHeight;
+        size_t strideWidth;
+        size_t padHeight;
+        size_t padWidth;
+        Layout layout;
+    };
+
+    /**
+     * Convolves a batch of images with weights and adds the bias, the padding reads zeros. Kernels with few products
+     * per output, e.g. over the color channels of the first layer, are computed directly, each task accumulating a
+     * block of output channels over a row of outputs so that every input row it reads is reused for the whole block.
+     * Larger kernels copy the patches of each image into the rows of a matrix, i.e. im2col, and multiply it by the
+     * weights with gemm, and 1x1 kernels without stride or padding multiply the image in place.
+     * @param conv the sizes of the convolution.
+     * @param x the buffer of the contiguous float32 images.
+     * @param xOffset the index of the first image element.
+     * @param weight the buffer of the contiguous float32 weights.
+     * @param weightOffset the index of the first weight.
+     * @param bias the bias of each output channel, or nullptr.
+     * @param out the first element of the contiguous outputs.
+     * @param workspace the scratch memory of the im2col matrix.
+     */
+    void conv2d(const ConvShape &conv, const Vec &x, size_t xOffset, const Vec &weight, size_t weightOffset,
+                const real *bias, real *out, Workspace &workspace);
+
+    /**
+     * Computes the gradients of a convolution from the gradient of its outputs and adds them to the given contiguous
+     * buffers. The weight gradient multiplies the output gradient by the im2col matrix of each image and the input
+     * gradient multiplies it by the weights and scatters the resulting patches back into the image, i.e. col2im.
+     * @param conv the sizes of the convolution.
+     * @param x the buffer of the contiguous float32 images.
+     * @param xOffset the index of the first image element.
+     * @param weight the buffer of the contiguous float32 weights.
+     * @param weightOffset the index of the first weight.
+     * @param outGrad the buffer of the contiguous float32 output gradient.
+     * @param outGradOffset the index of the first output gradient element.
+     * @param xGrad the first element of the input gradient, or nullptr.
+     * @param weightGrad the first element of the weight gradient, or nullptr.
+     * @param biasGrad the first element of the bias gradient, or nullptr.
+     * @param workspace the scratch memory of the im2col matrix.
+     */
+    void conv2dBackward(const ConvShape &conv, const Vec &x, size_t xOffset, const Vec &weight, size_t weightOffset,
+                        const Vec &outGrad, size_t outGradOffset, real *xGrad, real *weightGrad, real *biasGrad,
+                        Workspace &workspace);
+
+    /**
+     * Takes the maximum or the average of each window of a batch of images, the padding is skipped. Rows of outputs
+     * are split across threads.
+     * @param pool the sizes of the pooling.
+     * @param pooling the reduction of each window.
+     * @param x the first element of the contiguous images.
+     * @param out the first element of the contiguous outputs.
+     */
+    void pool2d(const ConvShape &pool, Pooling pooling, const real *x, real *out);
+
+    /**
+     * Adds the gradient of a pooling to the gradient of its images. The gradient of a maximum goes to the first
+     * largest element of the window and that of an average is spread evenly over the elements of the window.
+     * @param pool the sizes of the pooling.
+     * @param pooling the reduction of each window.
+     * @param x the first element of the contiguous images.
+     * @param outGrad the first element of the contiguous output gradient.
+     * @param xGrad the first element of the contiguous image gradient.
+     */
+    void pool2dBackward(const ConvShape &pool, Pooling pooling, const real *x, const real *outGrad, real *xGrad);
+
+    /**
+     * Picks the output tile size of the Winograd algorithm for a convolution, F(4x4, 3x3) when the output is large
+     * enough for most of its tiles to be full and F(2x2, 3x3) otherwise. Only 3x3 kernels without stride and with
+     * enough input channels for the im2col path are computed with Winograd.
+     * @param conv the sizes of the convolution.
+     * @return 4 or 2, or 0 if the convolution does not use Winograd.
+     */
+    size_t getWinogradTileSize(const ConvShape &conv);
+
+    /**
+     * Transforms 3x3 convolution weights for the Winograd algorithm, i.e. G g G^T for the kernel g of every output
+     * and input channel. The result holds (tileSize + 2)^2 matrices of output channels x input channels, one per
+     * element of a transformed tile.
+     * @param conv the sizes of the convolution.
+     * @param tileSize the output tile size.
+     * @param weight the first element of the contiguous weights.
+     * @param out the first element of the transformed weights.
+     */
+    void winogradFilter(const ConvShape &conv, size_t tileSize, const real *weight, real *out);
+
+    /**
+     * Convolves with the Winograd algorithm, which computes each tile of tileSize x tileSize outputs of a channel from
+     * (tileSize + 2)^2 products instead of 9 per output, i.e. 2.25x fewer for F(2x2, 3x3) and 4x fewer for F(4x4,
+     * 3x3). The input tiles are transformed, multiplied by the transformed weights with one gemm per element of a
+     * tile, and transformed back into the outputs to which the bias is added.
+     * @param conv the sizes of the convolution.
+     * @param tileSize the output tile size.
+     * @param x the buffer of the contiguous float32 images.
+     * @param xOffset the index of the first image element.
+     * @param filter the weights transformed by winogradFilter.
+     * @param bias the bias of each output channel, or nullptr.
+     * @param out the first element of the contiguous outputs.
+     * @param workspace the scratch memory of the transformed input tiles and of their products.
+     */
+    void conv2dWinograd(const ConvShape &conv, size_t tileSize, const Vec &x, size_t xOffset, const Vec &filter,
+                        const real *bias, real *out, Workspace &workspace);
+}
+
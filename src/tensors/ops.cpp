@@ -2,10 +2,12 @@
 // Created by Trung Luu on 7/12/24.
 //
 
+#include <algorithm>
 #include "ops.h"
 
 #include "assert/str_assert.h"
 #include "tensor_iter.h"
+#include "kernels.h"
 
 namespace Toygrad::Tensor {
     void ConstOp::forward() {
@@ -61,7 +63,8 @@ namespace Toygrad::Tensor {
         tensor->initVec();
         IterPtr outIter = initIter(tensor);
         IterPtr opIter = initIter(operand.get());
-        real sum = 0.f;
+        // Accumulates in float64 so long sums do not lose the small terms
+        double sum = 0.;
 
         if (dim == -1) {
             for (opIter->start(); opIter->hasNext(); opIter->next()) {
@@ -69,13 +72,13 @@ namespace Toygrad::Tensor {
             }
 
             outIter->start();
-            outIter->curr() = sum;
+            outIter->curr() = static_cast<real>(sum);
         } else {
             size_t lastDim = operand->shape[operand->shape.getNumDims() - 1];
 
             for (opIter->start(), outIter->start(); opIter->hasNext(); opIter->next()) {
                 if (opIter->count() > lastDim && (opIter->count() - 1) % lastDim == 0) {
-                    outIter->curr() = sum;
+                    outIter->curr() = static_cast<real>(sum);
                     outIter->next();
                     sum = opIter->curr();
                 } else {
@@ -83,7 +86,7 @@ namespace Toygrad::Tensor {
                 }
             }
 
-            outIter->curr() = sum;
+            outIter->curr() = static_cast<real>(sum);
         }
     }
 
@@ -134,17 +137,26 @@ namespace Toygrad::Tensor {
 
     void AddOp::backward() {
         assert(Error::str_assert(tensor->grad != nullptr, Error::Message::backpropFromNull));
-        lhs->initGrad();
-        rhs->initGrad();
         IterPtr outGradIter = initIter(tensor->grad.get());
-        IterPtr lhsGradIter = initIter(lhs->grad.get());
-        IterPtr rhsGradIter = initIter(rhs->grad.get());
 
-        for (outGradIter->start(), lhsGradIter->start(), rhsGradIter->start();
-             outGradIter->hasNext();
-             outGradIter->next(), lhsGradIter->next(), rhsGradIter->next()) {
-            lhsGradIter->curr() += outGradIter->curr();
-            rhsGradIter->curr() += outGradIter->curr();
+        if (lhs->requiresGrad) {
+            lhs->initGrad();
+            IterPtr lhsGradIter = initIter(lhs->grad.get());
+
+            for (outGradIter->start(), lhsGradIter->start(); outGradIter->hasNext();
+                 outGradIter->next(), lhsGradIter->next()) {
+                lhsGradIter->curr() += outGradIter->curr();
+            }
+        }
+
+        if (rhs->requiresGrad) {
+            rhs->initGrad();
+            IterPtr rhsGradIter = initIter(rhs->grad.get());
+
+            for (outGradIter->start(), rhsGradIter->start(); outGradIter->hasNext();
+                 outGradIter->next(), rhsGradIter->next()) {
+                rhsGradIter->curr() += outGradIter->curr();
+            }
         }
     }
 
@@ -172,17 +184,26 @@ namespace Toygrad::Tensor {
 
     void SubOp::backward() {
         assert(Error::str_assert(tensor->grad != nullptr, Error::Message::backpropFromNull));
-        lhs->initGrad();
-        rhs->initGrad();
         IterPtr outGradIter = initIter(tensor->grad.get());
-        IterPtr lhsGradIter = initIter(lhs->grad.get());
-        IterPtr rhsGradIter = initIter(rhs->grad.get());
 
-        for (outGradIter->start(), lhsGradIter->start(), rhsGradIter->start();
-             outGradIter->hasNext();
-             outGradIter->next(), lhsGradIter->next(), rhsGradIter->next()) {
-            lhsGradIter->curr() += outGradIter->curr();
-            rhsGradIter->curr() -= outGradIter->curr();
+        if (lhs->requiresGrad) {
+            lhs->initGrad();
+            IterPtr lhsGradIter = initIter(lhs->grad.get());
+
+            for (outGradIter->start(), lhsGradIter->start(); outGradIter->hasNext();
+                 outGradIter->next(), lhsGradIter->next()) {
+                lhsGradIter->curr() += outGradIter->curr();
+            }
+        }
+
+        if (rhs->requiresGrad) {
+            rhs->initGrad();
+            IterPtr rhsGradIter = initIter(rhs->grad.get());
+
+            for (outGradIter->start(), rhsGradIter->start(); outGradIter->hasNext();
+                 outGradIter->next(), rhsGradIter->next()) {
+                rhsGradIter->curr() -= outGradIter->curr();
+            }
         }
     }
 
@@ -210,23 +231,34 @@ namespace Toygrad::Tensor {
 
     void MulOp::backward() {
         assert(Error::str_assert(tensor->grad != nullptr, Error::Message::backpropFromNull));
-        lhs->initGrad();
-        rhs->initGrad();
         IterPtr outGradIter = initIter(tensor->grad.get());
-        IterPtr lhsIter = initIter(lhs.get());
-        IterPtr lhsGradIter = initIter(lhs->grad.get());
-        IterPtr rhsIter = initIter(rhs.get());
-        IterPtr rhsGradIter = initIter(rhs->grad.get());
 
         // z = x*y
         // dx += dz*y
         // dy += dx*x
 
-        for (outGradIter->start(), lhsIter->start(), lhsGradIter->start(), rhsIter->start(), rhsGradIter->start();
-             outGradIter->hasNext();
-             outGradIter->next(), lhsIter->next(), lhsGradIter->next(), rhsIter->next(), rhsGradIter->next()) {
-            lhsGradIter->curr() += outGradIter->curr() * rhsIter->curr();
-            rhsGradIter->curr() += outGradIter->curr() * lhsIter->curr();
+        if (lhs->requiresGrad) {
+            lhs->initGrad();
+            IterPtr lhsGradIter = initIter(lhs->grad.get());
+            IterPtr rhsIter = initIter(rhs.get());
+
+            for (outGradIter->start(), lhsGradIter->start(), rhsIter->start();
+                 outGradIter->hasNext();
+                 outGradIter->next(), lhsGradIter->next(), rhsIter->next()) {
+                lhsGradIter->curr() += outGradIter->curr() * rhsIter->curr();
+            }
+        }
+
+        if (rhs->requiresGrad) {
+            rhs->initGrad();
+            IterPtr lhsIter = initIter(lhs.get());
+            IterPtr rhsGradIter = initIter(rhs->grad.get());
+
+            for (outGradIter->start(), lhsIter->start(), rhsGradIter->start();
+                 outGradIter->hasNext();
+                 outGradIter->next(), lhsIter->next(), rhsGradIter->next()) {
+                rhsGradIter->curr() += outGradIter->curr() * lhsIter->curr();
+            }
         }
     }
 
@@ -254,23 +286,34 @@ namespace Toygrad::Tensor {
 
     void DivOp::backward() {
         assert(Error::str_assert(tensor->grad != nullptr, Error::Message::backpropFromNull));
-        lhs->initGrad();
-        rhs->initGrad();
         IterPtr outGradIter = initIter(tensor->grad.get());
-        IterPtr lhsIter = initIter(lhs.get());
-        IterPtr lhsGradIter = initIter(lhs->grad.get());
         IterPtr rhsIter = initIter(rhs.get());
-        IterPtr rhsGradIter = initIter(rhs->grad.get());
 
         // z = x/y
         // dx += dz * (1/y)
         // dy += dz * (-x / y^2)
 
-        for (outGradIter->start(), lhsIter->start(), lhsGradIter->start(), rhsIter->start(), rhsGradIter->start();
-             outGradIter->hasNext();
-             outGradIter->next(), lhsIter->next(), lhsGradIter->next(), rhsIter->next(), rhsGradIter->next()) {
-            lhsGradIter->curr() += outGradIter->curr() / rhsIter->curr();
-            rhsGradIter->curr() += outGradIter->curr() * -lhsIter->curr() / (rhsIter->curr() * rhsIter->curr());
+        if (lhs->requiresGrad) {
+            lhs->initGrad();
+            IterPtr lhsGradIter = initIter(lhs->grad.get());
+
+            for (outGradIter->start(), lhsGradIter->start(), rhsIter->start();
+                 outGradIter->hasNext();
+                 outGradIter->next(), lhsGradIter->next(), rhsIter->next()) {
+                lhsGradIter->curr() += outGradIter->curr() / rhsIter->curr();
+            }
+        }
+
+        if (rhs->requiresGrad) {
+            rhs->initGrad();
+            IterPtr lhsIter = initIter(lhs.get());
+            IterPtr rhsGradIter = initIter(rhs->grad.get());
+
+            for (outGradIter->start(), lhsIter->start(), rhsIter->start(), rhsGradIter->start();
+                 outGradIter->hasNext();
+                 outGradIter->next(), lhsIter->next(), rhsIter->next(), rhsGradIter->next()) {
+                rhsGradIter->curr() += outGradIter->curr() * -lhsIter->curr() / (rhsIter->curr() * rhsIter->curr());
+            }
         }
     }
 
@@ -404,17 +447,17 @@ namespace Toygrad::Tensor {
     void ExpOp::backward() {
         assert(Error::str_assert(tensor->grad != nullptr, Error::Message::backpropFromNull));
         operand->initGrad();
+        IterPtr outIter = initIter(tensor);
         IterPtr outGradIter = initIter(tensor->grad.get());
-        IterPtr opIter = initIter(operand.get());
         IterPtr opGradIter = initIter(operand->grad.get());
 
         // z = e^x
-        // dx += dz * e^x
+        // dx += dz * z
 
-        for (outGradIter->start(), opIter->start(), opGradIter->start();
+        for (outIter->start(), outGradIter->start(), opGradIter->start();
              outGradIter->hasNext();
-             outGradIter->next(), opIter->next(), opGradIter->next()) {
-            opGradIter->curr() += outGradIter->curr() * exp(opIter->curr());
+             outIter->next(), outGradIter->next(), opGradIter->next()) {
+            opGradIter->curr() += outGradIter->curr() * outIter->curr();
         }
     }
 
@@ -432,16 +475,22 @@ namespace Toygrad::Tensor {
         assert(Error::str_assert(tensor->grad != nullptr, Error::Message::backpropFromNull));
         operand->initGrad();
         IterPtr outGradIter = initIter(tensor->grad.get());
-        IterPtr opIter = initIter(operand.get());
         IterPtr opGradIter = initIter(operand->grad.get());
 
+        if (c == 0) {
+            // z = 0 everywhere so no gradient flows
+            return;
+        }
+
+        IterPtr outIter = initIter(tensor);
+
         // z = c / x
-        // dx += dz * (-c / x^2)
+        // dx += dz * (-c / x^2) = dz * (-z^2 / c)
 
-        for (outGradIter->start(), opIter->start(), opGradIter->start();
+        for (outIter->start(), outGradIter->start(), opGradIter->start();
              outGradIter->hasNext();
-             outGradIter->next(), opIter->next(), opGradIter->next()) {
-            opGradIter->curr() += outGradIter->curr() * -c / (opIter->curr() * opIter->curr());
+             outIter->next(), outGradIter->next(), opGradIter->next()) {
+            opGradIter->curr() += outGradIter->curr() * -outIter->curr() * outIter->curr() / c;
         }
     }
 
@@ -511,17 +560,17 @@ namespace Toygrad::Tensor {
     void SqrtOp::backward() {
         assert(Error::str_assert(tensor->grad != nullptr, Error::Message::backpropFromNull));
         operand->initGrad();
+        IterPtr outIter = initIter(tensor);
         IterPtr outGradIter = initIter(tensor->grad.get());
-        IterPtr opIter = initIter(operand.get());
         IterPtr opGradIter = initIter(operand->grad.get());
 
         // z = sqrt(x)
-        // dx += dz * 1 / (2 * sqrt(x))
+        // dx += dz * 1 / (2 * z)
 
-        for (outGradIter->start(), opIter->start(), opGradIter->start();
+        for (outIter->start(), outGradIter->start(), opGradIter->start();
              outGradIter->hasNext();
-             outGradIter->next(), opIter->next(), opGradIter->next()) {
-            opGradIter->curr() += outGradIter->curr() / (2 * sqrt(opIter->curr()));
+             outIter->next(), outGradIter->next(), opGradIter->next()) {
+            opGradIter->curr() += outGradIter->curr() / (2 * outIter->curr());
         }
     }
 
@@ -538,82 +587,68 @@ namespace Toygrad::Tensor {
         operand->grad = tensor->grad;
     }
 
-    void EqOp::forward() {
-        tensor->initVec();
-        IterPtr outIter = initIter(tensor);
-        IterPtr lhsIter = initIter(lhs.get());
-        IterPtr rhsIter = initIter(rhs.get());
+    void ReshapeOp::forward() {
+        tensor->vec = operand->vec;
+    }
 
-        for (outIter->start(), lhsIter->start(), rhsIter->start();
-             outIter->hasNext();
-             outIter->next(), lhsIter->next(), rhsIter->next()) {
-            outIter->curr() = static_cast<real>(lhsIter->curr() == rhsIter->curr());
+    void ReshapeOp::backward() {
+        assert(Error::str_assert(tensor->grad != nullptr, Error::Message::backpropFromNull));
+        operand->initGrad();
+        IterPtr outGradIter = initIter(tensor->grad.get());
+        IterPtr opGradIter = initIter(operand->grad.get());
+
+        // Both tensors list the same elements in row-major order
+        for (outGradIter->start(), opGradIter->start();
+             outGradIter->hasNext();
+             outGradIter->next(), opGradIter->next()) {
+            opGradIter->curr() += outGradIter->curr();
         }
     }
 
-    void NeqOp::forward() {
-        tensor->initVec();
-        IterPtr outIter = initIter(tensor);
-        IterPtr lhsIter = initIter(lhs.get());
-        IterPtr rhsIter = initIter(rhs.get());
+    // Writes the result of comparing each pair of elements as a float, a byte or a bit depending on the output type
+    template<class Cmp>
+    static void compare(Tensor *tensor, Tensor *lhs, Tensor *rhs, Cmp cmp) {
+        IterPtr outIter = initIndexIter(tensor);
+        IterPtr lhsIter = initIter(lhs);
+        IterPtr rhsIter = initIter(rhs);
+        std::byte *out = tensor->getVec()->buff.get();
+        DType dtype = tensor->getDType();
 
         for (outIter->start(), lhsIter->start(), rhsIter->start();
              outIter->hasNext();
              outIter->next(), lhsIter->next(), rhsIter->next()) {
-            outIter->curr() = static_cast<real>(lhsIter->curr() != rhsIter->curr());
+            writeMask(out, dtype, outIter->index(), cmp(lhsIter->curr(), rhsIter->curr()));
         }
     }
 
-    void LessOp::forward() {
+    void EqOp::forward() {
         tensor->initVec();
-        IterPtr outIter = initIter(tensor);
-        IterPtr lhsIter = initIter(lhs.get());
-        IterPtr rhsIter = initIter(rhs.get());
+        compare(tensor, lhs.get(), rhs.get(), [](real x, real y) { return x == y; });
+    }
 
-        for (outIter->start(), lhsIter->start(), rhsIter->start();
-             outIter->hasNext();
-             outIter->next(), lhsIter->next(), rhsIter->next()) {
-            outIter->curr() = static_cast<real>(lhsIter->curr() < rhsIter->curr());
-        }
+    void NeqOp::forward() {
+        tensor->initVec();
+        compare(tensor, lhs.get(), rhs.get(), [](real x, real y) { return x != y; });
     }
 
-    void GreaterOp::forward() {
+    void LessOp::forward() {
         tensor->initVec();
-        IterPtr outIter = initIter(tensor);
-        IterPtr lhsIter = initIter(lhs.get());
-        IterPtr rhsIter = initIter(rhs.get());
+        compare(tensor, lhs.get(), rhs.get(), [](real x, real y) { return x < y; });
+    }
 
-        for (outIter->start(), lhsIter->start(), rhsIter->start();
-             outIter->hasNext();
-             outIter->next(), lhsIter->next(), rhsIter->next()) {
-            outIter->curr() = static_cast<real>(lhsIter->curr() > rhsIter->curr());
-        }
+    void GreaterOp::forward() {
+        tensor->initVec();
+        compare(tensor, lhs.get(), rhs.get(), [](real x, real y) { return x > y; });
     }
 
     void LeqOp::forward() {
         tensor->initVec();
-        IterPtr outIter = initIter(tensor);
-        IterPtr lhsIter = initIter(lhs.get());
-        IterPtr rhsIter = initIter(rhs.get());
-
-        for (outIter->start(), lhsIter->start(), rhsIter->start();
-             outIter->hasNext();
-             outIter->next(), lhsIter->next(), rhsIter->next()) {
-            outIter->curr() = static_cast<real>(lhsIter->curr() <= rhsIter->curr());
-        }
+        compare(tensor, lhs.get(), rhs.get(), [](real x, real y) { return x <= y; });
     }
 
     void GeqOp::forward() {
         tensor->initVec();
-        IterPtr outIter = initIter(tensor);
-        IterPtr lhsIter = initIter(lhs.get());
-        IterPtr rhsIter = initIter(rhs.get());
-
-        for (outIter->start(), lhsIter->start(), rhsIter->start();
-             outIter->hasNext();
-             outIter->next(), lhsIter->next(), rhsIter->next()) {
-            outIter->curr() = static_cast<real>(lhsIter->curr() >= rhsIter->curr());
-        }
+        compare(tensor, lhs.get(), rhs.get(), [](real x, real y) { return x >= y; });
     }
 
     void MaxOp::forward() {
@@ -781,20 +816,11 @@ namespace Toygrad::Tensor {
     void PermOp::backward() {
         assert(Error::str_assert(tensor->grad != nullptr, Error::Message::backpropFromNull));
         operand->initGrad();
-        Shape opShape = operand->grad->shape;
-        // Temporarily use the shape to that of the resulting tensor for easy mapping
-        operand->grad->shape = tensor->grad->shape;
-        IterPtr outGradIter = initIter(tensor->grad.get());
-        IterPtr opGradIter = initIter(operand->grad.get());
-
-        for (outGradIter->start(), opGradIter->start();
-             outGradIter->hasNext();
-             outGradIter->next(), opGradIter->next()) {
-            opGradIter->curr() = outGradIter->curr();
-        }
-
-        // Switch the shape back to the original
-        operand->grad->shape = opShape;
+        // Both gradients share the layout of the resulting tensor so the copy maps each element to the same position
+        const Shape &outShape = tensor->grad->shape;
+        stridedCopy(tensor->grad->vec->getData<real>() + outShape.offset, outShape.getStrides(),
+                    operand->grad->vec->getData<real>() + operand->grad->shape.offset, outShape.getStrides(),
+                    outShape.getView());
     }
 
     void ReluOp::forward() {
@@ -803,24 +829,24 @@ namespace Toygrad::Tensor {
         IterPtr opIter = initIter(operand.get());
 
         for (outIter->start(), opIter->start(); outIter->hasNext(); outIter->next(), opIter->next()) {
-            outIter->curr() = static_cast<real>(opIter->curr() > 0.f);
+            outIter->curr() = std::max(opIter->curr(), 0.f);
         }
     }
 
     void ReluOp::backward() {
         assert(Error::str_assert(tensor->grad != nullptr, Error::Message::backpropFromNull));
         operand->initGrad();
+        IterPtr outIter = initIter(tensor);
         IterPtr outGradIter = initIter(tensor->grad.get());
-        IterPtr opIter = initIter(operand.get());
         IterPtr opGradIter = initIter(operand->grad.get());
 
         // z = max(x, 0)
-        // dx += dz * 1 if x > 0 else 0
+        // dx += dz * 1 if z > 0 else 0
 
-        for (outGradIter->start(), opIter->start(), opGradIter->start();
+        for (outIter->start(), outGradIter->start(), opGradIter->start();
              outGradIter->hasNext();
-             outGradIter->next(), opIter->next(), opGradIter->next()) {
-            opGradIter->curr() += outGradIter->curr() * static_cast<real>(opIter->curr() > 0.f);
+             outIter->next(), outGradIter->next(), opGradIter->next()) {
+            opGradIter->curr() += outGradIter->curr() * static_cast<real>(outIter->curr() > 0.f);
         }
     }
 
@@ -837,23 +863,33 @@ namespace Toygrad::Tensor {
     void SigmoidOp::backward() {
         assert(Error::str_assert(tensor->grad != nullptr, Error::Message::backpropFromNull));
         operand->initGrad();
+        IterPtr outIter = initIter(tensor);
         IterPtr outGradIter = initIter(tensor->grad.get());
-        IterPtr opIter = initIter(operand.get());
         IterPtr opGradIter = initIter(operand->grad.get());
 
         // z = 1 / (1 + exp(-x))
         // dx += dz * z * (1 - z)
 
-        for (outGradIter->start(), opIter->start(), opGradIter->start();
+        for (outIter->start(), outGradIter->start(), opGradIter->start();
              outGradIter->hasNext();
-             outGradIter->next(), opIter->next(), opGradIter->next()) {
-            real sigmoid = 1 / (1 + exp(-opIter->curr()));
-            opGradIter->curr() += outGradIter->curr() * sigmoid * (1 - sigmoid);
+             outIter->next(), outGradIter->next(), opGradIter->next()) {
+            opGradIter->curr() += outGradIter->curr() * outIter->curr() * (1 - outIter->curr());
         }
     }
 
     void CopyOp::forward() {
         tensor->initVec();
+        const Shape &opShape = operand->shape;
+
+        if (tensor->shape.getView() == opShape.getView() || tensor->isContiguous()) {
+            // A contiguous reshaped copy is written in the order of the operand's elements
+            Dims outStrides = tensor->shape.getView() == opShape.getView() ? tensor->shape.getStrides()
+                                                                         : Shape(opShape.getView()).getStrides();
+            stridedCast(*operand->vec, opShape.offset, opShape.getStrides(), *tensor->vec, tensor->shape.offset,
+                        outStrides, opShape.getView());
+            return;
+        }
+
         IterPtr outIter = initIter(tensor);
         IterPtr opIter = initIter(operand.get());
 
@@ -862,52 +898,621 @@ namespace Toygrad::Tensor {
         }
     }
 
-    void MatmulOp::forward() {
+    void CatOp::forward() {
+        tensor->initVec();
+
+        for (size_t i = 0; i < operands.size(); i++) {
+            const Shape &opShape = operands[i]->shape;
+            Shape slice = getSlice(tensor->shape, i);
+
+            // Operands computed in place already hold their values in the output
+            if (operands[i]->vec == tensor->vec && opShape.offset == slice.offset) {
+                continue;
+            }
+
+            stridedCast(*operands[i]->vec, opShape.offset, opShape.getStrides(), *tensor->vec, slice.offset,
+                        slice.getStrides(), slice.getView());
+        }
+    }
+
+    void CatOp::backward() {
+        assert(Error::str_assert(tensor->grad != nullptr, Error::Message::backpropFromNull));
+
+        for (size_t i = 0; i < operands.size(); i++) {
+            auto &operand = operands[i];
+
+            if (!operand->requiresGrad) {
+                continue;
+            }
+
+            // Every operand accumulates into its own gradient, a view of the output's gradient would also receive
+            // whatever is accumulated into the operand's gradient later
+            auto gradSlice = std::make_shared<Tensor>(getSlice(tensor->grad->shape, i), false);
+            gradSlice->vec = tensor->grad->vec;
+            operand->initGrad();
+
+            IterPtr sliceIter = initIter(gradSlice.get());
+            IterPtr opGradIter = initIter(operand->grad.get());
+
+            for (sliceIter->start(), opGradIter->start(); sliceIter->hasNext(); sliceIter->next(), opGradIter->next()) {
+                opGradIter->curr() += sliceIter->curr();
+            }
+        }
+    }
+
+    void CastOp::forward() {
+        tensor->initVec();
+        stridedCast(*operand->vec, operand->shape.offset, operand->shape.getStrides(), *tensor->vec,
+                    tensor->shape.offset, tensor->shape.getStrides(), tensor->shape.getView());
+    }
+
+    void CastOp::backward() {
+        assert(Error::str_assert(tensor->grad != nullptr, Error::Message::backpropFromNull));
+        operand->initGrad();
+        IterPtr outGradIter = initIter(tensor->grad.get());
+        IterPtr opGradIter = initIter(operand->grad.get());
+
+        // Gradients are float32 whatever the data type of the values
+        for (outGradIter->start(), opGradIter->start();
+             outGradIter->hasNext();
+             outGradIter->next(), opGradIter->next()) {
+            opGradIter->curr() += outGradIter->curr();
+        }
+    }
+
+    void WhereOp::forward() {
         tensor->initVec();
+        const Tensor *mask = operands[0].get();
+        const std::byte *maskData = mask->getVec()->buff.get();
+        IterPtr maskIter = initIndexIter(mask);
+        IterPtr xIter = initIter(operands[1].get());
+        IterPtr yIter = initIter(operands[2].get());
         IterPtr outIter = initIter(tensor);
-        IterPtr lhsIter = initIter(lhs.get());
-        IterPtr rhsIter = initIter(rhs.get());
-        size_t numDims = tensor->shape.getNumDims();
-        real sum;
-        outIter->start();
-        lhsIter->start();
-        rhsIter->start();
-        lhsIter->save();
-        rhsIter->save();
-
-        while (outIter->hasNext()) {
-            for (size_t i = 0; i < lhs->shape[numDims - 2]; i++) {
-                for (size_t j = 0; j < rhs->shape[numDims - 2]; j++) {
-                    sum = 0;
-
-                    for (size_t k = 0; k < rhs->shape[numDims - 1]; k++, lhsIter->next(), rhsIter->next()) {
-                        sum += lhsIter->curr() * rhsIter->curr();
-                    }
-
-                    outIter->curr() = sum;
-                    outIter->next();
 
-                    if (j < rhs->shape[numDims - 2] - 1) {
-                        lhsIter->restore();
-                    }
+        for (maskIter->start(), xIter->start(), yIter->start(), outIter->start();
+             outIter->hasNext();
+             maskIter->next(), xIter->next(), yIter->next(), outIter->next()) {
+            outIter->curr() = readMask(maskData, mask->dtype, maskIter->index()) ? xIter->curr() : yIter->curr();
+        }
+    }
+
+    void WhereOp::backward() {
+        assert(Error::str_assert(tensor->grad != nullptr, Error::Message::backpropFromNull));
+        const Tensor *mask = operands[0].get();
+        const std::byte *maskData = mask->getVec()->buff.get();
 
-                    lhsIter->save();
-                }
+        // dx += dz where the mask is set, dy += dz elsewhere
+        for (size_t i = 1; i < operands.size(); i++) {
+            auto &operand = operands[i];
+
+            if (!operand->requiresGrad) {
+                continue;
+            }
+
+            operand->initGrad();
+            IterPtr maskIter = initIndexIter(mask);
+            IterPtr outGradIter = initIter(tensor->grad.get());
+            IterPtr opGradIter = initIter(operand->grad.get());
 
-                if (i < lhs->shape[numDims - 2] - 1) {
-                    rhsIter->restore();
+            for (maskIter->start(), outGradIter->start(), opGradIter->start();
+                 outGradIter->hasNext();
+                 maskIter->next(), outGradIter->next(), opGradIter->next()) {
+                if (readMask(maskData, mask->dtype, maskIter->index()) == (i == 1)) {
+                    opGradIter->curr() += outGradIter->curr();
                 }
+            }
+        }
+    }
+
+    template<class F>
+    const Vec *Op::getCached(const TensorPtr &operand, std::shared_ptr<CachedValues> Tensor::*slot, size_t key,
+                             size_t size, const F &compute) {
+        Tensor *leaf = operand.get();
+
+        while (leaf->ops.size() == 1 && leaf->ops[0]->isView()) {
+            leaf = dynamic_cast<UnOp *>(leaf->ops[0])->operand.get();
+        }
+
+        if (!leaf->ops.empty() && leaf->ops[0]->opType != OpType::LEAF) {
+            return nullptr;
+        }
+
+        // Every write to the leaf's memory bumps the memory's version, including writes through a view of the leaf
+        const Shape &shape = operand->shape;
+        const Vec *source = operand->vec.get();
+        CachedValues *cached = (leaf->*slot).get();
+
+        if (cached != nullptr && cached->source == source && cached->version == source->version &&
+            cached->key == key && cached->shape.offset == shape.offset && cached->shape.getView() == shape.getView() &&
+            cached->shape.getStrides() == shape.getStrides()) {
+            return cached->data.get();
+        }
+
+        // The memory of stale values of the same size is reused, e.g. after every optimizer step
+        if (cached != nullptr && cached->data->size == size) {
+            cached->source = source;
+            cached->version = source->version;
+            cached->shape = shape;
+            cached->key = key;
+        } else {
+            leaf->*slot = std::make_shared<CachedValues>(source, source->version, shape, key, size);
+            cached = (leaf->*slot).get();
+        }
+
+        compute(*cached->data);
+        return cached->data.get();
+    }
+
+    const Vec *MatmulOp::getRhsVec(const TensorPtr &rhs, size_t m, Shape &rhsShape) {
+        size_t numDims = rhs->shape.getNumDims();
+        const Dims &strides = rhs->shape.getStrides();
+        bool transposed = strides[numDims - 1] != 1 && rhs->shape[numDims - 1] > 1;
+        bool skinny = m <= gemvMaxRows && strides[numDims - 2] == 1;
+        rhsShape = rhs->shape;
+
+        if (rhs->dtype != DType::FLOAT32 || !transposed || skinny) {
+            return rhs->vec.get();
+        }
+
+        Shape dense(rhs->shape.getView());
+        const Vec *packed = getCached(rhs, &Tensor::packed, 0, dense.getSize(), [&](Vec &data) {
+            stridedCast(*rhs->vec, rhs->shape.offset, strides, data, 0, dense.getStrides(), dense.getView());
+        });
+
+        if (packed == nullptr) {
+            return rhs->vec.get();
+        }
 
-                rhsIter->save();
+        rhsShape = dense;
+        return packed;
+    }
+
+    // Index of the first element of the matrix an operand contributes to a batch of the output. The batch dimensions
+    // are broadcast like numpy's, those the operand lacks or has of size 1 do not move the index so a shared matrix is
+    // read in place by every batch.
+    static size_t getBatchOffset(const Shape &shape, const Shape &outShape, size_t batch) {
+        size_t numDims = shape.getNumDims();
+        size_t outDims = outShape.getNumDims();
+        const Dims &strides = shape.getStrides();
+        size_t offset = shape.offset;
+
+        for (size_t d = outDims - 2; d > 0; d--) {
+            size_t i = batch % outShape[d - 1];
+            batch /= outShape[d - 1];
+
+            if (d - 1 + numDims >= outDims && shape[d - 1 + numDims - outDims] != 1) {
+                offset += i * strides[d - 1 + numDims - outDims];
             }
         }
+
+        return offset;
+    }
+
+    static size_t getNumBatches(const Shape &shape) {
+        size_t numBatches = 1;
+
+        for (size_t i = 0; i < shape.getNumDims() - 2; i++) {
+            numBatches *= shape[i];
+        }
+
+        return numBatches;
+    }
+
+    // Number of rows of a tensor whose leading dimensions are folded together
+    static size_t getNumRows(const Shape &shape) {
+        size_t numRows = 1;
+
+        for (size_t i = 0; i < shape.getNumDims() - 1; i++) {
+            numRows *= shape[i];
+        }
+
+        return numRows;
+    }
+
+    // Row and column strides of the last two dimensions
+    static Dims getMatrixStrides(const Shape &shape) {
+        const Dims &strides = shape.getStrides();
+        size_t numDims = shape.getNumDims();
+        return {strides[numDims - 2], strides[numDims - 1]};
+    }
+
+    void MatmulOp::forward() {
+        tensor->initVec();
+        const Shape &outShape = tensor->shape;
+        size_t numDims = outShape.getNumDims();
+        size_t m = outShape[numDims - 2];
+        size_t n = outShape[numDims - 1];
+        size_t k = lhs->shape[lhs->shape.getNumDims() - 1];
+        Shape rhsShape = rhs->shape;
+        const Vec *rhsVec = getRhsVec(rhs, m, rhsShape);
+        size_t numBatches = getNumBatches(outShape);
+
+        // Each matrix of the batch is multiplied on its own, rhs already switches the last two dimensions
+        for (size_t batch = 0; batch < numBatches; batch++) {
+            gemm(*lhs->vec, getBatchOffset(lhs->shape, outShape, batch), getMatrixStrides(lhs->shape), *rhsVec,
+                 getBatchOffset(rhsShape, outShape, batch), getMatrixStrides(rhsShape),
+                 tensor->vec->getData<real>() + getBatchOffset(outShape, outShape, batch), getMatrixStrides(outShape),
+                 m, n, k);
+        }
     }
 
     void MatmulOp::backward() {
         assert(Error::str_assert(tensor->grad != nullptr, Error::Message::backpropFromNull));
-        lhsTranspose = lhs->T(lhs->shape.getNumDims() - 2, false, lhsTranspose);
-        // rhs already switches the last two dimensions so no need to do transpose here
-        lhs->grad = tensor->grad->matmul(rhs, false, lhs->grad);
-        rhs->grad = lhsTranspose->matmul(tensor->grad, false, rhs->grad);
+        const Shape &outShape = tensor->shape;
+        const Shape &gradShape = tensor->grad->shape;
+        size_t numDims = outShape.getNumDims();
+        size_t m = outShape[numDims - 2];
+        size_t n = outShape[numDims - 1];
+        size_t k = lhs->shape[lhs->shape.getNumDims() - 1];
+        size_t numBatches = getNumBatches(outShape);
+        Dims gradStrides = getMatrixStrides(gradShape);
+        Dims lhsStrides = getMatrixStrides(lhs->shape);
+        Dims rhsStrides = getMatrixStrides(rhs->shape);
+
+        // Only the gradients leading to tensors that require them are computed, e.g. no dX for an input batch
+        if (lhs->requiresGrad) {
+            lhs->initGrad();
+        }
+
+        if (rhs->requiresGrad) {
+            rhs->initGrad();
+        }
+
+        // Batches that share a broadcast operand accumulate into the same matrix of its gradient
+        for (size_t batch = 0; batch < numBatches; batch++) {
+            size_t gradOffset = getBatchOffset(gradShape, gradShape, batch);
+
+            // dlhs += dz @ rhs, rhs already switches the last two dimensions so its columns are the rows gemm reads
+            if (lhs->requiresGrad) {
+                const Shape &lhsGradShape = lhs->grad->shape;
+                gemm(*tensor->grad->vec, gradOffset, gradStrides, *rhs->vec,
+                     getBatchOffset(rhs->shape, outShape, batch), {rhsStrides[1], rhsStrides[0]},
+                     lhs->grad->vec->getData<real>() + getBatchOffset(lhsGradShape, outShape, batch),
+                     getMatrixStrides(lhsGradShape), m, k, n, {.accumulate = true});
+            }
+
+            // drhs += dz^T @ lhs
+            if (rhs->requiresGrad) {
+                const Shape &rhsGradShape = rhs->grad->shape;
+                gemm(*tensor->grad->vec, gradOffset, {gradStrides[1], gradStrides[0]}, *lhs->vec,
+                     getBatchOffset(lhs->shape, outShape, batch), {lhsStrides[1], lhsStrides[0]},
+                     rhs->grad->vec->getData<real>() + getBatchOffset(rhsGradShape, outShape, batch),
+                     getMatrixStrides(rhsGradShape), n, k, m, {.accumulate = true});
+            }
+        }
+    }
+
+    // Strides of a layout viewed as a matrix whose rows fold its leading dimensions, returns false when the layout
+    // cannot be viewed this way
+    static bool getFoldedStrides(const Shape &shape, Dims &strides) {
+        return shape.getViewStrides({getNumRows(shape), shape[shape.getNumDims() - 1]}, strides);
+    }
+
+    // Runs a kernel that writes contiguous float32 outputs on the memory of a tensor, or on a buffer of the workspace
+    // that is then copied into a tensor of another layout
+    template<class F>
+    static void writeDense(const Shape &shape, const Vec &vec, Workspace &workspace, const F &f) {
+        real *out = vec.getData<real>() + shape.offset;
+
+        if (shape.isContiguous()) {
+            f(out);
+            return;
+        }
+
+        Vec &buffer = workspace.get(shape.getSize());
+        f(buffer.getData<real>());
+        stridedCopy(buffer.getData<real>(), Shape(shape.getView()).getStrides(), out, shape.getStrides(),
+                    shape.getView());
+    }
+
+    const Vec &FusedLinearOp::getMatrixVec(const Tensor *operand, Workspace &workspace, size_t &offset, Dims &strides) {
+        const Shape &shape = operand->shape;
+
+        if (getFoldedStrides(shape, strides)) {
+            offset = shape.offset;
+            return *operand->vec;
+        }
+
+        strides = {shape[shape.getNumDims() - 1], 1};
+        return getDenseVec(operand, workspace, offset);
+    }
+
+    void FusedLinearOp::forward() {
+        tensor->initVec();
+        const Shape &outShape = tensor->shape;
+        size_t m = getNumRows(outShape);
+        Shape weightShape = operands[1]->shape;
+        const Vec *weightVec = MatmulOp::getRhsVec(operands[1], m, weightShape);
+        Workspace local;
+        Workspace &scratch = getWorkspace(local);
+        size_t biasOffset, xOffset;
+        const real *bias = getDenseVec(operands[2].get(), scratch, biasOffset).getData<real>() + biasOffset;
+        Dims xStrides, outStrides;
+        const Vec &x = getMatrixVec(operands[0].get(), scratch, xOffset, xStrides);
+        auto multiply = [&](real *out, const Dims &strides) {
+            gemm(x, xOffset, xStrides, *weightVec, weightShape.offset, weightShape.getStrides(), out, strides, m,
+                 weightShape[0], weightShape[1], {.bias = bias, .activation = activation});
+        };
+
+        // An output whose rows cannot be folded, e.g. a slice of a concatenation, is computed into a buffer first
+        if (getFoldedStrides(outShape, outStrides)) {
+            multiply(tensor->vec->getData<real>() + outShape.offset, outStrides);
+        } else {
+            writeDense(outShape, *tensor->vec, scratch, [&](real *out) { multiply(out, {weightShape[0], 1}); });
+        }
+    }
+
+    void FusedLinearOp::backward() {
+        assert(Error::str_assert(tensor->grad != nullptr, Error::Message::backpropFromNull));
+        const TensorPtr &x = operands[0];
+        const TensorPtr &weight = operands[1];
+        const TensorPtr &bias = operands[2];
+        Workspace scratch;
+        size_t gradOffset, outOffset;
+        Dims gradStrides, outStrides;
+        const real *outGrad = getMatrixVec(tensor->grad.get(), scratch, gradOffset, gradStrides).getData<real>() +
+                              gradOffset;
+        const real *out = tensor->vec == nullptr
+                              ? nullptr
+                              : getMatrixVec(tensor, scratch, outOffset, outStrides).getData<real>() + outOffset;
+        size_t m = getNumRows(tensor->grad->shape);
+        size_t n = weight->shape[0];
+        size_t k = weight->shape[1];
+
+        // Gradient of the sum before the activation, stored as a contiguous M x N matrix
+        // z = f(y)
+        // dy = dz * 1 if z > 0 else 0 for relu, dz * z * (1 - z) for sigmoid
+        Vec &sumGrad = scratch.get(m * n);
+        real *dy = sumGrad.getData<real>();
+
+        for (size_t i = 0; i < m; i++) {
+            for (size_t j = 0; j < n; j++) {
+                real g = outGrad[i * gradStrides[0] + j * gradStrides[1]];
+
+                if (activation == Activation::RELU) {
+                    g *= static_cast<real>(out[i * outStrides[0] + j * outStrides[1]] > 0.f);
+                } else if (activation == Activation::SIGMOID) {
+                    real z = out[i * outStrides[0] + j * outStrides[1]];
+                    g *= z * (1 - z);
+                }
+
+                dy[i * n + j] = g;
+            }
+        }
+
+        // db += sum of the rows of dy
+        if (bias->requiresGrad) {
+            bias->initGrad();
+            real *biasGrad = bias->grad->vec->getData<real>() + bias->grad->shape.offset;
+            size_t biasStride = bias->grad->shape.getStrides()[0];
+
+            for (size_t i = 0; i < m; i++) {
+                for (size_t j = 0; j < n; j++) {
+                    biasGrad[j * biasStride] += dy[i * n + j];
+                }
+            }
+        }
+
+        // dx += dy @ w, the weight view is N x K so its columns are the rows gemm multiplies by
+        if (x->requiresGrad) {
+            x->initGrad();
+            const Shape &xGradShape = x->grad->shape;
+            const Dims &weightStrides = weight->shape.getStrides();
+            Dims xGradStrides;
+            auto multiply = [&](real *xGrad, const Dims &strides, bool accumulate) {
+                gemm(sumGrad, 0, {n, 1}, *weight->vec, weight->shape.offset, {weightStrides[1], weightStrides[0]},
+                     xGrad, strides, m, k, n, {.accumulate = accumulate});
+            };
+
+            if (getFoldedStrides(xGradShape, xGradStrides)) {
+                multiply(x->grad->vec->getData<real>() + xGradShape.offset, xGradStrides, true);
+            } else {
+                Vec xGrad(m * k);
+                multiply(xGrad.getData<real>(), {k, 1}, false);
+                addToGrad(x, xGrad);
+            }
+        }
+
+        // dw += dy^T @ x
+        if (weight->requiresGrad) {
+            weight->initGrad();
+            const Shape &weightGradShape = weight->grad->shape;
+            size_t xOffset;
+            Dims xStrides;
+            const Vec &xVec = getMatrixVec(x.get(), scratch, xOffset, xStrides);
+            gemm(sumGrad, 0, {1, n}, xVec, xOffset, {xStrides[1], xStrides[0]},
+                 weight->grad->vec->getData<real>() + weightGradShape.offset, weightGradShape.getStrides(), n, k, m,
+                 {.accumulate = true});
+        }
+    }
+
+    void Int8MatmulOp::forward() {
+        tensor->initVec();
+        const Shape &outShape = tensor->shape;
+        size_t m = getNumRows(outShape);
+        Workspace local;
+        Workspace &scratch = getWorkspace(local);
+        size_t xOffset, biasOffset;
+        Dims xStrides, outStrides;
+        const Vec &x = FusedLinearOp::getMatrixVec(lhs.get(), scratch, xOffset, xStrides);
+        quantizeRows(x, xOffset, xStrides, m, weights->cols, quantized, scratch);
+        const real *bias = getDenseVec(rhs.get(), scratch, biasOffset).getData<real>() + biasOffset;
+
+        if (getFoldedStrides(outShape, outStrides)) {
+            gemmInt8(quantized, *weights, bias, tensor->vec->getData<real>() + outShape.offset, outStrides);
+        } else {
+            writeDense(outShape, *tensor->vec, scratch, [&](real *out) {
+                gemmInt8(quantized, *weights, bias, out, {weights->rows, 1});
+            });
+        }
+    }
+
+    void Int4MatmulOp::forward() {
+        tensor->initVec();
+        const Shape &outShape = tensor->shape;
+        size_t m = getNumRows(outShape);
+        Workspace local;
+        Workspace &scratch = getWorkspace(local);
+        size_t xOffset, biasOffset;
+        Dims xStrides, outStrides;
+        const Vec &x = FusedLinearOp::getMatrixVec(lhs.get(), scratch, xOffset, xStrides);
+        const real *bias = getDenseVec(rhs.get(), scratch, biasOffset).getData<real>() + biasOffset;
+
+        if (getFoldedStrides(outShape, outStrides)) {
+            gemmInt4(x, xOffset, xStrides, m, *weights, bias, tensor->vec->getData<real>() + outShape.offset,
+                     outStrides, scratch);
+        } else {
+            writeDense(outShape, *tensor->vec, scratch, [&](real *out) {
+                gemmInt4(x, xOffset, xStrides, m, *weights, bias, out, {weights->rows, 1}, scratch);
+            });
+        }
+    }
+
+    Workspace &Op::getWorkspace(Workspace &local) const {
+        if (workspace == nullptr) {
+            return local;
+        }
+
+        workspace->reset();
+        return *workspace;
+    }
+
+    const Vec &Op::getDenseVec(const Tensor *operand, Workspace &workspace, size_t &offset) {
+        const Shape &shape = operand->shape;
+
+        if (operand->vec->dtype == DType::FLOAT32 && shape.isContiguous()) {
+            offset = shape.offset;
+            return *operand->vec;
+        }
+
+        Vec &buffer = workspace.get(shape.getSize());
+        stridedCast(*operand->vec, shape.offset, shape.getStrides(), buffer, 0, Shape(shape.getView()).getStrides(),
+                    shape.getView());
+        offset = 0;
+        return buffer;
+    }
+
+    void Op::addToGrad(const TensorPtr &operand, const Vec &grad) {
+        operand->initGrad();
+        IterPtr iter = initIter(operand->grad.get());
+        const real *values = grad.getData<real>();
+
+        for (iter->start(); iter->hasNext(); iter->next()) {
+            iter->curr() += *values++;
+        }
+    }
+
+    const Vec &ConvOp::getWinogradFilter(const TensorPtr &weight, const ConvShape &conv, size_t tileSize,
+                                         Workspace &workspace) {
+        size_t alpha = tileSize + 2;
+        auto transform = [&](Vec &data) {
+            size_t weightOffset;
+            const Vec &weightVec = getDenseVec(weight.get(), workspace, weightOffset);
+            winogradFilter(conv, tileSize, weightVec.getData<real>() + weightOffset, data.getData<real>());
+        };
+        size_t size = alpha * alpha * conv.outChannels * conv.inChannels;
+
+        if (const Vec *cached = getCached(weight, &Tensor::winograd, tileSize, size, transform); cached != nullptr) {
+            return *cached;
+        }
+
+        Vec &buffer = workspace.get(size);
+        transform(buffer);
+        return buffer;
+    }
+
+    void ConvOp::forward() {
+        tensor->initVec();
+        Workspace local;
+        Workspace &scratch = getWorkspace(local);
+        size_t xOffset, weightOffset, biasOffset;
+        const Vec &x = getDenseVec(operands[0].get(), scratch, xOffset);
+        const real *bias = operands.size() > 2
+                               ? getDenseVec(operands[2].get(), scratch, biasOffset).getData<real>() + biasOffset
+                               : nullptr;
+
+        // 3x3 kernels without stride multiply transformed tiles by weights transformed once per change
+        if (size_t tileSize = getWinogradTileSize(conv); tileSize != 0) {
+            const Vec &filter = getWinogradFilter(operands[1], conv, tileSize, scratch);
+            writeDense(tensor->shape, *tensor->vec, scratch, [&](real *out) {
+                conv2dWinograd(conv, tileSize, x, xOffset, filter, bias, out, scratch);
+            });
+            return;
+        }
+
+        const Vec &weight = getDenseVec(operands[1].get(), scratch, weightOffset);
+        writeDense(tensor->shape, *tensor->vec, scratch, [&](real *out) {
+            conv2d(conv, x, xOffset, weight, weightOffset, bias, out, scratch);
+        });
+    }
+
+    void ConvOp::backward() {
+        assert(Error::str_assert(tensor->grad != nullptr, Error::Message::backpropFromNull));
+        const TensorPtr &x = operands[0];
+        const TensorPtr &weight = operands[1];
+        bool biasRequiresGrad = operands.size() > 2 && operands[2]->requiresGrad;
+        Workspace scratch;
+        size_t xOffset = 0, weightOffset = 0, gradOffset;
+        // Each of the images and the weights is only read for the gradient of the other one
+        Vec unused(0);
+        const Vec &xVec = weight->requiresGrad ? getDenseVec(x.get(), scratch, xOffset) : unused;
+        const Vec &weightVec = x->requiresGrad ? getDenseVec(weight.get(), scratch, weightOffset) : unused;
+        const Vec &outGrad = getDenseVec(tensor->grad.get(), scratch, gradOffset);
+        std::unique_ptr<Vec> xGrad, weightGrad, biasGrad;
+
+        if (x->requiresGrad) {
+            xGrad = std::make_unique<Vec>(x->shape.getSize(), 0.f);
+        }
+
+        if (weight->requiresGrad) {
+            weightGrad = std::make_unique<Vec>(weight->shape.getSize(), 0.f);
+        }
+
+        if (biasRequiresGrad) {
+            biasGrad = std::make_unique<Vec>(conv.outChannels, 0.f);
+        }
+
+        conv2dBackward(conv, xVec, xOffset, weightVec, weightOffset, outGrad, gradOffset,
+                       xGrad == nullptr ? nullptr : xGrad->getData<real>(),
+                       weightGrad == nullptr ? nullptr : weightGrad->getData<real>(),
+                       biasGrad == nullptr ? nullptr : biasGrad->getData<real>(), scratch);
+
+        if (xGrad != nullptr) {
+            addToGrad(x, *xGrad);
+        }
+
+        if (weightGrad != nullptr) {
+            addToGrad(weight, *weightGrad);
+        }
+
+        if (biasGrad != nullptr) {
+            addToGrad(operands[2], *biasGrad);
+        }
+    }
+
+    void PoolOp::forward() {
+        tensor->initVec();
+        Workspace local;
+        Workspace &scratch = getWorkspace(local);
+        size_t offset;
+        const Vec &x = getDenseVec(operand.get(), scratch, offset);
+
+        writeDense(tensor->shape, *tensor->vec, scratch, [&](real *out) {
+            pool2d(pool, pooling, x.getData<real>() + offset, out);
+        });
+    }
+
+    void PoolOp::backward() {
+        assert(Error::str_assert(tensor->grad != nullptr, Error::Message::backpropFromNull));
+        Workspace scratch;
+        size_t xOffset, gradOffset;
+        // Only the maximum reads the images to find the element each window took
+        const real *x = pooling == Pooling::MAX
+                            ? getDenseVec(operand.get(), scratch, xOffset).getData<real>() + xOffset
+                            : nullptr;
+        const Vec &outGrad = getDenseVec(tensor->grad.get(), scratch, gradOffset);
+        Vec xGrad(operand->shape.getSize(), 0.f);
+        pool2dBackward(pool, pooling, x, outGrad.getData<real>() + gradOffset, xGrad.getData<real>());
+        addToGrad(operand, xGrad);
     }
 }
@@ -4,21 +4,23 @@
 
 #pragma once
 
+#include "kernels.h"
+#include "quant.h"
 #include "rand_gen.h"
 #include "tensor.h"
 
 namespace Toygrad::Tensor {
     enum class OpType {
-        LEAF, UN_OP, BIN_OP
+        LEAF, UN_OP, BIN_OP, MULTI_OP
     };
 
     enum class OpName {
         INDEX, CONST, ARANGE, FROM_ARR, RANDINT, RANDN,
         ADD, SUB, MUL, DIV, POW, LOG, SIN, COS, EXP, RECIP, NEG, SQ, SQRT, MATMUL,
-        ADD_ASSIGN, SUB_ASSIGN, MUL_ASSIGN, DIV_ASSIGN, ALIAS, DIFF_ALIAS, PERM,
+        ADD_ASSIGN, SUB_ASSIGN, MUL_ASSIGN, DIV_ASSIGN, ALIAS, DIFF_ALIAS, RESHAPE, PERM,
         EQ, NEQ, LESS, GREATER, LEQ, GEQ, MAX, MIN,
         RELU, SUM, SIGMOID, SOFTMAX,
-        COPY
+        COPY, CAT, STACK, CAST, WHERE, INT8_MATMUL, INT4_MATMUL, FUSED_LINEAR, CONV, POOL
     };
 
     inline std::unordered_map<OpName, std::string> op2Str = {
@@ -29,17 +31,37 @@ namespace Toygrad::Tensor {
         {OpName::EXP, "EXP"}, {OpName::RECIP, "RECIP"}, {OpName::NEG, "NEG"}, {OpName::SQ, "SQ"},
         {OpName::SQRT, "SQRT"}, {OpName::MATMUL, "MATMUL"}, {OpName::ADD_ASSIGN, "ADD_ASSIGN"},
         {OpName::SUB_ASSIGN, "SUB_ASSIGN"}, {OpName::MUL_ASSIGN, "MUL_ASSIGN"}, {OpName::DIV_ASSIGN, "DIV_ASSIGN"},
-        {OpName::ALIAS, "ALIAS"}, {OpName::DIFF_ALIAS, "DIFF_ALIAS"}, {OpName::PERM, "PERM"},
+        {OpName::ALIAS, "ALIAS"}, {OpName::DIFF_ALIAS, "DIFF_ALIAS"},
+        {OpName::RESHAPE, "RESHAPE"}, {OpName::PERM, "PERM"},
         {OpName::EQ, "EQ"}, {OpName::NEQ, "NEQ"}, {OpName::LESS, "LESS"}, {OpName::GREATER, "GREATER"},
         {OpName::LEQ, "LEQ"}, {OpName::GEQ, "GEQ"}, {OpName::MAX, "MAX"}, {OpName::MIN, "MIN"},
         {OpName::RELU, "RELU"}, {OpName::SUM, "SUM"}, {OpName::SIGMOID, "SIGMOID"}, {OpName::SOFTMAX, "SOFTMAX"},
-        {OpName::COPY, "COPY"}
+        {OpName::COPY, "COPY"}, {OpName::CAT, "CAT"}, {OpName::STACK, "STACK"},
+        {OpName::CAST, "CAST"}, {OpName::WHERE, "WHERE"}, {OpName::INT8_MATMUL, "INT8_MATMUL"},
+        {OpName::INT4_MATMUL, "INT4_MATMUL"}, {OpName::FUSED_LINEAR, "FUSED_LINEAR"},
+        {OpName::CONV, "CONV"}, {OpName::POOL, "POOL"}
+    };
+
+    // Values derived from the memory of a leaf tensor read through a view, e.g. a packed copy of a transposed weight,
+    // tagged with the memory, version and layout they were derived from and with a key that tells their variants apart
+    struct CachedValues {
+        const Vec *source;
+        size_t version;
+        Shape shape;
+        size_t key;
+        std::unique_ptr<Vec> data;
+
+        CachedValues(const Vec *source, size_t version, const Shape &shape, size_t key, size_t size): source(source),
+            version(version), shape(shape), key(key), data(std::make_unique<Vec>(size)) {
+        }
     };
 
     struct Op {
         OpType opType;
         OpName opName;
         Tensor *tensor;
+        // Scratch memory kept across forward passes by the plan that captured the op, nullptr outside of a plan
+        Workspace *workspace = nullptr;
 
         Op(OpType opType, OpName opName, Tensor *tensor) : opType(opType), opName(opName), tensor(tensor) {
         }
@@ -51,12 +73,56 @@ namespace Toygrad::Tensor {
 
         virtual void backward() {
         }
+
+        // Relative cost of recomputing the op, used to pick the tensors to checkpoint
+        virtual size_t cost() const {
+            return tensor->shape.getSize();
+        }
+
+        // Whether the op shares its operand's memory instead of allocating its own
+        virtual bool isView() const {
+            return false;
+        }
+
+        // Whether the op's values are fixed by its own parameters, e.g. arange, so rerunning it reproduces them
+        virtual bool isConstant() const {
+            return false;
+        }
+
+        // Whether backward reads the values of the operand at the given index
+        virtual bool savesInput(size_t) const {
+            return true;
+        }
+
+        // Whether backward reads the values of the op's output
+        virtual bool savesOutput() const {
+            return false;
+        }
+
+        // Returns the scratch memory of a forward pass, that of the plan when the op was captured by one and local
+        // otherwise
+        Workspace &getWorkspace(Workspace &local) const;
+
+        // Returns the buffer of the values of a tensor as contiguous float32 elements and sets the index of the first
+        // one, the values are converted into a buffer of the workspace unless they already are
+        static const Vec &getDenseVec(const Tensor *operand, Workspace &workspace, size_t &offset);
+
+        // Adds contiguous values to the gradient of a tensor in row-major order
+        static void addToGrad(const TensorPtr &operand, const Vec &grad);
+
+        // Returns size values derived from an operand by compute, cached in a slot of the leaf tensor the operand views
+        // and derived again only once the leaf's memory is written or the operand's layout or the key changes. Returns
+        // nullptr for operands computed by the graph, which have no leaf to cache on.
+        template<class F>
+        static const Vec *getCached(const TensorPtr &operand, std::shared_ptr<CachedValues> Tensor::*slot, size_t key,
+                                    size_t size, const F &compute);
     };
 
     struct LeafOp : Op {
         LeafOp(OpName opName, Tensor *tensor, bool lazy): Op(OpType::LEAF, opName, tensor) {
             if (lazy) {
                 tensor->ops.push_back(this);
+                tensor->dirty = true;
             }
         }
     };
@@ -68,7 +134,12 @@ namespace Toygrad::Tensor {
             operand(operand) {
             if (lazy) {
                 tensor->ops.push_back(this);
-                operand->edges.push_back(tensor);
+                tensor->dirty = true;
+
+                if (GradMode::isEnabled()) {
+                    operand->edges.push_back(tensor);
+                    tensor->requiresGrad = tensor->requiresGrad || operand->requiresGrad;
+                }
             }
         }
     };
@@ -81,8 +152,32 @@ namespace Toygrad::Tensor {
                 opName, tensor), lhs(lhs), rhs(rhs) {
             if (lazy) {
                 tensor->ops.push_back(this);
-                lhs->edges.push_back(tensor);
-                rhs->edges.push_back(tensor);
+                tensor->dirty = true;
+
+                if (GradMode::isEnabled()) {
+                    lhs->edges.push_back(tensor);
+                    rhs->edges.push_back(tensor);
+                    tensor->requiresGrad = tensor->requiresGrad || lhs->requiresGrad || rhs->requiresGrad;
+                }
+            }
+        }
+    };
+
+    struct MultiOp : Op {
+        std::vector<TensorPtr> operands;
+
+        MultiOp(OpName opName, const std::vector<TensorPtr> &operands, Tensor *tensor, bool lazy): Op(
+                OpType::MULTI_OP, opName, tensor), operands(operands) {
+            if (lazy) {
+                tensor->ops.push_back(this);
+                tensor->dirty = true;
+
+                if (GradMode::isEnabled()) {
+                    for (auto &operand: operands) {
+                        operand->edges.push_back(tensor);
+                        tensor->requiresGrad = tensor->requiresGrad || operand->requiresGrad;
+                    }
+                }
             }
         }
     };
@@ -102,6 +197,10 @@ namespace Toygrad::Tensor {
         }
 
         void forward() override;
+
+        bool isConstant() const override {
+            return true;
+        }
     };
 
     struct ArangeOp final : LeafOp {
@@ -113,6 +212,10 @@ namespace Toygrad::Tensor {
         }
 
         void forward() override;
+
+        bool isConstant() const override {
+            return true;
+        }
     };
 
     struct RandintOp final : LeafOp {
@@ -152,6 +255,10 @@ namespace Toygrad::Tensor {
         void forward() override;
 
         void backward() override;
+
+        bool savesInput(size_t) const override {
+            return false;
+        }
     };
 
     struct AddOp final : BinOp {
@@ -162,6 +269,10 @@ namespace Toygrad::Tensor {
         void forward() override;
 
         void backward() override;
+
+        bool savesInput(size_t) const override {
+            return false;
+        }
     };
 
     struct AddAssignOp final : UnOp {
@@ -170,6 +281,10 @@ namespace Toygrad::Tensor {
         }
 
         void forward() override;
+
+        bool savesInput(size_t) const override {
+            return false;
+        }
     };
 
     struct SubOp final : BinOp {
@@ -180,6 +295,10 @@ namespace Toygrad::Tensor {
         void forward() override;
 
         void backward() override;
+
+        bool savesInput(size_t) const override {
+            return false;
+        }
     };
 
     struct SubAssignOp final : UnOp {
@@ -188,6 +307,10 @@ namespace Toygrad::Tensor {
         }
 
         void forward() override;
+
+        bool savesInput(size_t) const override {
+            return false;
+        }
     };
 
     struct MulOp final : BinOp {
@@ -198,6 +321,11 @@ namespace Toygrad::Tensor {
         void forward() override;
 
         void backward() override;
+
+        bool savesInput(size_t idx) const override {
+            // Each operand is only read to compute the other's gradient
+            return idx == 0 ? rhs->requiresGrad : lhs->requiresGrad;
+        }
     };
 
     struct MulAssignOp final : UnOp {
@@ -206,6 +334,10 @@ namespace Toygrad::Tensor {
         }
 
         void forward() override;
+
+        bool savesInput(size_t) const override {
+            return false;
+        }
     };
 
     struct DivOp final : BinOp {
@@ -216,6 +348,10 @@ namespace Toygrad::Tensor {
         void forward() override;
 
         void backward() override;
+
+        bool savesInput(size_t idx) const override {
+            return idx == 0 ? rhs->requiresGrad : true;
+        }
     };
 
     struct DivAssignOp final : UnOp {
@@ -224,6 +360,10 @@ namespace Toygrad::Tensor {
         }
 
         void forward() override;
+
+        bool savesInput(size_t) const override {
+            return false;
+        }
     };
 
     struct PowOp final : UnOp {
@@ -272,6 +412,14 @@ namespace Toygrad::Tensor {
         void forward() override;
 
         void backward() override;
+
+        bool savesInput(size_t) const override {
+            return false;
+        }
+
+        bool savesOutput() const override {
+            return true;
+        }
     };
 
     struct RecipOp final : UnOp {
@@ -284,6 +432,15 @@ namespace Toygrad::Tensor {
         void forward() override;
 
         void backward() override;
+
+        // Backward reads the output instead of the input since -c / x^2 == -z^2 / c
+        bool savesInput(size_t) const override {
+            return false;
+        }
+
+        bool savesOutput() const override {
+            return c != 0;
+        }
     };
 
     struct NegOp final : UnOp {
@@ -293,6 +450,10 @@ namespace Toygrad::Tensor {
         void forward() override;
 
         void backward() override;
+
+        bool savesInput(size_t) const override {
+            return false;
+        }
     };
 
     struct SqOp final : UnOp {
@@ -311,23 +472,68 @@ namespace Toygrad::Tensor {
         void forward() override;
 
         void backward() override;
+
+        bool savesInput(size_t) const override {
+            return false;
+        }
+
+        bool savesOutput() const override {
+            return true;
+        }
     };
 
     struct AliasOp final : UnOp {
         AliasOp(const TensorPtr &operand, Tensor *tensor, bool lazy): UnOp(OpName::ALIAS, operand, tensor, lazy) {
+            tensor->dtype = operand->dtype;
         }
 
         void forward() override;
+
+        bool isView() const override {
+            return true;
+        }
+
+        bool savesInput(size_t) const override {
+            return false;
+        }
     };
 
     struct DiffAliasOp final : UnOp {
         DiffAliasOp(const TensorPtr &operand, Tensor *tensor, bool lazy): UnOp(
             OpName::DIFF_ALIAS, operand, tensor, lazy) {
+            tensor->dtype = operand->dtype;
         }
 
         void forward() override;
 
         void backward() override;
+
+        bool isView() const override {
+            return true;
+        }
+
+        bool savesInput(size_t) const override {
+            return false;
+        }
+    };
+
+    // Views the operand's memory with other dimensions, the elements keep their row-major order
+    struct ReshapeOp final : UnOp {
+        ReshapeOp(const TensorPtr &operand, Tensor *tensor, bool lazy): UnOp(OpName::RESHAPE, operand, tensor, lazy) {
+            tensor->dtype = operand->dtype;
+        }
+
+        void forward() override;
+
+        void backward() override;
+
+        bool isView() const override {
+            return true;
+        }
+
+        bool savesInput(size_t) const override {
+            return false;
+        }
     };
 
     struct EqOp final : BinOp {
@@ -336,6 +542,10 @@ namespace Toygrad::Tensor {
         }
 
         void forward() override;
+
+        bool savesInput(size_t) const override {
+            return false;
+        }
     };
 
     struct NeqOp final : BinOp {
@@ -344,6 +554,10 @@ namespace Toygrad::Tensor {
         }
 
         void forward() override;
+
+        bool savesInput(size_t) const override {
+            return false;
+        }
     };
 
     struct LessOp final : BinOp {
@@ -352,6 +566,10 @@ namespace Toygrad::Tensor {
         }
 
         void forward() override;
+
+        bool savesInput(size_t) const override {
+            return false;
+        }
     };
 
     struct GreaterOp final : BinOp {
@@ -360,6 +578,10 @@ namespace Toygrad::Tensor {
         }
 
         void forward() override;
+
+        bool savesInput(size_t) const override {
+            return false;
+        }
     };
 
     struct LeqOp final : BinOp {
@@ -368,6 +590,10 @@ namespace Toygrad::Tensor {
         }
 
         void forward() override;
+
+        bool savesInput(size_t) const override {
+            return false;
+        }
     };
 
     struct GeqOp final : BinOp {
@@ -376,6 +602,10 @@ namespace Toygrad::Tensor {
         }
 
         void forward() override;
+
+        bool savesInput(size_t) const override {
+            return false;
+        }
     };
 
     struct MaxOp final : UnOp {
@@ -388,6 +618,10 @@ namespace Toygrad::Tensor {
         void forward() override;
 
         void backward() override;
+
+        bool savesOutput() const override {
+            return true;
+        }
     };
 
     struct MinOp final : UnOp {
@@ -400,15 +634,28 @@ namespace Toygrad::Tensor {
         void forward() override;
 
         void backward() override;
+
+        bool savesOutput() const override {
+            return true;
+        }
     };
 
     struct PermOp final : UnOp {
         PermOp(const TensorPtr &operand, Tensor *tensor, bool lazy): UnOp(OpName::PERM, operand, tensor, lazy) {
+            tensor->dtype = operand->dtype;
         }
 
         void forward() override;
 
         void backward() override;
+
+        bool isView() const override {
+            return true;
+        }
+
+        bool savesInput(size_t) const override {
+            return false;
+        }
     };
 
     struct ReluOp final : UnOp {
@@ -418,6 +665,14 @@ namespace Toygrad::Tensor {
         void forward() override;
 
         void backward() override;
+
+        bool savesInput(size_t) const override {
+            return false;
+        }
+
+        bool savesOutput() const override {
+            return true;
+        }
     };
 
     struct SigmoidOp final : UnOp {
@@ -427,24 +682,246 @@ namespace Toygrad::Tensor {
         void forward() override;
 
         void backward() override;
+
+        bool savesInput(size_t) const override {
+            return false;
+        }
+
+        bool savesOutput() const override {
+            return true;
+        }
     };
 
     struct CopyOp final : UnOp {
         CopyOp(const TensorPtr &operand, Tensor *tensor, bool lazy): UnOp(OpName::COPY, operand, tensor, lazy) {
+            tensor->dtype = operand->dtype;
         }
 
         void forward() override;
+
+        bool savesInput(size_t) const override {
+            return false;
+        }
     };
 
-    struct MatmulOp final : BinOp {
-        TensorPtr lhsTranspose = nullptr;
+    // Concatenates the operands along an existing dimension or, for STACK, along a new one
+    struct CatOp final : MultiOp {
+        size_t dim;
+        // Index along dim at which each operand starts in the output
+        std::vector<size_t> begins;
+
+        CatOp(OpName opName, const std::vector<TensorPtr> &operands, Tensor *tensor, size_t dim,
+              bool lazy): MultiOp(opName, operands, tensor, lazy), dim(dim) {
+            tensor->dtype = operands[0]->dtype;
+            size_t begin = 0;
 
+            for (auto &operand: operands) {
+                begins.push_back(begin);
+                begin += opName == OpName::STACK ? 1 : operand->shape[dim];
+            }
+        }
+
+        // Shape of the slice that holds the operand at idx within a tensor laid out like the output or its gradient
+        Shape getSlice(const Shape &shape, size_t idx) const {
+            Shape slice = shape;
+            slice.offset += begins[idx] * shape.getStrides()[dim];
+
+            if (opName == OpName::STACK) {
+                slice.remove(dim);
+            } else {
+                slice.setDim(dim, operands[idx]->shape[dim]);
+            }
+
+            return slice;
+        }
+
+        void forward() override;
+
+        void backward() override;
+
+        bool savesInput(size_t) const override {
+            return false;
+        }
+    };
+
+    // Converts the operand's elements to the data type of the output
+    struct CastOp final : UnOp {
+        CastOp(const TensorPtr &operand, Tensor *tensor, bool lazy): UnOp(OpName::CAST, operand, tensor, lazy) {
+            // Gradients only flow into floating point tensors
+            tensor->requiresGrad = tensor->requiresGrad && isFloatingPoint(tensor->dtype) &&
+                                   isFloatingPoint(operand->dtype);
+        }
+
+        void forward() override;
+
+        void backward() override;
+
+        bool savesInput(size_t) const override {
+            return false;
+        }
+    };
+
+    // Selects the second operand where the first one, a mask of any type, is set and the third one elsewhere
+    struct WhereOp final : MultiOp {
+        WhereOp(const std::vector<TensorPtr> &operands, Tensor *tensor, bool lazy): MultiOp(OpName::WHERE, operands,
+                tensor, lazy) {
+        }
+
+        void forward() override;
+
+        void backward() override;
+
+        bool savesInput(size_t idx) const override {
+            return idx == 0;
+        }
+    };
+
+    struct MatmulOp final : BinOp {
         MatmulOp(const TensorPtr &lhs, const TensorPtr &rhs, Tensor *tensor, bool lazy): BinOp(
             OpName::MATMUL, lhs, rhs, tensor, lazy) {
         }
 
+        // Returns the buffer gemm reads a right operand from for a product with m rows and sets its shape. Float32
+        // weights read through a transposed view would be gathered by gemm tile by tile unless the skinny kernel reads
+        // them in place, so a packed copy is cached on the leaf they view instead, operands computed by the graph are
+        // gathered each pass. Reduced precision weights are read in place and converted a tile at a time by gemm.
+        static const Vec *getRhsVec(const TensorPtr &rhs, size_t m, Shape &rhsShape);
+
+        void forward() override;
+
+        void backward() override;
+
+        size_t cost() const override {
+            // Each output element is a dot product over the shared dimension
+            return tensor->shape.getSize() * lhs->shape[lhs->shape.getNumDims() - 1];
+        }
+
+        bool savesInput(size_t idx) const override {
+            return idx == 0 ? rhs->requiresGrad : lhs->requiresGrad;
+        }
+    };
+
+    // Multiplies x by the transpose of the weight view, adds the bias and applies the activation in the epilogue of
+    // one gemm so the result is written once, operands are x, the N x K weight view and the bias
+    struct FusedLinearOp final : MultiOp {
+        Activation activation;
+
+        FusedLinearOp(const std::vector<TensorPtr> &operands, Tensor *tensor, Activation activation,
+                      bool lazy): MultiOp(OpName::FUSED_LINEAR, operands, tensor, lazy), activation(activation) {
+        }
+
+        // Returns the buffer of the values of a tensor viewed as a matrix whose rows fold its leading dimensions and
+        // sets the index of its first element and its strides, a layout that cannot be folded, e.g. a slice of a
+        // concatenation along a leading dimension, is copied into a buffer of the workspace
+        static const Vec &getMatrixVec(const Tensor *operand, Workspace &workspace, size_t &offset, Dims &strides);
+
         void forward() override;
 
         void backward() override;
+
+        size_t cost() const override {
+            const Shape &xShape = operands[0]->shape;
+            return tensor->shape.getSize() * xShape[xShape.getNumDims() - 1];
+        }
+
+        bool savesInput(size_t idx) const override {
+            return idx == 0 ? operands[1]->requiresGrad : idx == 1 && operands[0]->requiresGrad;
+        }
+
+        bool savesOutput() const override {
+            return activation != Activation::NONE;
+        }
+    };
+
+    // Multiplies the rows of lhs, quantized to int8 on the fly, by constant int8 weights and adds rhs as the bias,
+    // used for inference only
+    struct Int8MatmulOp final : BinOp {
+        std::shared_ptr<const Int8Matrix> weights;
+        // Rows of lhs quantized by the last forward pass, kept so that the next pass reuses their memory
+        Int8Matrix quantized;
+
+        Int8MatmulOp(const TensorPtr &lhs, const TensorPtr &rhs, const std::shared_ptr<const Int8Matrix> &weights,
+                     Tensor *tensor, bool lazy): BinOp(OpName::INT8_MATMUL, lhs, rhs, tensor, lazy), weights(weights) {
+        }
+
+        void forward() override;
+
+        size_t cost() const override {
+            return tensor->shape.getSize() * weights->cols;
+        }
+
+        bool savesInput(size_t) const override {
+            return false;
+        }
+    };
+
+    // Multiplies lhs by constant 4-bit weights, dequantized group by group as they are read, and adds rhs as the bias,
+    // used for inference only
+    struct Int4MatmulOp final : BinOp {
+        std::shared_ptr<const Int4Matrix> weights;
+
+        Int4MatmulOp(const TensorPtr &lhs, const TensorPtr &rhs, const std::shared_ptr<const Int4Matrix> &weights,
+                     Tensor *tensor, bool lazy): BinOp(OpName::INT4_MATMUL, lhs, rhs, tensor, lazy), weights(weights) {
+        }
+
+        void forward() override;
+
+        size_t cost() const override {
+            return tensor->shape.getSize() * weights->cols;
+        }
+
+        bool savesInput(size_t) const override {
+            return false;
+        }
+    };
+
+    // Convolves a batch of images or signals with weights and adds the bias if there is one, operands are the
+    // images, the weights and optionally the bias
+    struct ConvOp final : MultiOp {
+        ConvShape conv;
+
+        ConvOp(const std::vector<TensorPtr> &operands, Tensor *tensor, const ConvShape &conv,
+               bool lazy): MultiOp(OpName::CONV, operands, tensor, lazy), conv(conv) {
+        }
+
+        // Returns the weights transformed for a Winograd convolution with the given tile size. Like packed matmul
+        // operands, the transform of weights that view a leaf is cached on the leaf until the leaf's memory is written
+        // and weights computed by the graph are transformed into a buffer of the workspace on every pass.
+        static const Vec &getWinogradFilter(const TensorPtr &weight, const ConvShape &conv, size_t tileSize,
+                                            Workspace &workspace);
+
+        void forward() override;
+
+        void backward() override;
+
+        size_t cost() const override {
+            return tensor->shape.getSize() * conv.inChannels * conv.kernelHeight * conv.kernelWidth;
+        }
+
+        bool savesInput(size_t idx) const override {
+            return idx == 0 ? operands[1]->requiresGrad : idx == 1 && operands[0]->requiresGrad;
+        }
+    };
+
+    // Takes the maximum or the average of each window of a batch of images or signals
+    struct PoolOp final : UnOp {
+        ConvShape pool;
+        Pooling pooling;
+
+        PoolOp(const TensorPtr &operand, Tensor *tensor, const ConvShape &pool, Pooling pooling,
+               bool lazy): UnOp(OpName::POOL, operand, tensor, lazy), pool(pool), pooling(pooling) {
+        }
+
+        void forward() override;
+
+        void backward() override;
+
+        size_t cost() const override {
+            return tensor->shape.getSize() * pool.kernelHeight * pool.kernelWidth;
+        }
+
+        bool savesInput(size_t) const override {
+            return pooling == Pooling::MAX;
+        }
     };
 }
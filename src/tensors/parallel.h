@@ -0,0 +1,160 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Toygrad::Tensor {
+    // Worker threads started once and shared by every parallel loop, so that a kernel call only wakes them instead of
+    // paying for creating and joining threads
+    class ThreadPool {
+        // Type-erased reference to the function run on each chunk, stored without allocating
+        struct Task {
+            const void *f = nullptr;
+            void (*invoke)(const void *f, size_t chunk) = nullptr;
+        };
+
+        std::vector<std::thread> workers;
+        // Guards the task and its counters, chunks are claimed under it so a worker never runs a stale task
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable done;
+        Task task;
+        size_t numChunks = 0;
+        size_t nextChunk = 0;
+        size_t pendingChunks = 0;
+        bool stopping = false;
+        // Lets one loop at a time use the workers when several threads call parallelFor
+        std::mutex submitMutex;
+
+        // Whether the current thread is running a chunk, a nested loop then runs on it without waiting for workers
+        static bool &isInChunk() {
+            thread_local bool inChunk = false;
+            return inChunk;
+        }
+
+        ThreadPool() {
+            size_t numWorkers = std::max<size_t>(std::thread::hardware_concurrency(), 1) - 1;
+
+            for (size_t i = 0; i < numWorkers; i++) {
+                workers.emplace_back([this] {
+                    isInChunk() = true;
+                    std::unique_lock lock(mutex);
+
+                    while (true) {
+                        wake.wait(lock, [this] { return stopping || nextChunk < numChunks; });
+
+                        if (stopping) {
+                            return;
+                        }
+
+                        runChunk(lock);
+                    }
+                });
+            }
+        }
+
+        // Runs the next unclaimed chunk with the mutex released while it runs
+        void runChunk(std::unique_lock<std::mutex> &lock) {
+            size_t chunk = nextChunk++;
+            Task current = task;
+            lock.unlock();
+            current.invoke(current.f, chunk);
+            lock.lock();
+
+            if (--pendingChunks == 0) {
+                done.notify_all();
+            }
+        }
+
+    public:
+        ThreadPool(const ThreadPool &) = delete;
+
+        ~ThreadPool() {
+            {
+                std::lock_guard lock(mutex);
+                stopping = true;
+            }
+
+            wake.notify_all();
+
+            for (auto &worker: workers) {
+                worker.join();
+            }
+        }
+
+        static ThreadPool &get() {
+            static ThreadPool pool;
+            return pool;
+        }
+
+        size_t getNumThreads() const { return workers.size() + 1; }
+
+        /**
+         * Calls f(chunk) for every chunk in [0, numChunks) on the workers and the calling thread, which also runs
+         * chunks, and returns once all of them are done.
+         * @param numChunks the number of chunks.
+         * @param f the function called with the index of each chunk.
+         */
+        template<class F>
+        void run(size_t numChunks, const F &f) {
+            if (isInChunk() || workers.empty()) {
+                for (size_t chunk = 0; chunk < numChunks; chunk++) {
+                    f(chunk);
+                }
+
+                return;
+            }
+
+            std::lock_guard submit(submitMutex);
+            std::unique_lock lock(mutex);
+            task = {&f, [](const void *fn, size_t chunk) { (*static_cast<const F *>(fn))(chunk); }};
+            this->numChunks = numChunks;
+            nextChunk = 0;
+            pendingChunks = numChunks;
+            wake.notify_all();
+            isInChunk() = true;
+
+            while (nextChunk < numChunks) {
+                runChunk(lock);
+            }
+
+            isInChunk() = false;
+            done.wait(lock, [this] { return pendingChunks == 0; });
+        }
+    };
+
+    /**
+     * Splits [begin, end) into contiguous chunks and runs them on the threads of the pool. Ranges of at most grain
+     * iterations run on the calling thread so that small tensors do not pay for waking workers, and so do loops
+     * nested in a chunk of another loop.
+     * @param begin the first iteration.
+     * @param end one past the last iteration.
+     * @param grain the minimum number of iterations worth giving to a thread.
+     * @param f the function called with the bounds [lo, hi) of each chunk.
+     */
+    template<class F>
+    void parallelFor(size_t begin, size_t end, size_t grain, const F &f) {
+        if (begin >= end) {
+            return;
+        }
+
+        size_t numIters = end - begin;
+        ThreadPool &pool = ThreadPool::get();
+        size_t numThreads = std::min(pool.getNumThreads(), (numIters + grain - 1) / std::max<size_t>(grain, 1));
+
+        if (numThreads <= 1) {
+            f(begin, end);
+            return;
+        }
+
+        size_t chunk = (numIters + numThreads - 1) / numThreads;
+
+        pool.run((numIters + chunk - 1) / chunk, [&](size_t idx) {
+            size_t lo = begin + idx * chunk;
+            f(lo, std::min(lo + chunk, end));
+        });
+    }
+}
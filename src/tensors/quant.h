@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "common.h"
+
+namespace Toygrad::Tensor {
+    // Row-major matrix of int8 values quantized symmetrically per row, element (i, j) stands for
+    // values[i * cols + j] * scales[i]
+    struct Int8Matrix {
+        size_t rows = 0;
+        size_t cols = 0;
+        std::vector<int8_t> values;
+        // Value of one quantization step of each row
+        std::vector<real> scales;
+    };
+
+    // Row-major matrix of 4-bit values quantized asymmetrically per group of consecutive elements of a row, two values
+    // per byte with the even column in the low half. Element (i, j) of group g stands for (q - zeros[i, g]) *
+    // scales[i, g].
+    struct Int4Matrix {
+        size_t rows = 0;
+        size_t cols = 0;
+        size_t groupSize = 0;
+        std::vector<uint8_t> values;
+        // Value of one quantization step of each group of each row
+        std::vector<real> scales;
+        // Quantized value that stands for zero in each group of each row
+        std::vector<real> zeros;
+
+        size_t getNumGroups() const { return (cols + groupSize - 1) / groupSize; }
+
+        size_t getRowBytes() const { return (cols + 1) / 2; }
+    };
+}
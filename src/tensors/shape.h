@@ -4,6 +4,7 @@
 #include <vector>
 
 #include "common.h"
+#include "dims.h"
 
 namespace Toygrad::Tensor {
     // TODO: fix shape so it can have at least one dimension
@@ -11,56 +12,146 @@ namespace Toygrad::Tensor {
     private:
         friend class Tensor;
 
+        Dims view;
+        Dims strides;
+        // Number of elements, cached since it is queried on every iteration
+        size_t size = 1;
+        // Whether the elements are laid out in row-major order without gaps
+        bool contiguous = true;
+
         Shape() = default;
 
         void initStrides() {
             strides.resize(view.size());
-            strides[view.size() - 1] = 1;
             size_t stride = 1;
 
-            for (int i = view.size() - 2; i >= 0; i--) {
-                stride *= view[i + 1];
-                strides[i] = stride;
+            for (size_t i = view.size(); i > 0; i--) {
+                strides[i - 1] = stride;
+                stride *= view[i - 1];
+            }
+
+            update();
+        }
+
+        void update() {
+            size = 1;
+            contiguous = true;
+
+            // Dimensions of size 1 are skipped since their strides never move the index
+            for (size_t i = view.size(); i > 0; i--) {
+                if (view[i - 1] != 1 && strides[i - 1] != size) {
+                    contiguous = false;
+                }
+
+                size *= view[i - 1];
             }
         }
 
     public:
         size_t offset = 0;
-        std::vector<size_t> view;
-        std::vector<size_t> strides;
 
-        Shape(size_t offset, const std::vector<size_t> &view, const std::vector<size_t> &strides): offset(offset),
-            view(view), strides(strides) {
+        Shape(size_t offset, const Dims &view, const Dims &strides): view(view), strides(strides), offset(offset) {
+            update();
         }
 
-        Shape(size_t offset, const std::vector<size_t> &view): offset(offset), view(view) {
+        Shape(size_t offset, const Dims &view): view(view), offset(offset) {
             initStrides();
         }
 
-        explicit Shape(const std::vector<size_t> &view): Shape(0, view) {
+        explicit Shape(const Dims &view): Shape(0, view) {
+        }
+
+        Shape(const Shape &shape) = default;
+
+        const Dims &getView() const {
+            return view;
+        }
+
+        const Dims &getStrides() const {
+            return strides;
+        }
+
+        void setDim(size_t dim, size_t size) {
+            view[dim] = size;
+            update();
+        }
+
+        void setStride(size_t dim, size_t stride) {
+            strides[dim] = stride;
+            update();
+        }
+
+        void insertDim(size_t dim, size_t size, size_t stride) {
+            view.insert(view.begin() + dim, size);
+            strides.insert(strides.begin() + dim, stride);
+            update();
         }
 
-        Shape(const Shape &shape) {
-            offset = shape.offset;
-            view = shape.view;
-            strides = shape.strides;
+        void pushDim(size_t size, size_t stride) {
+            view.push_back(size);
+            strides.push_back(stride);
+            update();
         }
 
         void remove(size_t dim) {
             view.erase(view.begin() + dim);
             strides.erase(strides.begin() + dim);
+            update();
         }
 
-        std::vector<size_t> getContiguousStrides() const {
-            std::vector<size_t> contiguousStrides(view.size());
-            size_t stride = 1;
+        bool isContiguous() const {
+            return contiguous;
+        }
 
-            for (int i = contiguousStrides.size() - 1; i >= 0; i--) {
-                contiguousStrides[i] = stride;
-                stride *= view[i];
+        // Computes the strides that view the same elements in row-major order with the target dimensions. Each run of
+        // dimensions that is contiguous with respect to itself may be split or merged freely, a target dimension that
+        // spans two such runs cannot be expressed without a copy.
+        bool getViewStrides(const Dims &target, Dims &targetStrides) const {
+            size_t targetSize = 1;
+
+            for (size_t dim: target) {
+                targetSize *= dim;
+            }
+
+            if (targetSize != size) {
+                return false;
+            }
+
+            targetStrides.resize(target.size());
+
+            if (size == 0) {
+                return true;
+            }
+
+            size_t targetDim = target.size();
+            size_t chunkStride = strides[view.size() - 1];
+            size_t chunkSize = 1;
+            size_t targetChunkSize = 1;
+
+            for (size_t dim = view.size(); dim > 0; dim--) {
+                chunkSize *= view[dim - 1];
+
+                // The chunk ends where the next outer dimension does not continue it
+                if (dim == 1 || (view[dim - 2] != 1 && strides[dim - 2] != chunkSize * chunkStride)) {
+                    while (targetDim > 0 && (targetChunkSize < chunkSize || target[targetDim - 1] == 1)) {
+                        targetStrides[targetDim - 1] = targetChunkSize * chunkStride;
+                        targetChunkSize *= target[targetDim - 1];
+                        targetDim--;
+                    }
+
+                    if (targetChunkSize != chunkSize) {
+                        return false;
+                    }
+
+                    if (dim > 1) {
+                        chunkStride = strides[dim - 2];
+                        chunkSize = 1;
+                        targetChunkSize = 1;
+                    }
+                }
             }
 
-            return contiguousStrides;
+            return targetDim == 0;
         }
 
         std::vector<size_t> getSizePerDim() const {
@@ -83,6 +174,7 @@ namespace Toygrad::Tensor {
                 shape.strides[i] = strides[shapePerm[i]];
             }
 
+            shape.update();
             return shape;
         }
 
@@ -112,64 +204,41 @@ namespace Toygrad::Tensor {
             return str;
         }
 
-        Shape &operator=(const Shape &rhs) {
-            if (this == &rhs) {
-                return *this;
-            }
-
-            offset = rhs.offset;
-            view = rhs.view;
-            strides = rhs.strides;
-            return *this;
-        }
+        Shape &operator=(const Shape &rhs) = default;
 
         size_t getNumDims() const {
             return view.size();
         }
 
         size_t getSize() const {
-            size_t s = 1;
-
-            for (size_t dim: view) {
-                s *= dim;
-            }
-
-            return s;
+            return size;
         }
 
-        size_t &operator[](size_t idx) {
+        size_t operator[](size_t idx) const {
             return view[idx];
         }
 
-        std::vector<size_t>::iterator begin() {
-            return view.begin();
-        }
-
-        std::vector<size_t>::iterator end() {
-            return view.end();
-        }
-
-        std::vector<size_t>::const_iterator cbegin() const {
+        Dims::const_iterator begin() const {
             return view.cbegin();
         }
 
-        std::vector<size_t>::const_iterator cend() const {
+        Dims::const_iterator end() const {
             return view.cend();
         }
 
-        std::vector<size_t>::reverse_iterator rbegin() {
-            return view.rbegin();
+        Dims::const_iterator cbegin() const {
+            return view.cbegin();
         }
 
-        std::vector<size_t>::reverse_iterator rend() {
-            return view.rend();
+        Dims::const_iterator cend() const {
+            return view.cend();
         }
 
-        std::vector<size_t>::const_reverse_iterator crbegin() const {
+        Dims::const_reverse_iterator crbegin() const {
             return view.crbegin();
         }
 
-        std::vector<size_t>::const_reverse_iterator crend() const {
+        Dims::const_reverse_iterator crend() const {
             return view.crend();
         }
     };
@@ -1,10 +1,13 @@
+#include <algorithm>
 #include <iostream>
+#include <numeric>
 #include <sstream>
 #include <ranges>
 #include "tensor.h"
 #include "ops.h"
 #include "tensor_iter.h"
 #include "tensor_graph.h"
+#include "kernels.h"
 
 namespace Toygrad::Tensor {
     size_t Tensor::idCounter = 0;
@@ -14,7 +17,35 @@ namespace Toygrad::Tensor {
     }
 
     Tensor::Tensor(const Shape &shape, bool initStrides) : Tensor() {
-        this->shape = initStrides ? Shape(0, shape.view) : shape;
+        setShape(initStrides ? Shape(0, shape.getView()) : shape);
+    }
+
+    void Tensor::setShape(const Shape &shape) {
+        this->shape = shape;
+        const Dims &view = shape.getView();
+        const Dims &strides = shape.getStrides();
+        iterView.resize(0);
+        iterStrides.resize(0);
+
+        for (size_t i = 0; i < view.size(); i++) {
+            if (view[i] == 1) {
+                continue;
+            }
+
+            if (!iterView.empty() && iterStrides[iterStrides.size() - 1] == strides[i] * view[i]) {
+                // Merge into the previous dimension
+                iterView[iterView.size() - 1] *= view[i];
+                iterStrides[iterStrides.size() - 1] = strides[i];
+            } else {
+                iterView.push_back(view[i]);
+                iterStrides.push_back(strides[i]);
+            }
+        }
+
+        if (iterView.empty()) {
+            iterView.push_back(1);
+            iterStrides.push_back(1);
+        }
     }
 
     Tensor::~Tensor() {
@@ -24,6 +55,15 @@ namespace Toygrad::Tensor {
     }
 
     std::ostream &operator<<(std::ostream &stream, const Tensor &tensor) {
+        if (tensor.dtype != DType::FLOAT32 && tensor.vec != nullptr) {
+            // Other data types are printed from a float32 copy
+            Tensor converted(Shape(tensor.shape.getView()));
+            converted.initVec();
+            stridedCast(*tensor.vec, tensor.shape.offset, tensor.shape.getStrides(), *converted.vec, 0,
+                        converted.shape.getStrides(), tensor.shape.getView());
+            return stream << converted;
+        }
+
         IterPtr iter = initConstIter(&tensor);
         std::vector<size_t> sizePerDim = tensor.shape.getSizePerDim();
         iter->start();
@@ -82,6 +122,7 @@ namespace Toygrad::Tensor {
     void Tensor::realizeOp(Op *op, bool lazy) {
         if (!lazy) {
             op->forward();
+            op->tensor->bumpVersion();
             delete op;
         }
     }
@@ -98,7 +139,7 @@ namespace Toygrad::Tensor {
         auto outShape = shape;
 
         for (size_t idx: indices) {
-            outShape.offset += idx * outShape.strides[0];
+            outShape.offset += idx * outShape.getStrides()[0];
             outShape.remove(0);
         }
 
@@ -117,20 +158,19 @@ namespace Toygrad::Tensor {
         outShape.offset = shape.offset;
 
         for (size_t i = 0; i < ranges.size(); i++) {
-            outShape.offset += ranges[i].beg * shape.strides[i];
+            outShape.offset += ranges[i].beg * shape.getStrides()[i];
         }
 
         for (size_t i = 0; i < ranges.size(); i++) {
             size_t dim = ceil(static_cast<real>(ranges[i].end - ranges[i].beg) / ranges[i].step);
-            outShape.view.push_back(dim);
-            outShape.strides.push_back(shape.strides[i] * ranges[i].step);
+            outShape.pushDim(dim, shape.getStrides()[i] * ranges[i].step);
         }
 
         return alias(outShape, lazy, std::move(outTensor));
     }
 
     bool Tensor::isContiguous() const {
-        return shape.strides == shape.getContiguousStrides();
+        return shape.isContiguous();
     }
 
     bool Tensor::isBroadcastableTo(const Shape &target) const {
@@ -159,25 +199,25 @@ namespace Toygrad::Tensor {
         }
 
         assert(Error::str_assert(isBroadcastableTo(target), Error::Message::notBroadcastable(shape, target)));
-        Shape outShape;
-        outShape.offset = shape.offset;
-        outShape.view = shape.view;
-        size_t dimsToAdd = target.getNumDims() - outShape.getNumDims();
+        Dims outView = shape.view;
+        size_t dimsToAdd = target.getNumDims() - outView.size();
 
         for (size_t i = 0; i < dimsToAdd; i++) {
-            outShape.view.insert(outShape.view.begin(), 1);
+            outView.insert(outView.begin(), 1);
         }
 
-        outShape.initStrides();
+        Shape outShape(shape.offset, outView);
 
         for (int i = target.getNumDims() - 1; i >= 0; i--) {
-            if (outShape.view[i] < target.view[i]) {
-                // outShape.view[i] == 1
-                outShape.view[i] = target.view[i];
+            if (outShape[i] < target[i]) {
+                // outShape[i] == 1
+                outShape.view[i] = target[i];
                 outShape.strides[i] = 0;
             }
         }
 
+        outShape.update();
+
         return alias(outShape, lazy, std::move(outTensor));
     }
 
@@ -202,6 +242,26 @@ namespace Toygrad::Tensor {
         return outTensor;
     }
 
+    TensorPtr Tensor::to(DType dtype, bool lazy, TensorPtr outTensor) {
+        if (dtype == this->dtype && outTensor == nullptr) {
+            return getThis();
+        }
+
+        outTensor = initTensor(shape, true, outTensor);
+        outTensor->dtype = dtype;
+        auto op = new CastOp(getThis(), outTensor.get(), lazy);
+        realizeOp(op, lazy);
+        return outTensor;
+    }
+
+    TensorPtr Tensor::contiguous(bool lazy, TensorPtr outTensor) {
+        if (isContiguous() && outTensor == nullptr) {
+            return getThis();
+        }
+
+        return copy(lazy, std::move(outTensor));
+    }
+
     TensorPtr Tensor::squeeze(int64_t dim, bool lazy, TensorPtr outTensor) {
         Shape outShape;
 
@@ -233,12 +293,9 @@ namespace Toygrad::Tensor {
         Shape outShape = shape;
 
         if (dim == -1) {
-            outShape.view.push_back(1);
-            outShape.strides.push_back(1);
+            outShape.pushDim(1, 1);
         } else {
-            outShape.view.insert(outShape.view.begin() + dim, 1);
-            size_t stride = outShape.view[dim] * outShape.strides[dim];
-            outShape.strides.insert(outShape.strides.begin() + dim, stride);
+            outShape.insertDim(dim, 1, outShape[dim] * outShape.strides[dim]);
         }
 
         return alias(outShape, lazy, std::move(outTensor));
@@ -250,11 +307,11 @@ namespace Toygrad::Tensor {
 
         // Turn invalid ranges into valid ones
         for (size_t i = 0; i < newRanges.size(); i++) {
-            if (newRanges[i].beg >= shape.view[i]) {
+            if (newRanges[i].beg >= shape[i]) {
                 newRanges[i].beg = 0;
                 newRanges[i].end = 0;
-            } else if (newRanges[i].end > shape.view[i]) {
-                newRanges[i].end = shape.view[i];
+            } else if (newRanges[i].end > shape[i]) {
+                newRanges[i].end = shape[i];
             }
         }
 
@@ -296,6 +353,98 @@ namespace Toygrad::Tensor {
         return outTensor;
     }
 
+    TensorPtr Tensor::fromBuffer(const std::shared_ptr<Vec> &vec, const Shape &shape) {
+        size_t end = shape.offset + 1;
+
+        for (size_t i = 0; i < shape.getNumDims(); i++) {
+            end += (shape[i] - 1) * shape.getStrides()[i];
+        }
+
+        // Every element must lie within the buffer
+        assert(Error::str_assert(shape.getSize() == 0 || end <= vec->size, Error::Message::indexOutOfBounds));
+        auto outTensor = initTensor(shape, false, nullptr);
+        outTensor->vec = vec;
+        outTensor->dtype = vec->dtype;
+        outTensor->bumpVersion();
+        return outTensor;
+    }
+
+    TensorPtr Tensor::cat(const std::vector<TensorPtr> &tensors, size_t dim, bool lazy, TensorPtr outTensor) {
+        assert(Error::str_assert(!tensors.empty(), Error::Message::emptyTensorList));
+        const Shape &firstShape = tensors[0]->shape;
+        assert(Error::str_assert(dim < firstShape.getNumDims(), Error::Message::invalidDim(dim, firstShape)));
+        Dims outView = firstShape.getView();
+        outView[dim] = 0;
+
+        for (auto &tensor: tensors) {
+            bool matched = tensor->shape.getNumDims() == firstShape.getNumDims();
+
+            for (size_t i = 0; matched && i < firstShape.getNumDims(); i++) {
+                matched = i == dim || tensor->shape[i] == firstShape[i];
+            }
+
+            assert(Error::str_assert(matched, Error::Message::shapesMismatched("cat", firstShape, tensor->shape)));
+            assert(Error::str_assert(tensor->dtype == tensors[0]->dtype,
+                Error::Message::dtypesMismatched("cat", tensors[0]->dtype, tensor->dtype)));
+            outView[dim] += tensor->shape[dim];
+        }
+
+        outTensor = initTensor(Shape(outView), true, outTensor);
+        auto op = new CatOp(OpName::CAT, tensors, outTensor.get(), dim, lazy);
+        realizeOp(op, lazy);
+        return outTensor;
+    }
+
+    TensorPtr Tensor::stack(const std::vector<TensorPtr> &tensors, size_t dim, bool lazy, TensorPtr outTensor) {
+        assert(Error::str_assert(!tensors.empty(), Error::Message::emptyTensorList));
+        const Shape &firstShape = tensors[0]->shape;
+        assert(Error::str_assert(dim <= firstShape.getNumDims(), Error::Message::invalidDim(dim, firstShape)));
+
+        for ([[maybe_unused]] auto &tensor: tensors) {
+            assert(Error::str_assert(tensor->shape == firstShape,
+                Error::Message::shapesMismatched("stack", firstShape, tensor->shape)));
+            assert(Error::str_assert(tensor->dtype == tensors[0]->dtype,
+                Error::Message::dtypesMismatched("stack", tensors[0]->dtype, tensor->dtype)));
+        }
+
+        Dims outView = firstShape.getView();
+        outView.insert(outView.begin() + dim, tensors.size());
+        outTensor = initTensor(Shape(outView), true, outTensor);
+        auto op = new CatOp(OpName::STACK, tensors, outTensor.get(), dim, lazy);
+        realizeOp(op, lazy);
+        return outTensor;
+    }
+
+    TensorPtr Tensor::where(const TensorPtr &mask, const TensorPtr &x, const TensorPtr &y, bool lazy,
+                            TensorPtr outTensor) {
+        assert(Error::str_assert(mask->isBroadcastableTo(x->shape),
+            Error::Message::notBroadcastable(mask->shape, x->shape)));
+        assert(Error::str_assert(y->isBroadcastableTo(x->shape), Error::Message::notBroadcastable(y->shape, x->shape)));
+        auto broadcastedMask = mask->broadcastTo(x->shape, lazy, nullptr);
+        auto broadcastedY = y->broadcastTo(x->shape, lazy, nullptr);
+        outTensor = initTensor(x->shape, true, outTensor);
+        auto op = new WhereOp({broadcastedMask, x, broadcastedY}, outTensor.get(), lazy);
+        realizeOp(op, lazy);
+        return outTensor;
+    }
+
+    TensorPtr Tensor::maskedSelect(const Tensor &mask) const {
+        assert(Error::str_assert(vec != nullptr && mask.vec != nullptr, Error::Message::tensorUnrealized));
+        assert(Error::str_assert(mask.shape == shape, Error::Message::shapesMismatched("masked select", shape,
+            mask.shape)));
+        IterPtr iter = initConstIter(this);
+        IterPtr maskIter = initIndexIter(&mask);
+        std::vector<real> selected;
+
+        for (iter->start(), maskIter->start(); iter->hasNext(); iter->next(), maskIter->next()) {
+            if (readMask(mask.vec->buff.get(), mask.dtype, maskIter->index())) {
+                selected.push_back(iter->curr());
+            }
+        }
+
+        return fromVec({selected.size()}, selected, false);
+    }
+
     TensorPtr Tensor::operator[](size_t idx) {
         auto outTensor = at(idx, true, nullptr);
         return outTensor;
@@ -304,9 +453,9 @@ namespace Toygrad::Tensor {
     TensorPtr Tensor::add(Tensor &rhs, bool lazy, TensorPtr outTensor) {
         assert(Error::str_assert(rhs.isBroadcastableTo(shape),
             Error::Message::notBroadcastable(rhs.shape, shape)));
-        auto broadcastedRhs = rhs.broadcastTo(shape, lazy, nullptr);
+        auto broadcastedRhs = rhs.broadcastTo(shape, lazy, nullptr)->toReal(lazy);
         outTensor = initTensor(shape, true, outTensor);
-        auto op = new AddOp(getThis(), broadcastedRhs, outTensor.get(), lazy);
+        auto op = new AddOp(toReal(lazy), broadcastedRhs, outTensor.get(), lazy);
         realizeOp(op, lazy);
         return outTensor;
     }
@@ -314,9 +463,9 @@ namespace Toygrad::Tensor {
     TensorPtr Tensor::sub(Tensor &rhs, bool lazy, TensorPtr outTensor) {
         assert(Error::str_assert(rhs.isBroadcastableTo(shape),
             Error::Message::notBroadcastable(rhs.shape, shape)));
-        auto broadcastedRhs = rhs.broadcastTo(shape, lazy, nullptr);
+        auto broadcastedRhs = rhs.broadcastTo(shape, lazy, nullptr)->toReal(lazy);
         outTensor = initTensor(shape, true, outTensor);
-        auto op = new SubOp(getThis(), broadcastedRhs, outTensor.get(), lazy);
+        auto op = new SubOp(toReal(lazy), broadcastedRhs, outTensor.get(), lazy);
         realizeOp(op, lazy);
         return outTensor;
     }
@@ -324,9 +473,9 @@ namespace Toygrad::Tensor {
     TensorPtr Tensor::mul(Tensor &rhs, bool lazy, TensorPtr outTensor) {
         assert(Error::str_assert(rhs.isBroadcastableTo(shape),
             Error::Message::notBroadcastable(rhs.shape, shape)));
-        auto broadcastedRhs = rhs.broadcastTo(shape, lazy, nullptr);
+        auto broadcastedRhs = rhs.broadcastTo(shape, lazy, nullptr)->toReal(lazy);
         outTensor = initTensor(shape, true, outTensor);
-        auto op = new MulOp(getThis(), broadcastedRhs, outTensor.get(), lazy);
+        auto op = new MulOp(toReal(lazy), broadcastedRhs, outTensor.get(), lazy);
         realizeOp(op, lazy);
         return outTensor;
     }
@@ -334,82 +483,82 @@ namespace Toygrad::Tensor {
     TensorPtr Tensor::div(Tensor &rhs, bool lazy, TensorPtr outTensor) {
         assert(Error::str_assert(rhs.isBroadcastableTo(shape),
             Error::Message::notBroadcastable(rhs.shape, shape)));
-        auto broadcastedRhs = rhs.broadcastTo(shape, lazy, nullptr);
+        auto broadcastedRhs = rhs.broadcastTo(shape, lazy, nullptr)->toReal(lazy);
         outTensor = initTensor(shape, true, outTensor);
-        auto op = new DivOp(getThis(), broadcastedRhs, outTensor.get(), lazy);
+        auto op = new DivOp(toReal(lazy), broadcastedRhs, outTensor.get(), lazy);
         realizeOp(op, lazy);
         return outTensor;
     }
 
     TensorPtr Tensor::pow(real c, bool lazy, TensorPtr outTensor) {
         outTensor = initTensor(shape, true, outTensor);
-        auto op = new PowOp(getThis(), outTensor.get(), c, lazy);
+        auto op = new PowOp(toReal(lazy), outTensor.get(), c, lazy);
         realizeOp(op, lazy);
         return outTensor;
     }
 
     TensorPtr Tensor::log(bool lazy, TensorPtr outTensor) {
         outTensor = initTensor(shape, true, outTensor);
-        auto op = new LogOp(getThis(), outTensor.get(), lazy);
+        auto op = new LogOp(toReal(lazy), outTensor.get(), lazy);
         realizeOp(op, lazy);
         return outTensor;
     }
 
     TensorPtr Tensor::sin(bool lazy, TensorPtr outTensor) {
         outTensor = initTensor(shape, true, outTensor);
-        auto op = new SinOp(getThis(), outTensor.get(), lazy);
+        auto op = new SinOp(toReal(lazy), outTensor.get(), lazy);
         realizeOp(op, lazy);
         return outTensor;
     }
 
     TensorPtr Tensor::cos(bool lazy, TensorPtr outTensor) {
         outTensor = initTensor(shape, true, outTensor);
-        auto op = new CosOp(getThis(), outTensor.get(), lazy);
+        auto op = new CosOp(toReal(lazy), outTensor.get(), lazy);
         realizeOp(op, lazy);
         return outTensor;
     }
 
     TensorPtr Tensor::exp(bool lazy, TensorPtr outTensor) {
         outTensor = initTensor(shape, true, outTensor);
-        auto op = new ExpOp(getThis(), outTensor.get(), lazy);
+        auto op = new ExpOp(toReal(lazy), outTensor.get(), lazy);
         realizeOp(op, lazy);
         return outTensor;
     }
 
     TensorPtr Tensor::recip(real c, bool lazy, TensorPtr outTensor) {
         outTensor = initTensor(shape, true, outTensor);
-        auto op = new RecipOp(getThis(), outTensor.get(), c, lazy);
+        auto op = new RecipOp(toReal(lazy), outTensor.get(), c, lazy);
         realizeOp(op, lazy);
         return outTensor;
     }
 
     TensorPtr Tensor::sq(bool lazy, TensorPtr outTensor) {
         outTensor = initTensor(shape, true, outTensor);
-        auto op = new SqOp(getThis(), outTensor.get(), lazy);
+        auto op = new SqOp(toReal(lazy), outTensor.get(), lazy);
         realizeOp(op, lazy);
         return outTensor;
     }
 
     TensorPtr Tensor::sqrt(bool lazy, TensorPtr outTensor) {
         outTensor = initTensor(shape, true, outTensor);
-        auto op = new SqrtOp(getThis(), outTensor.get(), lazy);
+        auto op = new SqrtOp(toReal(lazy), outTensor.get(), lazy);
         realizeOp(op, lazy);
         return outTensor;
     }
 
     TensorPtr Tensor::neg(bool lazy, TensorPtr outTensor) {
         outTensor = initTensor(shape, true, outTensor);
-        auto op = new NegOp(getThis(), outTensor.get(), lazy);
+        auto op = new NegOp(toReal(lazy), outTensor.get(), lazy);
         realizeOp(op, lazy);
         return outTensor;
     }
 
-    TensorPtr Tensor::eq(Tensor &rhs, bool lazy, TensorPtr outTensor) {
+    TensorPtr Tensor::eq(Tensor &rhs, bool lazy, TensorPtr outTensor, DType dtype) {
         assert(Error::str_assert(rhs.isBroadcastableTo(shape),
             Error::Message::notBroadcastable(rhs.shape, shape)));
-        auto broadcastedRhs = rhs.broadcastTo(shape, lazy, nullptr);
-        outTensor = initTensor(shape, true, outTensor);
-        auto op = new EqOp(getThis(), broadcastedRhs, outTensor.get(), lazy);
+        auto broadcastedRhs = rhs.broadcastTo(shape, lazy, nullptr)->toReal(lazy);
+        outTensor = initMask(dtype, outTensor);
+        auto op = new EqOp(toReal(lazy), broadcastedRhs, outTensor.get(), lazy);
         realizeOp(op, lazy);
         return outTensor;
     }
@@ -432,12 +581,12 @@ namespace Toygrad::Tensor {
         return true;
     }
 
-    TensorPtr Tensor::neq(Tensor &rhs, bool lazy, TensorPtr outTensor) {
+    TensorPtr Tensor::neq(Tensor &rhs, bool lazy, TensorPtr outTensor, DType dtype) {
         assert(Error::str_assert(rhs.isBroadcastableTo(shape),
             Error::Message::notBroadcastable(rhs.shape, shape)));
-        auto broadcastedRhs = rhs.broadcastTo(shape, lazy, nullptr);
-        outTensor = initTensor(shape, true, outTensor);
-        auto op = new NeqOp(getThis(), broadcastedRhs, outTensor.get(), lazy);
+        auto broadcastedRhs = rhs.broadcastTo(shape, lazy, nullptr)->toReal(lazy);
+        outTensor = initMask(dtype, outTensor);
+        auto op = new NeqOp(toReal(lazy), broadcastedRhs, outTensor.get(), lazy);
         realizeOp(op, lazy);
         return outTensor;
     }
@@ -446,42 +595,42 @@ namespace Toygrad::Tensor {
         return !(*this == rhs);
     }
 
-    TensorPtr Tensor::lt(Tensor &rhs, bool lazy, TensorPtr outTensor) {
+    TensorPtr Tensor::lt(Tensor &rhs, bool lazy, TensorPtr outTensor, DType dtype) {
         assert(Error::str_assert(rhs.isBroadcastableTo(shape),
             Error::Message::notBroadcastable(rhs.shape, shape)));
-        auto broadcastedRhs = rhs.broadcastTo(shape, lazy, nullptr);
-        outTensor = initTensor(shape, true, outTensor);
-        auto op = new LessOp(getThis(), broadcastedRhs, outTensor.get(), lazy);
+        auto broadcastedRhs = rhs.broadcastTo(shape, lazy, nullptr)->toReal(lazy);
+        outTensor = initMask(dtype, outTensor);
+        auto op = new LessOp(toReal(lazy), broadcastedRhs, outTensor.get(), lazy);
         realizeOp(op, lazy);
         return outTensor;
     }
 
-    TensorPtr Tensor::gt(Tensor &rhs, bool lazy, TensorPtr outTensor) {
+    TensorPtr Tensor::gt(Tensor &rhs, bool lazy, TensorPtr outTensor, DType dtype) {
         assert(Error::str_assert(rhs.isBroadcastableTo(shape),
             Error::Message::notBroadcastable(rhs.shape, shape)));
-        auto broadcastedRhs = rhs.broadcastTo(shape, lazy, nullptr);
-        outTensor = initTensor(shape, true, outTensor);
-        auto op = new GreaterOp(getThis(), broadcastedRhs, outTensor.get(), lazy);
+        auto broadcastedRhs = rhs.broadcastTo(shape, lazy, nullptr)->toReal(lazy);
+        outTensor = initMask(dtype, outTensor);
+        auto op = new GreaterOp(toReal(lazy), broadcastedRhs, outTensor.get(), lazy);
         realizeOp(op, lazy);
         return outTensor;
     }
 
-    TensorPtr Tensor::leq(Tensor &rhs, bool lazy, TensorPtr outTensor) {
+    TensorPtr Tensor::leq(Tensor &rhs, bool lazy, TensorPtr outTensor, DType dtype) {
         assert(Error::str_assert(rhs.isBroadcastableTo(shape),
             Error::Message::notBroadcastable(rhs.shape, shape)));
-        auto broadcastedRhs = rhs.broadcastTo(shape, lazy, nullptr);
-        outTensor = initTensor(shape, true, outTensor);
-        auto op = new LeqOp(getThis(), broadcastedRhs, outTensor.get(), lazy);
+        auto broadcastedRhs = rhs.broadcastTo(shape, lazy, nullptr)->toReal(lazy);
+        outTensor = initMask(dtype, outTensor);
+        auto op = new LeqOp(toReal(lazy), broadcastedRhs, outTensor.get(), lazy);
         realizeOp(op, lazy);
         return outTensor;
     }
 
-    TensorPtr Tensor::geq(Tensor &rhs, bool lazy, TensorPtr outTensor) {
+    TensorPtr Tensor::geq(Tensor &rhs, bool lazy, TensorPtr outTensor, DType dtype) {
         assert(Error::str_assert(rhs.isBroadcastableTo(shape),
             Error::Message::notBroadcastable(rhs.shape, shape)));
-        auto broadcastedRhs = rhs.broadcastTo(shape, lazy, nullptr);
-        outTensor = initTensor(shape, true, outTensor);
-        auto op = new GeqOp(getThis(), broadcastedRhs, outTensor.get(), lazy);
+        auto broadcastedRhs = rhs.broadcastTo(shape, lazy, nullptr)->toReal(lazy);
+        outTensor = initMask(dtype, outTensor);
+        auto op = new GeqOp(toReal(lazy), broadcastedRhs, outTensor.get(), lazy);
         realizeOp(op, lazy);
         return outTensor;
     }
@@ -489,7 +638,7 @@ namespace Toygrad::Tensor {
     TensorPtr Tensor::addAssign(Tensor &rhs, bool lazy) {
         assert(Error::str_assert(rhs.isBroadcastableTo(shape),
             Error::Message::notBroadcastable(rhs.shape, shape)));
-        auto broadcastedRhs = rhs.broadcastTo(shape, lazy, nullptr);
+        auto broadcastedRhs = rhs.broadcastTo(shape, lazy, nullptr)->toReal(lazy);
         auto op = new AddAssignOp(broadcastedRhs, this, lazy);
         realizeOp(op, lazy);
         return getThis();
@@ -498,7 +647,7 @@ namespace Toygrad::Tensor {
     TensorPtr Tensor::subAssign(Tensor &rhs, bool lazy) {
         assert(Error::str_assert(rhs.isBroadcastableTo(shape),
             Error::Message::notBroadcastable(rhs.shape, shape)));
-        auto broadcastedRhs = rhs.broadcastTo(shape, lazy, nullptr);
+        auto broadcastedRhs = rhs.broadcastTo(shape, lazy, nullptr)->toReal(lazy);
         auto op = new SubAssignOp(broadcastedRhs, this, lazy);
         realizeOp(op, lazy);
         return getThis();
@@ -507,7 +656,7 @@ namespace Toygrad::Tensor {
     TensorPtr Tensor::mulAssign(Tensor &rhs, bool lazy) {
         assert(Error::str_assert(rhs.isBroadcastableTo(shape),
             Error::Message::notBroadcastable(rhs.shape, shape)));
-        auto broadcastedRhs = rhs.broadcastTo(shape, lazy, nullptr);
+        auto broadcastedRhs = rhs.broadcastTo(shape, lazy, nullptr)->toReal(lazy);
         auto op = new MulAssignOp(broadcastedRhs, this, lazy);
         realizeOp(op, lazy);
         return getThis();
@@ -516,7 +665,7 @@ namespace Toygrad::Tensor {
     TensorPtr Tensor::divAssign(Tensor &rhs, bool lazy) {
         assert(Error::str_assert(rhs.isBroadcastableTo(shape),
             Error::Message::notBroadcastable(rhs.shape, shape)));
-        auto broadcastedRhs = rhs.broadcastTo(shape, lazy, nullptr);
+        auto broadcastedRhs = rhs.broadcastTo(shape, lazy, nullptr)->toReal(lazy);
         auto op = new DivAssignOp(broadcastedRhs, this, lazy);
         realizeOp(op, lazy);
         return getThis();
@@ -524,14 +673,14 @@ namespace Toygrad::Tensor {
 
     TensorPtr Tensor::relu(bool lazy, TensorPtr outTensor) {
         outTensor = initTensor(shape, true, outTensor);
-        auto op = new ReluOp(getThis(), outTensor.get(), lazy);
+        auto op = new ReluOp(toReal(lazy), outTensor.get(), lazy);
         realizeOp(op, lazy);
         return outTensor;
     }
 
     TensorPtr Tensor::sigmoid(bool lazy, TensorPtr outTensor) {
         outTensor = initTensor(shape, true, outTensor);
-        auto op = new SigmoidOp(getThis(), outTensor.get(), lazy);
+        auto op = new SigmoidOp(toReal(lazy), outTensor.get(), lazy);
         realizeOp(op, lazy);
         return outTensor;
     }
@@ -572,32 +721,201 @@ namespace Toygrad::Tensor {
 
     TensorPtr Tensor::matmul(Tensor &rhs, bool lazy, TensorPtr outTensor) {
         const auto message = Error::Message::shapesMismatched("matmul", shape, rhs.shape);
-        assert(Error::str_assert(shape.getNumDims() == rhs.shape.getNumDims(), message));
-        assert(Error::str_assert(shape.getNumDims() >= 2, Error::Message::matmulOnLessThan2d));
-        assert(Error::str_assert(std::equal(shape.begin(), shape.end() - 2,
-            rhs.shape.begin(), rhs.shape.end() - 2), message));
-        size_t numDims = shape.getNumDims();
-        assert(Error::str_assert(shape[numDims - 1] == rhs.shape[numDims - 2], message));
-        Shape outShape = shape;
-        // Shape of ...x H1 x W1 matmul ...x W1 x H2 == ...x H1 x H2
-        outShape[numDims - 1] = rhs.shape[numDims - 1];
+        assert(Error::str_assert(shape.getNumDims() >= 2 && rhs.shape.getNumDims() >= 2,
+            Error::Message::matmulOnLessThan2d));
+        size_t lhsDims = shape.getNumDims();
+        size_t rhsDims = rhs.shape.getNumDims();
+        size_t numDims = std::max(lhsDims, rhsDims);
+        assert(Error::str_assert(shape[lhsDims - 1] == rhs.shape[rhsDims - 2], message));
+        // Shape of ...x H1 x W1 matmul ...x W1 x H2 == ...x H1 x H2, the batch dimensions are broadcast against each
+        // other aligned from the last one
+        Dims outView(numDims);
+
+        for (size_t i = 0; i < numDims - 2; i++) {
+            size_t lhsDim = i + lhsDims >= numDims ? shape[i + lhsDims - numDims] : 1;
+            size_t rhsDim = i + rhsDims >= numDims ? rhs.shape[i + rhsDims - numDims] : 1;
+            assert(Error::str_assert(lhsDim == rhsDim || lhsDim == 1 || rhsDim == 1, message));
+            outView[i] = std::max(lhsDim, rhsDim);
+        }
+
+        outView[numDims - 2] = shape[lhsDims - 2];
+        outView[numDims - 1] = rhs.shape[rhsDims - 1];
         // Permutes rhs's last two dimensions
-        auto tranposedRhs = rhs.T(numDims - 2, lazy);
+        auto tranposedRhs = rhs.T(rhsDims - 2, lazy);
         // Do matrix multiplication on the last 2 dimensions
-        outTensor = initTensor(outShape, true, outTensor);
+        outTensor = initTensor(Shape(outView), true, outTensor);
         auto op = new MatmulOp(getThis(), tranposedRhs, outTensor.get(), lazy);
         realizeOp(op, lazy);
         return outTensor;
     }
 
+    TensorPtr Tensor::linear(const TensorPtr &weight, const TensorPtr &bias, Activation activation, bool lazy,
+                             TensorPtr outTensor) {
+        const Shape &weightShape = weight->shape;
+        size_t numDims = shape.getNumDims();
+        assert(Error::str_assert(numDims >= 2 && weightShape.getNumDims() == 2 && shape[numDims - 1] == weightShape[0],
+            Error::Message::shapesMismatched("linear", shape, weightShape)));
+        assert(Error::str_assert(bias->shape == Shape({weightShape[1]}),
+            Error::Message::shapesMismatched("linear", bias->shape, weightShape)));
+        // The leading dimensions are folded into the rows of one product
+        assert(Error::str_assert(canReshapeWithoutCopy({getNumel() / shape[numDims - 1], shape[numDims - 1]}),
+            Error::Message::shapesMismatched("linear", shape, weightShape)));
+        Dims outView = shape.getView();
+        outView[numDims - 1] = weightShape[1];
+        outTensor = initTensor(Shape(outView), true, outTensor);
+        // The weight is read as output features x input features like the right operand of matmul
+        auto transposedWeight = weight->T(0, lazy);
+        auto op = new FusedLinearOp({getThis(), transposedWeight, bias}, outTensor.get(), activation, lazy);
+        realizeOp(op, lazy);
+        return outTensor;
+    }
+
+    TensorPtr Tensor::matmulInt8(const std::shared_ptr<const Int8Matrix> &weights, const TensorPtr &bias, bool lazy,
+                                 TensorPtr outTensor) {
+        Shape weightShape({weights->rows, weights->cols});
+        size_t numDims = shape.getNumDims();
+        assert(Error::str_assert(numDims >= 2 && shape[numDims - 1] == weights->cols,
+            Error::Message::shapesMismatched("int8 matmul", shape, weightShape)));
+        assert(Error::str_assert(bias->shape == Shape({weights->rows}),
+            Error::Message::shapesMismatched("int8 matmul", bias->shape, weightShape)));
+        // The leading dimensions are folded into the rows of one product
+        Dims outView = shape.getView();
+        outView[numDims - 1] = weights->rows;
+        outTensor = initTensor(Shape(outView), true, outTensor);
+        auto op = new Int8MatmulOp(getThis(), bias, weights, outTensor.get(), lazy);
+        realizeOp(op, lazy);
+        return outTensor;
+    }
+
+    TensorPtr Tensor::matmulInt4(const std::shared_ptr<const Int4Matrix> &weights, const TensorPtr &bias, bool lazy,
+                                 TensorPtr outTensor) {
+        Shape weightShape({weights->rows, weights->cols});
+        size_t numDims = shape.getNumDims();
+        assert(Error::str_assert(numDims >= 2 && shape[numDims - 1] == weights->cols,
+            Error::Message::shapesMismatched("int4 matmul", shape, weightShape)));
+        assert(Error::str_assert(bias->shape == Shape({weights->rows}),
+            Error::Message::shapesMismatched("int4 matmul", bias->shape, weightShape)));
+        // The leading dimensions are folded into the rows of one product
+        Dims outView = shape.getView();
+        outView[numDims - 1] = weights->rows;
+        outTensor = initTensor(Shape(outView), true, outTensor);
+        auto op = new Int4MatmulOp(getThis(), bias, weights, outTensor.get(), lazy);
+        realizeOp(op, lazy);
+        return outTensor;
+    }
+
+    // Sets the batch size, the channels and the height and width of a convolution or pooling from the shape of its
+    // images, signals have a height of 1 and weights are read as a batch of output channels
+    static void setInputSizes(ConvShape &conv, const Shape &shape, size_t numSpatialDims) {
+        bool channelsLast = conv.layout == Layout::CHANNELS_LAST;
+        conv.batchSize = shape[0];
+        conv.inChannels = shape[channelsLast ? numSpatialDims + 1 : 1];
+        conv.inHeight = numSpatialDims == 2 ? shape[channelsLast ? 1 : 2] : 1;
+        conv.inWidth = shape[channelsLast ? numSpatialDims : numSpatialDims + 1];
+    }
+
+    // Sets the stride, the padding and the output height and width of a convolution or pooling, signals are only
+    // strided and padded along their length
+    static bool setWindow(ConvShape &conv, size_t numSpatialDims, size_t stride, size_t padding) {
+        conv.strideHeight = numSpatialDims == 2 ? stride : 1;
+        conv.strideWidth = stride;
+        conv.padHeight = numSpatialDims == 2 ? padding : 0;
+        conv.padWidth = padding;
+
+        if (stride == 0 || conv.inHeight + 2 * conv.padHeight < conv.kernelHeight ||
+            conv.inWidth + 2 * conv.padWidth < conv.kernelWidth) {
+            return false;
+        }
+
+        conv.outHeight = (conv.inHeight + 2 * conv.padHeight - conv.kernelHeight) / conv.strideHeight + 1;
+        conv.outWidth = (conv.inWidth + 2 * conv.padWidth - conv.kernelWidth) / conv.strideWidth + 1;
+        return true;
+    }
+
+    // Shape of the outputs of a convolution or pooling in the layout of its images
+    static Shape getOutShape(const ConvShape &conv, size_t numSpatialDims) {
+        std::vector<size_t> view = {conv.batchSize};
+
+        if (conv.layout == Layout::CHANNELS_FIRST) {
+            view.push_back(conv.outChannels);
+        }
+
+        if (numSpatialDims == 2) {
+            view.push_back(conv.outHeight);
+        }
+
+        view.push_back(conv.outWidth);
+
+        if (conv.layout == Layout::CHANNELS_LAST) {
+            view.push_back(conv.outChannels);
+        }
+
+        return Shape(view);
+    }
+
+    TensorPtr Tensor::conv(const TensorPtr &weight, const TensorPtr &bias, size_t numSpatialDims, size_t stride,
+                           size_t padding, Layout layout, bool lazy, TensorPtr outTensor) {
+        const Shape &weightShape = weight->shape;
+        assert(Error::str_assert(shape.getNumDims() == numSpatialDims + 2 &&
+            weightShape.getNumDims() == numSpatialDims + 2,
+            Error::Message::shapesMismatched("conv", shape, weightShape)));
+        ConvShape conv{};
+        conv.layout = layout;
+        setInputSizes(conv, shape, numSpatialDims);
+        ConvShape kernel{};
+        kernel.layout = layout;
+        setInputSizes(kernel, weightShape, numSpatialDims);
+        assert(Error::str_assert(kernel.inChannels == conv.inChannels,
+            Error::Message::shapesMismatched("conv", shape, weightShape)));
+        conv.outChannels = kernel.batchSize;
+        conv.kernelHeight = kernel.inHeight;
+        conv.kernelWidth = kernel.inWidth;
+        [[maybe_unused]] bool validWindow = setWindow(conv, numSpatialDims, stride, padding);
+        assert(Error::str_assert(validWindow, Error::Message::invalidWindow(shape, conv.kernelWidth, stride, padding)));
+        assert(Error::str_assert(bias == nullptr || bias->shape == Shape({conv.outChannels}),
+            Error::Message::shapesMismatched("conv", bias == nullptr ? weightShape : bias->shape, weightShape)));
+        outTensor = initTensor(getOutShape(conv, numSpatialDims), true, outTensor);
+        std::vector<TensorPtr> operands = {getThis(), weight};
+
+        if (bias != nullptr) {
+            operands.push_back(bias);
+        }
+
+        auto op = new ConvOp(operands, outTensor.get(), conv, lazy);
+        realizeOp(op, lazy);
+        return outTensor;
+    }
+
+    TensorPtr Tensor::pool(Pooling pooling, size_t numSpatialDims, size_t kernelSize, size_t stride, size_t padding,
+                           Layout layout, bool lazy, TensorPtr outTensor) {
+        assert(Error::str_assert(shape.getNumDims() == numSpatialDims + 2,
+            Error::Message::invalidWindow(shape, kernelSize, stride, padding)));
+        ConvShape pool{};
+        pool.layout = layout;
+        setInputSizes(pool, shape, numSpatialDims);
+        pool.outChannels = pool.inChannels;
+        pool.kernelHeight = numSpatialDims == 2 ? kernelSize : 1;
+        pool.kernelWidth = kernelSize;
+        [[maybe_unused]] bool validWindow = setWindow(pool, numSpatialDims, stride, padding);
+        // Every window holds at least one element when the padding is smaller than the window
+        assert(Error::str_assert(validWindow && padding < kernelSize,
+            Error::Message::invalidWindow(shape, kernelSize, stride, padding)));
+        outTensor = initTensor(getOutShape(pool, numSpatialDims), true, outTensor);
+        auto op = new PoolOp(getThis(), outTensor.get(), pool, pooling, lazy);
+        realizeOp(op, lazy);
+        return outTensor;
+    }
+
     TensorPtr Tensor::reshape(const Shape &target, bool lazy, TensorPtr outTensor) {
         assert(Error::str_assert(target.getSize() == shape.getSize(),
             Error::Message::shapesMismatched("matmul", shape, target)));
 
-        if (isContiguous()) {
-            outTensor = initTensor(target, false, outTensor);
-            outTensor->shape.offset = shape.offset;
-            auto op = new AliasOp(getThis(), outTensor.get(), lazy);
+        Dims strides;
+
+        if (shape.getViewStrides(target.getView(), strides)) {
+            // The target can be expressed with new strides over the same memory
+            outTensor = initTensor(Shape(shape.offset, target.getView(), strides), false, outTensor);
+            auto op = new ReshapeOp(getThis(), outTensor.get(), lazy);
             realizeOp(op, lazy);
         } else {
             outTensor = initTensor(target, true, outTensor);
@@ -608,17 +926,22 @@ namespace Toygrad::Tensor {
         return outTensor;
     }
 
+    bool Tensor::canReshapeWithoutCopy(const Shape &target) const {
+        Dims strides;
+        return shape.getViewStrides(target.getView(), strides);
+    }
+
     TensorPtr Tensor::sum(int64_t dim, bool lazy, TensorPtr outTensor) {
         assert(Error::str_assert(isDimValid(dim), Error::Message::invalidDim(dim, shape)));
 
         if (dim == -1) {
             outTensor = initTensor(Shape({1}), true, outTensor);
-            auto op = new SumOp(getThis(), outTensor.get(), dim, lazy);
+            auto op = new SumOp(toReal(lazy), outTensor.get(), dim, lazy);
             realizeOp(op, lazy);
         } else {
             Shape outShape = shape;
             // Remove the dimension in which the sum is computed in from the output shape
-            outShape.view.erase(outShape.view.begin() + dim);
+            outShape.remove(dim);
             // Move the dimension in which the sum is computed in to the back of the input shape
             std::vector<size_t> shapePerm(shape.getNumDims());
             std::iota(shapePerm.begin(), shapePerm.end(), 0);
@@ -627,7 +950,7 @@ namespace Toygrad::Tensor {
             // Compute sum
             auto permTensor = perm(shapePerm, lazy, nullptr);
             outTensor = initTensor(outShape, true, outTensor);
-            auto op = new SumOp(permTensor, outTensor.get(), dim, lazy);
+            auto op = new SumOp(permTensor->toReal(lazy), outTensor.get(), dim, lazy);
             realizeOp(op, lazy);
         }
 
@@ -639,12 +962,12 @@ namespace Toygrad::Tensor {
 
         if (dim == -1) {
             outTensor = initTensor(Shape({1}), true, outTensor);
-            auto op = new MaxOp(getThis(), outTensor.get(), dim, lazy);
+            auto op = new MaxOp(toReal(lazy), outTensor.get(), dim, lazy);
             realizeOp(op, lazy);
         } else {
             Shape outShape = shape;
             // Remove the dimension in which the max is computed in from the output shape
-            outShape.view.erase(outShape.view.begin() + dim);
+            outShape.remove(dim);
             // Move the dimension in which the max is computed in to the back of the input shape
             std::vector<size_t> shapePerm(shape.getNumDims());
             std::iota(shapePerm.begin(), shapePerm.end(), 0);
@@ -653,7 +976,7 @@ namespace Toygrad::Tensor {
             // Compute max
             auto permTensor = perm(shapePerm, lazy, nullptr);
             outTensor = initTensor(outShape, true, outTensor);
-            auto op = new MaxOp(permTensor, outTensor.get(), dim, lazy);
+            auto op = new MaxOp(permTensor->toReal(lazy), outTensor.get(), dim, lazy);
             realizeOp(op, lazy);
         }
 
@@ -665,12 +988,12 @@ namespace Toygrad::Tensor {
 
         if (dim == -1) {
             outTensor = initTensor(Shape({1}), true, outTensor);
-            auto op = new MinOp(getThis(), outTensor.get(), dim, lazy);
+            auto op = new MinOp(toReal(lazy), outTensor.get(), dim, lazy);
             realizeOp(op, lazy);
         } else {
             Shape outShape = shape;
             // Remove the dimension in which the min is computed in from the output shape
-            outShape.view.erase(outShape.view.begin() + dim);
+            outShape.remove(dim);
             // Move the dimension in which the min is computed in to the back of the input shape
             std::vector<size_t> shapePerm(shape.getNumDims());
             std::iota(shapePerm.begin(), shapePerm.end(), 0);
@@ -679,7 +1002,7 @@ namespace Toygrad::Tensor {
             // Compute min
             auto permTensor = perm(shapePerm, lazy, nullptr);
             outTensor = initTensor(outShape, true, outTensor);
-            auto op = new MinOp(permTensor, outTensor.get(), dim, lazy);
+            auto op = new MinOp(permTensor->toReal(lazy), outTensor.get(), dim, lazy);
             realizeOp(op, lazy);
         }
 
@@ -722,9 +1045,7 @@ namespace Toygrad::Tensor {
     }
 
     bool Tensor::isEmpty() const {
-        IterPtr iter = initConstIter(this);
-        iter->start();
-        return !iter->hasNext();
+        return getNumel() == 0;
     }
 
     void Tensor::forward() {
@@ -739,4 +1060,12 @@ namespace Toygrad::Tensor {
         assert(Error::str_assert(graph != nullptr, Error::Message::tensorGraphUninitialized));
         graph->backward();
     }
+
+    void Tensor::setMemoryBudget(size_t budget) {
+        if (graph == nullptr) {
+            graph = new TensorGraph(this);
+        }
+
+        graph->setMemoryBudget(budget);
+    }
 }
@@ -2,12 +2,20 @@
 
 #include "shape.h"
 #include "vec.h"
+#include "grad_mode.h"
 #include "assert/str_assert.h"
 
 namespace Toygrad::Tensor {
     class Tensor final : public std::enable_shared_from_this<Tensor> {
         Shape shape;
+        // Iteration plan: the shape with size-1 dimensions dropped and adjacent dimensions merged wherever the outer
+        // stride is the inner stride times the inner size, so strided iteration carries over as few dimensions as
+        // possible
+        Dims iterView;
+        Dims iterStrides;
         std::shared_ptr<Vec> vec = nullptr;
+        // Type of the elements, ops that read elements through iterators only support float32
+        DType dtype = DType::FLOAT32;
         static size_t idCounter;
         size_t id{};
         std::vector<Op *> ops = std::vector<Op *>();
@@ -15,14 +23,34 @@ namespace Toygrad::Tensor {
         std::vector<Tensor *> edges = std::vector<Tensor *>();
         // TensorGraph is incomplete so raw pointer is used
         TensorGraph *graph = nullptr;
+        // Incremented whenever the tensor's values are recomputed or modified
+        size_t version = 0;
+        // Sum of the operands' versions when the tensor was last computed
+        size_t operandVersion = 0;
+        // Whether the tensor's ops must be rerun in the next forward pass regardless of its operands
+        bool dirty = true;
+        // Whether gradients flow into the tensor, set on parameters and propagated to the tensors computed from them
+        bool requiresGrad = false;
+        // Whether the tensor's values are discarded after forward propagation and recomputed when needed
+        bool checkpoint = false;
+        // Tensor whose memory holds the tensor's values when the tensor is computed directly into a slice of it, e.g.
+        // an operand of cat
+        std::weak_ptr<Tensor> base;
+        // Copy of the values laid out for matrix multiplication, kept on parameters that are the right operand of
+        // matmul so they are packed once rather than on every forward pass
+        std::shared_ptr<CachedValues> packed;
+        // Weights transformed for Winograd convolutions, kept on parameters so they are transformed once per change
+        std::shared_ptr<CachedValues> winograd;
 
         friend class NN::Module;
         friend class TensorGraph;
+        friend class TensorPlan;
         friend class TensorDraw;
         friend struct Op;
         friend struct LeafOp;
         friend struct UnOp;
         friend struct BinOp;
+        friend struct MultiOp;
         friend struct ConstOp;
         friend struct IndexOp;
         friend struct ArangeOp;
@@ -49,6 +77,7 @@ namespace Toygrad::Tensor {
         friend struct SqrtOp;
         friend struct AliasOp;
         friend struct DiffAliasOp;
+        friend struct ReshapeOp;
         friend struct EqOp;
         friend struct NeqOp;
         friend struct LessOp;
@@ -62,7 +91,15 @@ namespace Toygrad::Tensor {
         friend struct SigmoidOp;
         friend struct SoftmaxOp;
         friend struct CopyOp;
+        friend struct CatOp;
+        friend struct CastOp;
+        friend struct WhereOp;
         friend struct MatmulOp;
+        friend struct Int8MatmulOp;
+        friend struct Int4MatmulOp;
+        friend struct FusedLinearOp;
+        friend struct ConvOp;
+        friend struct PoolOp;
 
         Tensor();
 
@@ -85,13 +122,40 @@ namespace Toygrad::Tensor {
             return std::make_shared<Tensor>(shape, initStrides);
         }
 
+        // Arithmetic ops, comparisons and reductions compute in float32 and read other data types converted to it,
+        // except float64 which would silently lose precision and must be converted explicitly
+        TensorPtr toReal(bool lazy) {
+            assert(Error::str_assert(dtype != DType::FLOAT64, Error::Message::dtypeUnsupported(dtype)));
+            return to(DType::FLOAT32, lazy);
+        }
+
+        // Output of a comparison, which holds a float, a byte or a bit per element depending on the data type
+        TensorPtr initMask(DType dtype, TensorPtr outTensor) const {
+            assert(Error::str_assert(dtype == DType::FLOAT32 || dtype == DType::BOOL || dtype == DType::BITMASK,
+                Error::Message::dtypeUnsupported(dtype)));
+            outTensor = initTensor(shape, true, std::move(outTensor));
+            [[maybe_unused]] DType vecType = outTensor->vec == nullptr ? dtype : outTensor->vec->dtype;
+            assert(Error::str_assert(vecType == dtype, Error::Message::dtypesMismatched("comparison", vecType, dtype)));
+            outTensor->dtype = dtype;
+            return outTensor;
+        }
+
         TensorPtr index(const std::vector<size_t> &indices, bool lazy = true, TensorPtr outTensor = nullptr);
 
         TensorPtr index(const std::vector<Range> &ranges, bool lazy = true, TensorPtr outTensor = nullptr);
 
         void initVec() {
             if (vec == nullptr) {
-                vec = std::make_shared<Vec>(shape.getSize());
+                if (auto owner = base.lock(); owner != nullptr) {
+                    owner->initVec();
+                    vec = owner->vec;
+                    return;
+                }
+
+                // A slice has no memory of its own to fall back on once the tensor owning its memory is gone
+                assert(Error::str_assert(!base.owner_before(std::weak_ptr<Tensor>()) &&
+                    !std::weak_ptr<Tensor>().owner_before(base), Error::Message::sliceOwnerExpired));
+                vec = std::make_shared<Vec>(shape.getSize(), dtype);
             }
         }
 
@@ -103,24 +167,47 @@ namespace Toygrad::Tensor {
 
         void initGrad() {
             if (grad == nullptr) {
-                grad = initTensor(shape, false, nullptr);
+                // A slice of another tensor's memory gets a gradient with its own row-major layout
+                grad = initTensor(shape, !base.expired(), nullptr);
                 grad->initVec();
             }
         }
 
         void initGrad(real c) {
             if (grad == nullptr) {
-                grad = initTensor(shape, false, nullptr);
+                grad = initTensor(shape, !base.expired(), nullptr);
                 grad->initVec(c);
             }
         }
 
+        // Records a write to the tensor's values, the memory's own version also changes so that values cached from it,
+        // e.g. packed weights, are recomputed after a write through a view
+        void bumpVersion() {
+            version++;
+
+            if (vec != nullptr) {
+                vec->version++;
+            }
+        }
+
+        /**
+         * Sets the shape of the tensor and recomputes the metadata derived from it.
+         * @param shape the new shape.
+         */
+        void setShape(const Shape &shape);
+
         bool isDimValid(int64_t dim) const { return dim >= -1 && dim < static_cast<int>(shape.getNumDims()); }
 
         TensorPtr perm(const Shape &target, bool lazy = true, TensorPtr outTensor = nullptr);
 
         TensorPtr alias(const Shape &target, bool lazy = true, TensorPtr outTensor = nullptr);
 
+        TensorPtr conv(const TensorPtr &weight, const TensorPtr &bias, size_t numSpatialDims, size_t stride,
+                       size_t padding, Layout layout, bool lazy, TensorPtr outTensor);
+
+        TensorPtr pool(Pooling pooling, size_t numSpatialDims, size_t kernelSize, size_t stride, size_t padding,
+                       Layout layout, bool lazy, TensorPtr outTensor);
+
     public:
         explicit Tensor(const Shape &shape, bool initStrides = true);
 
@@ -146,6 +233,58 @@ namespace Toygrad::Tensor {
          */
         TensorPtr getGrad() const { return grad; }
 
+        /**
+         * Gets the version of the tensor, which is incremented whenever the tensor's values change.
+         * @return the tensor's version.
+         */
+        size_t getVersion() const { return version; }
+
+        /**
+         * Marks the tensor as modified so that its ops, including leaf ops such as randn, are rerun in the next
+         * forward propagation along with every tensor that depends on it.
+         */
+        void markDirty() { dirty = true; }
+
+        /**
+         * Marks the tensor's values as written in place, e.g. through a numpy view of its memory, so that every tensor
+         * that depends on it and every copy cached from its memory, such as packed weights, is recomputed in the next
+         * forward propagation. Unlike markDirty, the tensor's own ops are not rerun so the written values are kept.
+         */
+        void markModified() { bumpVersion(); }
+
+        /**
+         * Checks whether backward propagation computes a gradient for the tensor.
+         * @return true if the tensor requires a gradient and false otherwise.
+         */
+        bool getRequiresGrad() const { return requiresGrad; }
+
+        /**
+         * Sets whether backward propagation computes a gradient for the tensor. The flag is propagated when ops are
+         * built so it must be set before the tensor is used in any computation.
+         * @param requiresGrad whether the tensor requires a gradient.
+         */
+        void setRequiresGrad(bool requiresGrad) { this->requiresGrad = requiresGrad; }
+
+        /**
+         * Checks whether the tensor is checkpointed.
+         * @return true if the tensor is checkpointed and false otherwise.
+         */
+        bool isCheckpoint() const { return checkpoint; }
+
+        /**
+         * Sets whether the tensor is checkpointed. A checkpointed intermediate tensor releases its memory once its
+         * consumers have run in forward propagation and is recomputed from its operands when backward propagation
+         * needs it. Tensors referenced outside the graph always keep their values.
+         * @param checkpoint whether the tensor is checkpointed.
+         */
+        void setCheckpoint(bool checkpoint) { this->checkpoint = checkpoint; }
+
+        /**
+         * Gets the type of the tensor's elements.
+         * @return the data type.
+         */
+        DType getDType() const { return dtype; }
+
         /**
          * Gets a pointer to the underlying memory.
          * @return a pointer to the underlying memory.
@@ -158,6 +297,24 @@ namespace Toygrad::Tensor {
          */
         bool isContiguous() const;
 
+        /**
+         * Gets the number of elements in the tensor.
+         * @return the number of elements.
+         */
+        size_t getNumel() const { return shape.getSize(); }
+
+        /**
+         * Gets the dimension sizes used to iterate over the tensor, with mergeable dimensions merged.
+         * @return the dimension sizes of the iteration plan.
+         */
+        const Dims &getIterView() const { return iterView; }
+
+        /**
+         * Gets the strides used to iterate over the tensor, with mergeable dimensions merged.
+         * @return the strides of the iteration plan.
+         */
+        const Dims &getIterStrides() const { return iterStrides; }
+
         /**
          * Checks if the tensor is broadcastable to a given shape.
          * @param target the target shape to be broadcasted to.
@@ -220,6 +377,25 @@ namespace Toygrad::Tensor {
          */
         TensorPtr copy(bool lazy = true, TensorPtr outTensor = nullptr);
 
+        /**
+         * Converts the tensor's elements to another data type, e.g. float64 for precision-sensitive accumulations or
+         * int64 for indices and labels. Gradients flow through conversions between floating point types.
+         * @param dtype the target data type.
+         * @param lazy whether the operation is executed lazily.
+         * @param outTensor the output tensor.
+         * @return the tensor itself if it already has the data type and a converted copy otherwise.
+         */
+        TensorPtr to(DType dtype, bool lazy = true, TensorPtr outTensor = nullptr);
+
+        /**
+         * Gets the tensor with its elements laid out contiguously in memory. A contiguous tensor is returned as is,
+         * otherwise its elements are copied into a new contiguous tensor, e.g. after a transpose.
+         * @param lazy whether the operation is executed lazily.
+         * @param outTensor the output tensor.
+         * @return a contiguous tensor with the same elements.
+         */
+        TensorPtr contiguous(bool lazy = true, TensorPtr outTensor = nullptr);
+
         /**
          * Squeezes the tensor in a given dimension.
          * @param dim the dimension to squeeze the tensor.
@@ -502,6 +678,71 @@ namespace Toygrad::Tensor {
             return fromVec(Shape(view), data, lazy, std::move(outTensor));
         }
 
+        /**
+         * Constructs a realized tensor that views a buffer in place, e.g. one borrowed from a numpy array, so writes
+         * through either are seen by the other. The tensor takes the type of the buffer's elements.
+         * @param vec the buffer.
+         * @param shape the offset, view and strides of the tensor's elements within the buffer.
+         * @return a new tensor sharing the buffer.
+         */
+        static TensorPtr fromBuffer(const std::shared_ptr<Vec> &vec, const Shape &shape);
+
+        /**
+         * Concatenates tensors along an existing dimension. The output is allocated once and, when the graph is
+         * forwarded, intermediate tensors computed only for the concatenation write their values directly into
+         * their slice of the output. Gradients of the tensors are views of the output's gradient.
+         * @param tensors the tensors, which must have the same shape except in the given dimension.
+         * @param dim the dimension to concatenate along.
+         * @param lazy whether the operation is executed lazily.
+         * @param outTensor the output tensor.
+         * @return the result tensor.
+         */
+        static TensorPtr cat(const std::vector<TensorPtr> &tensors, size_t dim, bool lazy = true,
+                             TensorPtr outTensor = nullptr);
+
+        /**
+         * Stacks tensors of the same shape along a new dimension, e.g. samples into a batch. Memory is shared the
+         * same way as for cat.
+         * @param tensors the tensors, which must have the same shape.
+         * @param dim the index of the new dimension in the result.
+         * @param lazy whether the operation is executed lazily.
+         * @param outTensor the output tensor.
+         * @return the result tensor.
+         */
+        static TensorPtr stack(const std::vector<TensorPtr> &tensors, size_t dim, bool lazy = true,
+                               TensorPtr outTensor = nullptr);
+
+        /**
+         * Selects elements from two tensors according to a mask, i.e. mask ? x : y elementwise. The mask is read in
+         * its own type so the bool and bitmask results of comparisons are consumed without conversion.
+         * @param mask the mask, which is broadcast to the shape of x.
+         * @param x the tensor whose elements are selected where the mask is set.
+         * @param y the tensor whose elements are selected elsewhere, which is broadcast to the shape of x.
+         * @param lazy whether the operation is executed lazily.
+         * @param outTensor the output tensor.
+         * @return the result tensor.
+         */
+        static TensorPtr where(const TensorPtr &mask, const TensorPtr &x, const TensorPtr &y, bool lazy = true,
+                               TensorPtr outTensor = nullptr);
+
+        /**
+         * Gathers the elements where the mask is set into a 1D tensor. The size of the result depends on the values
+         * of the mask so the selection is executed eagerly on tensors that have been forwarded and is not
+         * differentiable.
+         * @param mask the mask of the same shape as the tensor, of any type.
+         * @return the selected elements in row-major order.
+         */
+        TensorPtr maskedSelect(const Tensor &mask) const;
+
+        /**
+         * Gathers the elements where the mask is set into a 1D tensor.
+         * @param mask the mask of the same shape as the tensor, of any type.
+         * @return the selected elements in row-major order.
+         */
+        TensorPtr maskedSelect(const TensorPtr &mask) const {
+            return maskedSelect(*mask);
+        }
+
         friend std::ostream &operator<<(std::ostream &stream, const Tensor &tensor);
 
         TensorPtr operator[](size_t idx);
@@ -708,10 +949,12 @@ namespace Toygrad::Tensor {
          * @param rhs the right tensor.
          * @param lazy whether the operation is executed lazily.
          * @param outTensor the output tensor.
+         * @param dtype the type of the result, FLOAT32, BOOL or BITMASK.
          * @return the result tensor.
          */
-        TensorPtr eq(const TensorPtr &rhs, bool lazy = true, TensorPtr outTensor = nullptr) {
-            return eq(*rhs, lazy, std::move(outTensor));
+        TensorPtr eq(const TensorPtr &rhs, bool lazy = true, TensorPtr outTensor = nullptr,
+                     DType dtype = DType::FLOAT32) {
+            return eq(*rhs, lazy, std::move(outTensor), dtype);
         }
 
         /**
@@ -719,19 +962,21 @@ namespace Toygrad::Tensor {
          * @param rhs the right tensor.
          * @param lazy whether the operation is executed lazily.
          * @param outTensor the output tensor.
+         * @param dtype the type of the result, FLOAT32, BOOL or BITMASK.
          * @return the result tensor.
          */
-        TensorPtr eq(Tensor &rhs, bool lazy = true, TensorPtr outTensor = nullptr);
+        TensorPtr eq(Tensor &rhs, bool lazy = true, TensorPtr outTensor = nullptr, DType dtype = DType::FLOAT32);
 
         /**
          * Checks if each element in the tensor is equal to a constant.
          * @param c the constant to be compared.
          * @param lazy whether the operation is executed lazily.
          * @param outTensor the output tensor.
+         * @param dtype the type of the result, FLOAT32, BOOL or BITMASK.
          * @return the result tensor.
          */
-        TensorPtr eq(real c, bool lazy = true, TensorPtr outTensor = nullptr) {
-            return eq(fromConst(shape, c, lazy, nullptr), lazy, std::move(outTensor));
+        TensorPtr eq(real c, bool lazy = true, TensorPtr outTensor = nullptr, DType dtype = DType::FLOAT32) {
+            return eq(fromConst(shape, c, lazy, nullptr), lazy, std::move(outTensor), dtype);
         }
 
         /**
@@ -746,10 +991,12 @@ namespace Toygrad::Tensor {
          * @param rhs the right tensor.
          * @param lazy whether the operation is executed lazily.
          * @param outTensor the output tensor.
+         * @param dtype the type of the result, FLOAT32, BOOL or BITMASK.
          * @return the result tensor.
          */
-        TensorPtr neq(const TensorPtr &rhs, bool lazy = true, TensorPtr outTensor = nullptr) {
-            return neq(*rhs, lazy, std::move(outTensor));
+        TensorPtr neq(const TensorPtr &rhs, bool lazy = true, TensorPtr outTensor = nullptr,
+                      DType dtype = DType::FLOAT32) {
+            return neq(*rhs, lazy, std::move(outTensor), dtype);
         }
 
         /**
@@ -757,19 +1004,21 @@ namespace Toygrad::Tensor {
          * @param rhs the right tensor.
          * @param lazy whether the operation is executed lazily.
          * @param outTensor the output tensor.
+         * @param dtype the type of the result, FLOAT32, BOOL or BITMASK.
          * @return the result tensor.
          */
-        TensorPtr neq(Tensor &rhs, bool lazy = true, TensorPtr outTensor = nullptr);
+        TensorPtr neq(Tensor &rhs, bool lazy = true, TensorPtr outTensor = nullptr, DType dtype = DType::FLOAT32);
 
         /**
          * Checks if each element in the tensor is not equal to a constant.
          * @param c the constant to be compared.
          * @param lazy whether the operation is executed lazily.
          * @param outTensor the output tensor.
+         * @param dtype the type of the result, FLOAT32, BOOL or BITMASK.
          * @return the result tensor.
          */
-        TensorPtr neq(real c, bool lazy = true, TensorPtr outTensor = nullptr) {
-            return neq(fromConst(shape, c, lazy, nullptr), lazy, std::move(outTensor));
+        TensorPtr neq(real c, bool lazy = true, TensorPtr outTensor = nullptr, DType dtype = DType::FLOAT32) {
+            return neq(fromConst(shape, c, lazy, nullptr), lazy, std::move(outTensor), dtype);
         }
 
         /**
@@ -784,10 +1033,12 @@ namespace Toygrad::Tensor {
          * @param rhs the right tensor.
          * @param lazy whether the operation is executed lazily.
          * @param outTensor the output tensor.
+         * @param dtype the type of the result, FLOAT32, BOOL or BITMASK.
          * @return the result tensor.
          */
-        TensorPtr lt(const TensorPtr &rhs, bool lazy = true, TensorPtr outTensor = nullptr) {
-            return lt(*rhs, lazy, std::move(outTensor));
+        TensorPtr lt(const TensorPtr &rhs, bool lazy = true, TensorPtr outTensor = nullptr,
+                     DType dtype = DType::FLOAT32) {
+            return lt(*rhs, lazy, std::move(outTensor), dtype);
         }
 
         /**
@@ -795,19 +1046,21 @@ namespace Toygrad::Tensor {
          * @param rhs the right tensor.
          * @param lazy whether the operation is executed lazily.
          * @param outTensor the output tensor.
+         * @param dtype the type of the result, FLOAT32, BOOL or BITMASK.
          * @return the result tensor.
          */
-        TensorPtr lt(Tensor &rhs, bool lazy = true, TensorPtr outTensor = nullptr);
+        TensorPtr lt(Tensor &rhs, bool lazy = true, TensorPtr outTensor = nullptr, DType dtype = DType::FLOAT32);
 
         /**
          * Checks if each element of the tensor is less than a constant.
          * @param c the constant to be compared.
          * @param lazy whether the operation is executed lazily.
          * @param outTensor the output tensor.
+         * @param dtype the type of the result, FLOAT32, BOOL or BITMASK.
          * @return the result tensor.
          */
-        TensorPtr lt(real c, bool lazy = true, TensorPtr outTensor = nullptr) {
-            return lt(fromConst(shape, c, lazy, nullptr), lazy, std::move(outTensor));
+        TensorPtr lt(real c, bool lazy = true, TensorPtr outTensor = nullptr, DType dtype = DType::FLOAT32) {
+            return lt(fromConst(shape, c, lazy, nullptr), lazy, std::move(outTensor), dtype);
         }
 
         /**
@@ -815,10 +1068,12 @@ namespace Toygrad::Tensor {
          * @param rhs the right tensor.
          * @param lazy whether the operation is executed lazily.
          * @param outTensor the output tensor.
+         * @param dtype the type of the result, FLOAT32, BOOL or BITMASK.
          * @return the result tensor.
          */
-        TensorPtr gt(const TensorPtr &rhs, bool lazy = true, TensorPtr outTensor = nullptr) {
-            return gt(*rhs, lazy, std::move(outTensor));
+        TensorPtr gt(const TensorPtr &rhs, bool lazy = true, TensorPtr outTensor = nullptr,
+                     DType dtype = DType::FLOAT32) {
+            return gt(*rhs, lazy, std::move(outTensor), dtype);
         }
 
         /**
@@ -826,19 +1081,21 @@ namespace Toygrad::Tensor {
          * @param rhs the right tensor.
          * @param lazy whether the operation is executed lazily.
          * @param outTensor the output tensor.
+         * @param dtype the type of the result, FLOAT32, BOOL or BITMASK.
          * @return the result tensor.
          */
-        TensorPtr gt(Tensor &rhs, bool lazy = true, TensorPtr outTensor = nullptr);
+        TensorPtr gt(Tensor &rhs, bool lazy = true, TensorPtr outTensor = nullptr, DType dtype = DType::FLOAT32);
 
         /**
          * Checks if each element of the tensor is greater than a constant.
          * @param c the constant to be compared.
          * @param lazy whether the operation is executed lazily.
          * @param outTensor the output tensor.
+         * @param dtype the type of the result, FLOAT32, BOOL or BITMASK.
          * @return the result tensor.
          */
-        TensorPtr gt(real c, bool lazy = true, TensorPtr outTensor = nullptr) {
-            return gt(fromConst(shape, c, lazy, nullptr), lazy, std::move(outTensor));
+        TensorPtr gt(real c, bool lazy = true, TensorPtr outTensor = nullptr, DType dtype = DType::FLOAT32) {
+            return gt(fromConst(shape, c, lazy, nullptr), lazy, std::move(outTensor), dtype);
         }
 
         /**
@@ -846,10 +1103,12 @@ namespace Toygrad::Tensor {
          * @param rhs the right tensor.
          * @param lazy whether the operation is executed lazily.
          * @param outTensor the output tensor.
+         * @param dtype the type of the result, FLOAT32, BOOL or BITMASK.
          * @return the result tensor.
          */
-        TensorPtr leq(const TensorPtr &rhs, bool lazy = true, TensorPtr outTensor = nullptr) {
-            return leq(*rhs, lazy, std::move(outTensor));
+        TensorPtr leq(const TensorPtr &rhs, bool lazy = true, TensorPtr outTensor = nullptr,
+                      DType dtype = DType::FLOAT32) {
+            return leq(*rhs, lazy, std::move(outTensor), dtype);
         }
 
         /**
@@ -857,19 +1116,21 @@ namespace Toygrad::Tensor {
          * @param rhs the right tensor.
          * @param lazy whether the operation is executed lazily.
          * @param outTensor the output tensor.
+         * @param dtype the type of the result, FLOAT32, BOOL or BITMASK.
          * @return the result tensor.
          */
-        TensorPtr leq(Tensor &rhs, bool lazy = true, TensorPtr outTensor = nullptr);
+        TensorPtr leq(Tensor &rhs, bool lazy = true, TensorPtr outTensor = nullptr, DType dtype = DType::FLOAT32);
 
         /**
          * Checks if each element of the tensor is less than or equal to a constant.
          * @param c the constant to be compared.
          * @param lazy whether the operation is executed lazily.
          * @param outTensor the output tensor.
+         * @param dtype the type of the result, FLOAT32, BOOL or BITMASK.
          * @return the result tensor.
          */
-        TensorPtr leq(real c, bool lazy = true, TensorPtr outTensor = nullptr) {
-            return leq(fromConst(shape, c, lazy, nullptr), lazy, std::move(outTensor));
+        TensorPtr leq(real c, bool lazy = true, TensorPtr outTensor = nullptr, DType dtype = DType::FLOAT32) {
+            return leq(fromConst(shape, c, lazy, nullptr), lazy, std::move(outTensor), dtype);
         }
 
         /**
@@ -877,10 +1138,12 @@ namespace Toygrad::Tensor {
          * @param rhs the right tensor.
          * @param lazy whether the operation is executed lazily.
          * @param outTensor the output tensor.
+         * @param dtype the type of the result, FLOAT32, BOOL or BITMASK.
          * @return the result tensor.
          */
-        TensorPtr geq(const TensorPtr &rhs, bool lazy = true, TensorPtr outTensor = nullptr) {
-            return geq(*rhs, lazy, std::move(outTensor));
+        TensorPtr geq(const TensorPtr &rhs, bool lazy = true, TensorPtr outTensor = nullptr,
+                      DType dtype = DType::FLOAT32) {
+            return geq(*rhs, lazy, std::move(outTensor), dtype);
         }
 
         /**
@@ -888,19 +1151,21 @@ namespace Toygrad::Tensor {
          * @param rhs the right tensor.
          * @param lazy whether the operation is executed lazily.
          * @param outTensor the output tensor.
+         * @param dtype the type of the result, FLOAT32, BOOL or BITMASK.
          * @return the result tensor.
          */
-        TensorPtr geq(Tensor &rhs, bool lazy = true, TensorPtr outTensor = nullptr);
+        TensorPtr geq(Tensor &rhs, bool lazy = true, TensorPtr outTensor = nullptr, DType dtype = DType::FLOAT32);
 
         /**
          * Checks if each element of the tensor is greater than or equal to a constant.
          * @param c the constant to be compared.
          * @param lazy whether the operation is executed lazily.
          * @param outTensor the output tensor.
+         * @param dtype the type of the result, FLOAT32, BOOL or BITMASK.
          * @return the result tensor.
          */
-        TensorPtr geq(real c, bool lazy = true, TensorPtr outTensor = nullptr) {
-            return geq(fromConst(shape, c, lazy, nullptr), lazy, std::move(outTensor));
+        TensorPtr geq(real c, bool lazy = true, TensorPtr outTensor = nullptr, DType dtype = DType::FLOAT32) {
+            return geq(fromConst(shape, c, lazy, nullptr), lazy, std::move(outTensor), dtype);
         }
 
         Tensor &operator=(const Tensor &rhs) = delete;
@@ -1035,7 +1300,8 @@ namespace Toygrad::Tensor {
         TensorPtr softmax(int64_t dim = -1, bool lazy = true, TensorPtr outTensor = nullptr);
 
         /**
-         * Matrix multiplies two tensors in the last two dimensions.
+         * Matrix multiplies two tensors in the last two dimensions. The leading batch dimensions are broadcast as in
+         * numpy, e.g. a 2D weight multiplies every matrix of a 3D batch in place without being copied per matrix.
          * @param rhs the right tensor.
          * @param lazy whether the operation is executed lazily.
          * @param outTensor the output tensor.
@@ -1046,7 +1312,8 @@ namespace Toygrad::Tensor {
         }
 
         /**
-         * Matrix multiplies two tensors in the last two dimensions.
+         * Matrix multiplies two tensors in the last two dimensions. The leading batch dimensions are broadcast as in
+         * numpy, e.g. a 2D weight multiplies every matrix of a 3D batch in place without being copied per matrix.
          * @param rhs the right tensor.
          * @param lazy whether the operation is executed lazily.
          * @param outTensor the output tensor.
@@ -1055,7 +1322,185 @@ namespace Toygrad::Tensor {
         TensorPtr matmul(Tensor &rhs, bool lazy = true, TensorPtr outTensor = nullptr);
 
         /**
-         * Reshapes the tensor to a given shape.
+         * Sums products of tensors over the dimensions named by subscripts as in numpy's einsum, e.g. "ij,jk->ik" is
+         * a matrix product and "bij,bkj->bik" a batched one with a transposed right operand. Without "->" the output
+         * keeps the labels that appear once in alphabetical order. The order in which pairs of operands are contracted
+         * is chosen to minimize the number of multiply-adds, by trying every order for a few operands and greedily
+         * for more. Each pairwise contraction permutes the operands as views, merges the dimensions of each kind and
+         * runs one batched matmul. Labels may not repeat within an operand, and a scalar operand of shape (1) has no
+         * labels, e.g. ",ij" scales a matrix.
+         * @param subscripts the labels of the dimensions of each operand separated by commas, then optionally "->" and
+         * the labels of the output.
+         * @param operands the tensors.
+         * @param lazy whether the operation is executed lazily.
+         * @return the result tensor, of shape (1) when the output has no labels.
+         */
+        static TensorPtr einsum(const std::string &subscripts, const std::vector<TensorPtr> &operands,
+                                bool lazy = true);
+
+        /**
+         * Multiplies a tensor by a weight, adds a bias and applies an activation in one operation, i.e.
+         * activation(x @ weight + bias). The bias and activation are applied to each element as the product computes
+         * it so the result is written to memory once instead of once per step, and backward computes the gradient of
+         * the activation, the bias and both products in one pass. The leading dimensions of the tensor are folded into
+         * the rows of one product, so they must be viewable as a single dimension without a copy.
+         * @param weight the weight of shape input features x output features.
+         * @param bias the bias of shape output features.
+         * @param activation the activation applied to the result.
+         * @param lazy whether the operation is executed lazily.
+         * @param outTensor the output tensor.
+         * @return the result tensor.
+         */
+        TensorPtr linear(const TensorPtr &weight, const TensorPtr &bias, Activation activation = Activation::NONE,
+                         bool lazy = true, TensorPtr outTensor = nullptr);
+
+        /**
+         * Multiplies a tensor by int8 weights stored with one row per output feature and adds a bias. The leading
+         * dimensions of the tensor are folded into the rows of one product like linear, and the rows are quantized to
+         * int8 when the operation runs, the products are summed in int32 and dequantized in float32. The result is not
+         * differentiable.
+         * @param weights the quantized weights of shape output features x input features.
+         * @param bias the bias of shape output features.
+         * @param lazy whether the operation is executed lazily.
+         * @param outTensor the output tensor.
+         * @return the result tensor.
+         */
+        TensorPtr matmulInt8(const std::shared_ptr<const Int8Matrix> &weights, const TensorPtr &bias, bool lazy = true,
+                             TensorPtr outTensor = nullptr);
+
+        /**
+         * Multiplies a tensor by 4-bit weights stored with one row per output feature and adds a bias. The leading
+         * dimensions of the tensor are folded into the rows of one product like linear, the weights are dequantized
+         * group by group as they are read and the result is not differentiable.
+         * @param weights the quantized weights of shape output features x input features.
+         * @param bias the bias of shape output features.
+         * @param lazy whether the operation is executed lazily.
+         * @param outTensor the output tensor.
+         * @return the result tensor.
+         */
+        TensorPtr matmulInt4(const std::shared_ptr<const Int4Matrix> &weights, const TensorPtr &bias, bool lazy = true,
+                             TensorPtr outTensor = nullptr);
+
+        /**
+         * Convolves a batch of signals of shape batch x channels x length, or batch x length x channels when channels
+         * are last, with weights and adds a bias. The padding reads zeros on both ends.
+         * @param weight the weights of shape output channels x input channels x kernel size, or output channels x
+         * kernel size x input channels when channels are last.
+         * @param bias the bias of shape output channels, or nullptr.
+         * @param stride the step between the positions the kernel is applied at.
+         * @param padding the number of zeros on each end.
+         * @param layout the order of the dimensions of the signals, the output has the same layout.
+         * @param lazy whether the operation is executed lazily.
+         * @param outTensor the output tensor.
+         * @return the result tensor.
+         */
+        TensorPtr conv1d(const TensorPtr &weight, const TensorPtr &bias, size_t stride = 1, size_t padding = 0,
+                         Layout layout = Layout::CHANNELS_FIRST, bool lazy = true, TensorPtr outTensor = nullptr) {
+            return conv(weight, bias, 1, stride, padding, layout, lazy, std::move(outTensor));
+        }
+
+        /**
+         * Convolves a batch of images of shape batch x channels x height x width, or batch x height x width x
+         * channels when channels are last, with weights and adds a bias. The stride and the padding apply to both
+         * spatial dimensions and the padding reads zeros. Kernels with few products per output are computed directly
+         * and larger ones by multiplying the patches of each image, i.e. im2col, by the weights. 3x3 kernels without
+         * stride use the Winograd algorithm instead, which needs 2.25x to 4x fewer multiplications, and weights that
+         * are parameters are only transformed for it again when they change.
+         * @param weight the weights of shape output channels x input channels x kernel height x kernel width, or
+         * output channels x kernel height x kernel width x input channels when channels are last.
+         * @param bias the bias of shape output channels, or nullptr.
+         * @param stride the step between the positions the kernel is applied at.
+         * @param padding the number of zeros on each side.
+         * @param layout the order of the dimensions of the images, the output has the same layout.
+         * @param lazy whether the operation is executed lazily.
+         * @param outTensor the output tensor.
+         * @return the result tensor.
+         */
+        TensorPtr conv2d(const TensorPtr &weight, const TensorPtr &bias, size_t stride = 1, size_t padding = 0,
+                         Layout layout = Layout::CHANNELS_FIRST, bool lazy = true, TensorPtr outTensor = nullptr) {
+            return conv(weight, bias, 2, stride, padding, layout, lazy, std::move(outTensor));
+        }
+
+        /**
+         * Takes the maximum of each window of a batch of signals, the padding is skipped.
+         * @param kernelSize the size of the windows.
+         * @param stride the step between windows.
+         * @param padding the number of positions skipped on each end, less than the size of the windows.
+         * @param layout the order of the dimensions of the signals.
+         * @param lazy whether the operation is executed lazily.
+         * @param outTensor the output tensor.
+         * @return the result tensor.
+         */
+        TensorPtr maxPool1d(size_t kernelSize, size_t stride, size_t padding = 0,
+                            Layout layout = Layout::CHANNELS_FIRST, bool lazy = true, TensorPtr outTensor = nullptr) {
+            return pool(Pooling::MAX, 1, kernelSize, stride, padding, layout, lazy, std::move(outTensor));
+        }
+
+        /**
+         * Takes the maximum of each square window of a batch of images, the padding is skipped.
+         * @param kernelSize the height and width of the windows.
+         * @param stride the step between windows.
+         * @param padding the number of positions skipped on each side, less than the size of the windows.
+         * @param layout the order of the dimensions of the images.
+         * @param lazy whether the operation is executed lazily.
+         * @param outTensor the output tensor.
+         * @return the result tensor.
+         */
+        TensorPtr maxPool2d(size_t kernelSize, size_t stride, size_t padding = 0,
+                            Layout layout = Layout::CHANNELS_FIRST, bool lazy = true, TensorPtr outTensor = nullptr) {
+            return pool(Pooling::MAX, 2, kernelSize, stride, padding, layout, lazy, std::move(outTensor));
+        }
+
+        /**
+         * Averages each window of a batch of signals over the elements that are not padding.
+         * @param kernelSize the size of the windows.
+         * @param stride the step between windows.
+         * @param padding the number of positions skipped on each end, less than the size of the windows.
+         * @param layout the order of the dimensions of the signals.
+         * @param lazy whether the operation is executed lazily.
+         * @param outTensor the output tensor.
+         * @return the result tensor.
+         */
+        TensorPtr avgPool1d(size_t kernelSize, size_t stride, size_t padding = 0,
+                            Layout layout = Layout::CHANNELS_FIRST, bool lazy = true, TensorPtr outTensor = nullptr) {
+            return pool(Pooling::AVG, 1, kernelSize, stride, padding, layout, lazy, std::move(outTensor));
+        }
+
+        /**
+         * Averages each square window of a batch of images over the elements that are not padding.
+         * @param kernelSize the height and width of the windows.
+         * @param stride the step between windows.
+         * @param padding the number of positions skipped on each side, less than the size of the windows.
+         * @param layout the order of the dimensions of the images.
+         * @param lazy whether the operation is executed lazily.
+         * @param outTensor the output tensor.
+         * @return the result tensor.
+         */
+        TensorPtr avgPool2d(size_t kernelSize, size_t stride, size_t padding = 0,
+                            Layout layout = Layout::CHANNELS_FIRST, bool lazy = true, TensorPtr outTensor = nullptr) {
+            return pool(Pooling::AVG, 2, kernelSize, stride, padding, layout, lazy, std::move(outTensor));
+        }
+
+        /**
+         * Checks if the tensor can be reshaped to a given shape as a view of the same memory.
+         * @param target the target shape to be reshaped to.
+         * @return true if reshape returns a view and false if it has to copy.
+         */
+        bool canReshapeWithoutCopy(const Shape &target) const;
+
+        /**
+         * Checks if the tensor can be reshaped to a given shape as a view of the same memory.
+         * @param view the view of the target shape to be reshaped to.
+         * @return true if reshape returns a view and false if it has to copy.
+         */
+        bool canReshapeWithoutCopy(const std::vector<size_t> &view) const {
+            return canReshapeWithoutCopy(Shape(view));
+        }
+
+        /**
+         * Reshapes the tensor to a given shape. The result is a view of the same memory whenever new strides can
+         * express the target shape, e.g. when splitting or merging dimensions that are contiguous with each other,
+         * and a copy otherwise.
          * @param target the target shape to be reshaped to.
          * @param lazy whether the operation is executed lazily.
          * @param outTensor the output tensor.
@@ -1136,7 +1581,8 @@ namespace Toygrad::Tensor {
         bool isEmpty() const;
 
         /**
-         * Forward propagation.
+         * Forward propagation. Only the tensors that are dirty or depend on a tensor modified since the last forward
+         * propagation are recomputed.
          */
         void forward();
 
@@ -1144,5 +1590,12 @@ namespace Toygrad::Tensor {
          * Backward propagation.
          */
         void backward();
+
+        /**
+         * Checkpoints the cheapest intermediate tensors to recompute in the graph rooted at the current tensor until
+         * the memory held by the rest fits in the budget.
+         * @param budget the number of bytes intermediate tensors may hold after forward propagation.
+         */
+        void setMemoryBudget(size_t budget);
     };
 }
@@ -2,26 +2,118 @@
 // Created by Trung Luu on 7/26/24.
 //
 
+#include <algorithm>
 #include <ranges>
 #include "tensor_graph.h"
 #include "ops.h"
 
 namespace Toygrad::Tensor {
-    void TensorGraph::recurSort(Tensor *tensor, std::unordered_set<size_t> visited) {
+    std::vector<Tensor *> TensorGraph::getOperands(const Op *op) {
+        if (op->opType == OpType::UN_OP) {
+            auto unOp = dynamic_cast<const UnOp *>(op);
+            return {unOp->operand.get()};
+        }
+
+        if (op->opType == OpType::BIN_OP) {
+            auto binOp = dynamic_cast<const BinOp *>(op);
+            return {binOp->lhs.get(), binOp->rhs.get()};
+        }
+
+        if (op->opType == OpType::MULTI_OP) {
+            auto multiOp = dynamic_cast<const MultiOp *>(op);
+            std::vector<Tensor *> operands;
+
+            for (auto &operand: multiOp->operands) {
+                operands.push_back(operand.get());
+            }
+
+            return operands;
+        }
+
+        return {};
+    }
+
+    size_t TensorGraph::getOperandVersion(const Tensor *tensor) {
+        // Versions only increase so the sum changes if and only if one of the operands changes
+        size_t operandVersion = 0;
+
+        for (auto &op: tensor->ops) {
+            for (auto &operand: getOperands(op)) {
+                operandVersion += operand->version;
+            }
+        }
+
+        return operandVersion;
+    }
+
+    bool TensorGraph::isIntermediate(const Tensor *tensor) {
+        return !tensor->ops.empty() && tensor->ops[0]->opType != OpType::LEAF;
+    }
+
+    bool TensorGraph::isPinned(const Tensor *tensor) const {
+        // Tensors referenced from outside the graph, e.g. by the caller, must keep their values
+        auto iter = uses.find(tensor);
+        size_t numUses = iter == uses.end() ? 0 : iter->second;
+        return tensor == root || static_cast<size_t>(tensor->weak_from_this().use_count()) > numUses;
+    }
+
+    bool TensorGraph::isReleasable(const Tensor *tensor) const {
+        // Values are kept only when backward needs them and they are not checkpointed for recomputation
+        return isIntermediate(tensor) && !isPinned(tensor) && !constants.contains(tensor) &&
+               (tensor->checkpoint || !saved.contains(tensor));
+    }
+
+    void TensorGraph::materialize(Tensor *tensor) {
+        // Recomputes a released tensor without bumping its version since its values are unchanged
+        for (auto &op: tensor->ops) {
+            for (auto &operand: getOperands(op)) {
+                if (operand->vec == nullptr) {
+                    materialize(operand);
+                }
+            }
+        }
+
+        for (auto &op: tensor->ops) {
+            op->forward();
+        }
+    }
+
+    void TensorGraph::recurSort(Tensor *tensor, std::unordered_set<size_t> &visited) {
         if (!visited.contains(tensor->id)) {
             visited.insert(tensor->id);
 
             for (auto &op: tensor->ops) {
-                if (op->opType == OpType::UN_OP) {
-                    auto unOp = dynamic_cast<UnOp *>(op);
-                    recurSort(unOp->operand.get(), visited);
-                } else if (op->opType == OpType::BIN_OP) {
-                    auto binOp = dynamic_cast<BinOp *>(op);
-                    recurSort(binOp->lhs.get(), visited);
-                    recurSort(binOp->rhs.get(), visited);
+                auto operands = getOperands(op);
+
+                for (size_t i = 0; i < operands.size(); i++) {
+                    recurSort(operands[i], visited);
+                    uses[operands[i]]++;
+
+                    if (tensor->requiresGrad && op->savesInput(i)) {
+                        saved.insert(operands[i]);
+                    }
+                }
+
+                if (tensor->requiresGrad && op->savesOutput()) {
+                    saved.insert(tensor);
+                }
+            }
+
+            // Parameters, sampled leaves and leaves reading the caller's memory may change between forward passes
+            bool isConstant = !tensor->ops.empty() && !tensor->requiresGrad;
+
+            for (auto &op: tensor->ops) {
+                isConstant = isConstant && (op->opType != OpType::LEAF || op->isConstant());
+
+                for (auto &operand: getOperands(op)) {
+                    isConstant = isConstant && constants.contains(operand);
                 }
             }
 
+            if (isConstant) {
+                constants.insert(tensor);
+            }
+
             tensors.push_back(tensor);
         }
     }
@@ -31,19 +123,181 @@ namespace Toygrad::Tensor {
         recurSort(root, visited);
     }
 
+    void TensorGraph::bindSlices() {
+        // Consumers are visited first so that a nested concatenation is bound before its own operands
+        for (auto &tensor: std::ranges::reverse_view(tensors)) {
+            for (auto &op: tensor->ops) {
+                auto catOp = dynamic_cast<CatOp *>(op);
+
+                if (catOp == nullptr) {
+                    continue;
+                }
+
+                for (size_t i = 0; i < catOp->operands.size(); i++) {
+                    Tensor *operand = catOp->operands[i].get();
+                    bool isView = std::ranges::any_of(operand->ops, [](const Op *opndOp) { return opndOp->isView(); });
+
+                    // Only producers that are computed for the concatenation alone and whose memory is not yet
+                    // allocated can write their values into the output instead of being copied, a producer the caller
+                    // holds keeps its own layout
+                    if (uses[operand] != 1 || !isIntermediate(operand) || isView || operand->vec != nullptr ||
+                        !operand->base.expired() || isPinned(operand)) {
+                        continue;
+                    }
+
+                    operand->setShape(catOp->getSlice(tensor->shape, i));
+                    operand->base = tensor->weak_from_this();
+                }
+            }
+        }
+    }
+
     void TensorGraph::forward() const {
+        auto pendingUses = uses;
+
         for (auto &tensor: tensors) {
+            size_t operandVersion = getOperandVersion(tensor);
+
+            // Skip tensors whose inputs are unchanged since the last forward pass
+            if (tensor->dirty || tensor->operandVersion != operandVersion) {
+                for (auto &op: tensor->ops) {
+                    for (auto &operand: getOperands(op)) {
+                        if (operand->vec == nullptr) {
+                            materialize(operand);
+                        }
+                    }
+
+                    op->forward();
+                }
+
+                tensor->dirty = false;
+                tensor->operandVersion = operandVersion;
+                tensor->bumpVersion();
+            }
+
             for (auto &op: tensor->ops) {
-                op->forward();
+                for (auto &operand: getOperands(op)) {
+                    // Intermediates not needed by backward are released once their last consumer has run
+                    if (--pendingUses[operand] == 0 && isReleasable(operand)) {
+                        operand->vec = nullptr;
+                    }
+                }
             }
         }
     }
 
     void TensorGraph::backward() const {
         for (auto &tensor: std::ranges::reverse_view(tensors)) {
+            // Tensors that do not lead to a parameter, including those created in inference mode, need no gradients
+            if (!tensor->requiresGrad) {
+                continue;
+            }
+
+            // Recomputes the checkpointed values the backward ops read
+            for (auto &op: tensor->ops) {
+                auto operands = getOperands(op);
+
+                for (size_t i = 0; i < operands.size(); i++) {
+                    if (op->savesInput(i) && operands[i]->vec == nullptr) {
+                        materialize(operands[i]);
+                    }
+                }
+
+                if (op->savesOutput() && tensor->vec == nullptr) {
+                    materialize(tensor);
+                }
+            }
+
             for (auto &op: std::ranges::reverse_view(tensor->ops)) {
                 op->backward();
             }
+
+            // Every backward reader precedes the tensor in reverse order so its values are no longer needed
+            if (isIntermediate(tensor) && !isPinned(tensor)) {
+                tensor->vec = nullptr;
+            }
+        }
+
+        // Releases the values read by backward of tensors that have no backward pass of their own
+        for (auto &tensor: tensors) {
+            if (isIntermediate(tensor) && !isPinned(tensor) && !constants.contains(tensor)) {
+                tensor->vec = nullptr;
+            }
+        }
+    }
+
+    void TensorGraph::setMemoryBudget(size_t budget) {
+        auto numBytes = [](const Tensor *tensor) {
+            return getNumBytes(tensor->dtype, tensor->getNumel());
+        };
+
+        std::vector<Tensor *> candidates;
+        size_t total = 0;
+
+        for (auto &tensor: tensors) {
+            // Views free no memory when released
+            if (!isIntermediate(tensor) || isPinned(tensor) || constants.contains(tensor) || tensor->checkpoint ||
+                tensor->ops[0]->isView()) {
+                continue;
+            }
+
+            candidates.push_back(tensor);
+            total += numBytes(tensor);
+        }
+
+        auto cost = [](const Tensor *tensor) {
+            size_t sum = 0;
+
+            for (auto &op: tensor->ops) {
+                sum += op->cost();
+            }
+
+            return sum;
+        };
+
+        // Cheapest recomputation per byte freed first
+        std::ranges::sort(candidates, [&cost, &numBytes](const Tensor *t1, const Tensor *t2) {
+            return cost(t1) * numBytes(t2) < cost(t2) * numBytes(t1);
+        });
+
+        for (auto &tensor: candidates) {
+            if (total <= budget) {
+                break;
+            }
+
+            tensor->checkpoint = true;
+            total -= numBytes(tensor);
+        }
+    }
+
+    void TensorGraph::checkpoint(Tensor *output, const std::vector<TensorPtr> &inputs, bool enabled) {
+        std::unordered_set<const Tensor *> boundary;
+        std::unordered_set<size_t> visited;
+        std::vector<Tensor *> stack = {output};
+
+        for (auto &input: inputs) {
+            boundary.insert(input.get());
+        }
+
+        while (!stack.empty()) {
+            Tensor *tensor = stack.back();
+            stack.pop_back();
+
+            if (visited.contains(tensor->id) || boundary.contains(tensor) || !isIntermediate(tensor)) {
+                continue;
+            }
+
+            visited.insert(tensor->id);
+
+            if (tensor != output) {
+                tensor->checkpoint = enabled;
+            }
+
+            for (auto &op: tensor->ops) {
+                for (auto &operand: getOperands(op)) {
+                    stack.push_back(operand);
+                }
+            }
         }
     }
 }
@@ -4,24 +4,50 @@
 
 #pragma once
 
+#include <unordered_map>
 #include <unordered_set>
 #include "tensor.h"
 
 // Computational graph
 namespace Toygrad::Tensor {
     class TensorGraph {
+        friend class TensorPlan;
+
         std::vector<Tensor *> tensors;
+        // Number of references to each tensor from the ops in the graph
+        std::unordered_map<const Tensor *, size_t> uses;
+        // Tensors whose values are read by backward propagation
+        std::unordered_set<const Tensor *> saved;
+        // Tensors computed only from constant leaves such as arange, which keep their values since a consumer that is
+        // recomputed after another input changes reads them again
+        std::unordered_set<const Tensor *> constants;
         Tensor *root = nullptr;
 
         TensorGraph() = default;
 
-        void recurSort(Tensor *tensor, std::unordered_set<size_t> visited);
+        static std::vector<Tensor *> getOperands(const Op *op);
+
+        static size_t getOperandVersion(const Tensor *tensor);
+
+        static bool isIntermediate(const Tensor *tensor);
+
+        bool isPinned(const Tensor *tensor) const;
+
+        static void materialize(Tensor *tensor);
+
+        bool isReleasable(const Tensor *tensor) const;
+
+        void recurSort(Tensor *tensor, std::unordered_set<size_t> &visited);
 
         void sort();
 
+        // Lets the operands of concatenations compute their values directly into the output's memory
+        void bindSlices();
+
     public:
         explicit TensorGraph(Tensor *root): root(root) {
             sort();
+            bindSlices();
         }
 
         Tensor *getRoot() const { return root; }
@@ -30,6 +56,22 @@ namespace Toygrad::Tensor {
 
         void backward() const;
 
+        /**
+         * Checkpoints intermediate tensors greedily, cheapest recomputation per byte first, until the memory held by
+         * the remaining intermediate tensors fits in the budget.
+         * @param budget the number of bytes intermediate tensors may hold after forward propagation.
+         */
+        void setMemoryBudget(size_t budget);
+
+        /**
+         * Checkpoints the intermediate tensors computed between the given inputs and the output, e.g. the
+         * activations inside a module, leaving the output as the segment's boundary.
+         * @param output the last tensor of the segment.
+         * @param inputs the tensors the segment starts from.
+         * @param enabled whether the tensors are checkpointed or restored to keep their values.
+         */
+        static void checkpoint(Tensor *output, const std::vector<TensorPtr> &inputs, bool enabled = true);
+
         std::vector<Tensor *>::iterator begin() {
             return tensors.begin();
         }
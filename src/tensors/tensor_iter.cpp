@@ -8,36 +8,42 @@ namespace Toygrad::Tensor {
     void SparseIter::next() {
         state.counter++;
 
-        if (state.counter > tensor->getShape().getSize()) {
+        if (state.counter > numel) {
             return;
         }
 
-        auto &shape = tensor->getShape();
-        bool flag;
+        auto &view = tensor->getIterView();
+        auto &strides = tensor->getIterStrides();
 
-        do {
-            flag = state.rotator[state.ridx] + 1 < shape.view[state.ridx];
+        // Step the innermost dimension and carry into the outer ones, updating the index incrementally
+        for (size_t i = view.size() - 1;; i--) {
+            state.rotator[i]++;
+            state.elmIdx += strides[i];
 
-            if (!flag) {
-                state.ridx--;
+            if (state.rotator[i] < view[i] || i == 0) {
+                break;
             }
-        } while (!flag);
 
-        state.rotator[state.ridx]++;
-        state.elmIdx = offset;
-
-        for (size_t i = state.ridx + 1; i < state.rotator.size(); i++) {
+            state.elmIdx -= view[i] * strides[i];
             state.rotator[i] = 0;
         }
+    }
+
+    IterPtr initIter(Tensor *tensor) {
+        assert(Error::str_assert(tensor->getDType() == DType::FLOAT32,
+            Error::Message::dtypeUnsupported(tensor->getDType())));
 
-        for (size_t i = 0; i < state.rotator.size(); i++) {
-            state.elmIdx += state.rotator[i] * tensor->getShape().strides[i];
+        if (tensor->isContiguous()) {
+            return std::make_unique<DenseIter>(tensor);
         }
 
-        state.ridx = state.rotator.size() - 1;
+        return std::make_unique<SparseIter>(tensor);
     }
 
-    IterPtr initIter(Tensor *tensor) {
+    IterPtr initConstIter(const Tensor *tensor) {
+        assert(Error::str_assert(tensor->getDType() == DType::FLOAT32,
+            Error::Message::dtypeUnsupported(tensor->getDType())));
+
         if (tensor->isContiguous()) {
             return std::make_unique<DenseIter>(tensor);
         }
@@ -45,7 +51,7 @@ namespace Toygrad::Tensor {
         return std::make_unique<SparseIter>(tensor);
     }
 
-    IterPtr initConstIter(const Tensor *tensor) {
+    IterPtr initIndexIter(const Tensor *tensor) {
         if (tensor->isContiguous()) {
             return std::make_unique<DenseIter>(tensor);
         }
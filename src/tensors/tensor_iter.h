@@ -26,6 +26,9 @@ namespace Toygrad::Tensor {
 
         virtual real &curr() const = 0;
 
+        // Index of the current element in the tensor's buffer
+        virtual size_t index() const = 0;
+
         virtual size_t count() = 0;
 
         virtual void save() = 0;
@@ -42,6 +45,7 @@ namespace Toygrad::Tensor {
 
         State state = State();
         std::vector<State> saved = std::vector<State>();
+        size_t end = 0;
 
     public:
         explicit DenseIter(const Tensor *tensor): TensorIter(tensor) {
@@ -49,11 +53,12 @@ namespace Toygrad::Tensor {
 
         void start() override {
             offset = tensor->getShape().offset;
+            end = offset + tensor->getNumel();
             state.elmIdx = offset;
         }
 
         bool hasNext() override {
-            return state.elmIdx < tensor->getShape().offset + tensor->getShape().getSize();
+            return state.elmIdx < end;
         }
 
         void next() override {
@@ -64,6 +69,10 @@ namespace Toygrad::Tensor {
             return (*tensor->getVec())[state.elmIdx];
         }
 
+        size_t index() const override {
+            return state.elmIdx;
+        }
+
         size_t count() override {
             return state.elmIdx - offset + 1;
         }
@@ -82,8 +91,8 @@ namespace Toygrad::Tensor {
     class SparseIter : public TensorIter {
         struct State {
             size_t elmIdx = 0;
-            size_t ridx = 0;
-            std::vector<size_t> rotator = std::vector<size_t>();
+            // Position in each dimension of the tensor's iteration plan
+            Dims rotator = Dims();
             size_t counter = 0;
 
             State() = default;
@@ -91,22 +100,23 @@ namespace Toygrad::Tensor {
 
         State state = State();
         std::vector<State> saved = std::vector<State>();
+        size_t numel = 0;
 
     public:
         explicit SparseIter(const Tensor *tensor): TensorIter(tensor) {
-            state.rotator.resize(tensor->getShape().getNumDims());
+            state.rotator.resize(tensor->getIterView().size());
         }
 
         void start() override {
             offset = tensor->getShape().offset;
+            numel = tensor->getNumel();
             state.elmIdx = offset;
             std::ranges::fill(state.rotator.begin(), state.rotator.end(), 0);
-            state.ridx = state.rotator.size() - 1;
             state.counter = 1;
         }
 
         bool hasNext() override {
-            return state.counter <= tensor->getShape().getSize();
+            return state.counter <= numel;
         }
 
         void next() override;
@@ -115,6 +125,10 @@ namespace Toygrad::Tensor {
             return (*tensor->getVec())[state.elmIdx];
         }
 
+        size_t index() const override {
+            return state.elmIdx;
+        }
+
         size_t count() override {
             return state.counter;
         }
@@ -133,4 +147,7 @@ namespace Toygrad::Tensor {
     IterPtr initIter(Tensor *tensor);
 
     IterPtr initConstIter(const Tensor *tensor);
+
+    // Iterates over the element indices of a tensor of any data type, curr() must only be used for float32
+    IterPtr initIndexIter(const Tensor *tensor);
 }
@@ -0,0 +1,102 @@
+#include <unordered_set>
+#include "tensor_plan.h"
+#include "ops.h"
+
+namespace Toygrad::Tensor {
+    TensorPlan::TensorPlan(const TensorPtr &root, const std::vector<TensorPtr> &inputs): root(root), inputs(inputs) {
+        root->forward();
+        std::unordered_set<size_t> downstream;
+
+        for (auto &input: inputs) {
+            downstream.insert(input->id);
+            buffers.push_back(input->vec);
+        }
+
+        for (auto &tensor: *root->graph) {
+            if (downstream.contains(tensor->id)) {
+                continue;
+            }
+
+            bool isDownstream = false;
+
+            for (auto &op: tensor->ops) {
+                for (auto &operand: TensorGraph::getOperands(op)) {
+                    isDownstream = isDownstream || downstream.contains(operand->id);
+                }
+            }
+
+            if (isDownstream) {
+                downstream.insert(tensor->id);
+                steps.insert(steps.end(), tensor->ops.begin(), tensor->ops.end());
+                outputs.push_back(tensor->shared_from_this());
+            }
+        }
+
+        for (auto &op: steps) {
+            for (auto &operand: TensorGraph::getOperands(op)) {
+                if (!downstream.contains(operand->id)) {
+                    if (operand->vec == nullptr) {
+                        TensorGraph::materialize(operand);
+                    }
+
+                    constants.push_back(operand->shared_from_this());
+                }
+            }
+        }
+
+        for (auto &op: steps) {
+            workspaces.push_back(std::make_unique<Workspace>());
+            op->workspace = workspaces.back().get();
+        }
+
+        // Recomputes the outputs the forward pass released, now that they are held, and sizes the scratch memory.
+        // Their values are unchanged so their versions are not bumped.
+        for (auto &op: steps) {
+            op->forward();
+        }
+    }
+
+    TensorPlan::~TensorPlan() {
+        for (auto &op: steps) {
+            op->workspace = nullptr;
+        }
+    }
+
+    const TensorPtr &TensorPlan::replay(const std::vector<TensorPtr> &x) {
+        assert(Error::str_assert(x.size() == inputs.size(),
+            Error::Message::invalidInputSize(x.size(), inputs.size())));
+
+        for (size_t i = 0; i < x.size(); i++) {
+            assert(Error::str_assert(x[i]->vec != nullptr, Error::Message::tensorUnrealized));
+            assert(Error::str_assert(x[i]->shape == inputs[i]->shape,
+                Error::Message::shapesMismatched("replay", x[i]->shape, inputs[i]->shape)));
+
+            // Only memory holding the captured data type can be bound, other inputs are converted while copied
+            if (x[i]->shape.offset == 0 && x[i]->isContiguous() && x[i]->dtype == inputs[i]->dtype) {
+                inputs[i]->vec = x[i]->vec;
+            } else {
+                inputs[i]->vec = buffers[i];
+                stridedCast(*x[i]->vec, x[i]->shape.offset, x[i]->shape.getStrides(), *buffers[i],
+                            inputs[i]->shape.offset, inputs[i]->shape.getStrides(), inputs[i]->shape.getView());
+            }
+
+            inputs[i]->bumpVersion();
+        }
+
+        for (auto &op: steps) {
+            op->forward();
+        }
+
+        for (auto &tensor: outputs) {
+            tensor->bumpVersion();
+        }
+
+        return root;
+    }
+
+    void TensorPlan::unbind() {
+        for (size_t i = 0; i < inputs.size(); i++) {
+            inputs[i]->vec = buffers[i];
+        }
+    }
+}
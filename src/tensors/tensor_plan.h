@@ -0,0 +1,54 @@
+#pragma once
+
+#include "kernels.h"
+#include "tensor_graph.h"
+
+// Captured execution plan
+namespace Toygrad::Tensor {
+    class TensorPlan {
+        TensorPtr root;
+        std::vector<TensorPtr> inputs;
+        // Buffers owned by the inputs when the plan was captured
+        std::vector<std::shared_ptr<Vec> > buffers;
+        // Ops downstream of the inputs in execution order
+        std::vector<Op *> steps;
+        // Scratch memory of each step, sized while capturing and reused by every replay
+        std::vector<std::unique_ptr<Workspace> > workspaces;
+        // Tensors written by the steps, held so their memory is never released
+        std::vector<TensorPtr> outputs;
+        // Tensors read by the steps but not written by them, held so they are never released
+        std::vector<TensorPtr> constants;
+
+    public:
+        /**
+         * Captures the graph of a root tensor so it can be rerun for new inputs of the same shapes. The graph is
+         * forwarded once, then the steps are run once more with the plan's scratch memory so that every tensor they
+         * write and every scratch buffer of their kernels is allocated before the first replay.
+         * @param root the root tensor of the graph.
+         * @param inputs the tensors of the graph to be rebound on every replay.
+         */
+        TensorPlan(const TensorPtr &root, const std::vector<TensorPtr> &inputs);
+
+        ~TensorPlan();
+
+        /**
+         * Gets the root tensor of the captured graph.
+         * @return the root tensor.
+         */
+        const TensorPtr &getRoot() const { return root; }
+
+        /**
+         * Binds new inputs and reruns the ops downstream of them without walking the graph. The steps write into the
+         * captured tensors and use the captured scratch memory, so no tensor memory or scratch buffer is allocated.
+         * Contiguous inputs with the captured shapes share their memory with the graph, other inputs are copied.
+         * @param x the realized input tensors, in the same order as the captured inputs.
+         * @return the root tensor.
+         */
+        const TensorPtr &replay(const std::vector<TensorPtr> &x);
+
+        /**
+         * Restores the buffers owned by the inputs so the tensors bound in the last replay are no longer shared.
+         */
+        void unbind();
+    };
+}
@@ -2,14 +2,33 @@
 
 namespace Toygrad::Tensor {
     std::ostream &operator<<(std::ostream &stream, const Vec &vec) {
-        for (size_t i = 0; i < vec.size; i++) {
-            stream << vec[i];
-
-            if (i < vec.size - 1) {
-                stream << " ";
+        if (vec.dtype == DType::BITMASK) {
+            for (size_t i = 0; i < vec.size; i++) {
+                stream << readMask(vec.buff.get(), vec.dtype, i) << (i < vec.size - 1 ? " " : "");
             }
+
+            return stream;
         }
 
+        dispatch(vec.dtype, [&]<class T>() {
+            for (size_t i = 0; i < vec.size; i++) {
+                T elm = vec.getData<T>()[i];
+
+                // Reduced precision numbers print as floats and booleans as 0 or 1
+                if constexpr (std::is_same_v<T, Half> || std::is_same_v<T, BFloat16>) {
+                    stream << static_cast<float>(elm);
+                } else if constexpr (std::is_same_v<T, bool>) {
+                    stream << static_cast<int>(elm);
+                } else {
+                    stream << elm;
+                }
+
+                if (i < vec.size - 1) {
+                    stream << " ";
+                }
+            }
+        });
+
         return stream;
     }
 }
@@ -1,30 +1,75 @@
 #pragma once
+#include <functional>
 #include <iostream>
 #include "common.h"
+#include "dtype.h"
 
 namespace Toygrad::Tensor {
     struct Vec {
+        // Memory allocated by the vector, or borrowed from another object whose reference is dropped on deletion
+        using Buffer = std::unique_ptr<std::byte[], std::function<void(std::byte *)> >;
+
         size_t size;
-        std::unique_ptr<real[]> buff;
+        // Type of the elements stored in the buffer
+        DType dtype = DType::FLOAT32;
+        Buffer buff;
+        // Incremented by every tensor that writes to the buffer, including views and slices of another tensor
+        size_t version = 0;
+
+        explicit Vec(size_t size, DType dtype = DType::FLOAT32) : size(size), dtype(dtype) {
+            buff = allocate(getNumBytes(dtype, size));
+        }
 
-        explicit Vec(size_t size) : size(size) {
-            buff = std::make_unique<real[]>(size);
+        /**
+         * Wraps memory owned by another object, e.g. a numpy array, without copying it. The owner is kept alive until
+         * the vector is destroyed.
+         * @param size the number of elements.
+         * @param dtype the type of the elements.
+         * @param data the first byte of the memory.
+         * @param owner the reference that keeps the memory alive.
+         */
+        Vec(size_t size, DType dtype, std::byte *data, std::shared_ptr<void> owner) : size(size), dtype(dtype) {
+            buff = Buffer(data, [owner = std::move(owner)](std::byte *) mutable { owner.reset(); });
         }
 
         Vec(size_t size, real c) : Vec(size) {
-            std::fill_n(buff.get(), size, c);
+            std::fill_n(getData<real>(), size, c);
         }
 
         Vec(const Vec &vec) {
             size = vec.size;
-            buff = std::make_unique<real[]>(size);
-            std::ranges::copy(vec.buff.get(), vec.buff.get() + size, buff.get());
+            dtype = vec.dtype;
+            buff = allocate(getNumBytes(dtype, size));
+            std::ranges::copy(vec.buff.get(), vec.buff.get() + getNumBytes(dtype, size), buff.get());
         }
 
         ~Vec() = default;
 
+        // Allocates zeroed memory
+        static Buffer allocate(size_t numBytes) {
+            return Buffer(new std::byte[numBytes](), std::default_delete<std::byte[]>());
+        }
+
+        /**
+         * Gets the buffer as an array of elements of the given type.
+         * @return a pointer to the first element.
+         */
+        template<class T>
+        T *getData() const {
+            return reinterpret_cast<T *>(buff.get());
+        }
+
+        /**
+         * Gets the address of an element regardless of the type of the elements.
+         * @param idx the index of the element.
+         * @return a pointer to the first byte of the element.
+         */
+        std::byte *getElmPtr(size_t idx) const {
+            return buff.get() + idx * getDTypeSize(dtype);
+        }
+
         real &operator[](size_t idx) const {
-            return buff[idx];
+            return getData<real>()[idx];
         }
 
         friend std::ostream &operator<<(std::ostream &stream, const Vec &vec);
@@ -1,3 +1,138 @@
 //
 // Created by Trung Luu on 9/19/24.
 //
+
+#include "gtest/gtest.h"
+#include "nn/conv.h"
+#include "nn/linear.h"
+#include "nn/qlinear.h"
+
+using namespace Toygrad::Tensor;
+using namespace Toygrad::NN;
+
+class NNTestFixture : public testing::Test {
+protected:
+    void SetUp() override {
+    }
+
+    void TearDown() override {
+    }
+};
+
+TEST(NNTestFixture, linearForward1) {
+    std::cout << std::endl << "Linear forward 1:" << std::endl;
+    Linear linear(4, 3);
+    auto x1 = Tensor::randn({2, 4});
+    auto y1 = linear.forward({x1})->copy(false);
+    // Weights are realized once so feeding the same batch again gives the same output
+    auto y2 = linear.forward({x1});
+    std::cout << "Actual:" << std::endl << *y2 << std::endl;
+    std::cout << "Expected:" << std::endl << *y1 << std::endl;
+    ASSERT_EQ(*y2, *y1);
+}
+
+TEST(NNTestFixture, linearReplay1) {
+    std::cout << std::endl << "Linear replay 1:" << std::endl;
+    Linear linear(4, 3);
+    auto x1 = Tensor::randn({2, 4});
+    auto x2 = Tensor::randn({2, 4});
+    x1->forward();
+    x2->forward();
+    linear.capture({x1});
+    auto y2 = linear.replay({x2})->copy(false);
+    auto y1 = linear.replay({x1})->copy(false);
+    auto z2 = linear.forward({x2});
+    std::cout << "Actual:" << std::endl << *y2 << std::endl;
+    std::cout << "Expected:" << std::endl << *z2 << std::endl;
+    ASSERT_EQ(*y2, *z2);
+    ASSERT_EQ(*y1, *linear.forward({x1}));
+    // An input of another data type is converted into the captured buffer instead of being bound
+    auto x3 = x2->to(DType::FLOAT16, false);
+    auto y3 = linear.replay({x3})->copy(false);
+    ASSERT_EQ(*y3, *linear.forward({x3->to(DType::FLOAT32, false)}));
+}
+
+TEST(NNTestFixture, linearBFloat16) {
+    std::cout << std::endl << "Linear bfloat16:" << std::endl;
+    Linear linear(4, 3, DType::BFLOAT16);
+    auto x1 = Tensor::randn({2, 4});
+    auto y1 = linear.forward({x1});
+    auto z1 = y1->sum();
+    z1->forward();
+    z1->backward();
+    std::cout << *y1 << std::endl;
+    ASSERT_EQ(y1->getDType(), DType::FLOAT32);
+    ASSERT_EQ(y1->getGrad()->getDType(), DType::FLOAT32);
+    ASSERT_EQ(*linear.forward({x1}), *y1);
+}
+
+TEST(NNTestFixture, linearBatch1) {
+    std::cout << std::endl << "Linear batch 1:" << std::endl;
+    Linear linear(4, 3, DType::FLOAT32, Activation::RELU);
+    auto x1 = Tensor::randn({2, 3, 8}, false);
+    auto x2 = x1->at({Range{0, 2, 1}, Range{0, 3, 1}, Range{0, 4, 1}}, false);
+    auto x3 = x1->at({Range{0, 2, 1}, Range{0, 3, 2}, Range{0, 4, 1}}, false);
+    // Leading dimensions of a dense input are folded into one product, those of a strided slice are broadcast against
+    // the weight
+    auto y2 = linear.forward({x2})->copy(false);
+    auto y3 = linear.F({x3});
+    y3->forward();
+    ASSERT_EQ(y2->getShape(), Shape({2, 3, 3}));
+    ASSERT_EQ(y3->getShape(), Shape({2, 2, 3}));
+
+    for (size_t i = 0; i < 2; i++) {
+        auto y = linear.F({x2->at({i}, false)});
+        y->forward();
+        std::cout << *y << std::endl;
+        ASSERT_EQ(*y2->at({i}, false), *y);
+        ASSERT_EQ(*y3->at({Range{i, i + 1, 1}, Range{0, 2, 1}, Range{0, 3, 1}}, false),
+                  *y2->at({Range{i, i + 1, 1}, Range{0, 3, 2}, Range{0, 3, 1}}, false));
+    }
+}
+
+TEST(NNTestFixture, qlinear1) {
+    std::cout << std::endl << "Quantized linear 1:" << std::endl;
+    Linear linear(64, 16);
+    QLinear qlinear(linear);
+    std::vector<TensorPtr> x;
+
+    for (size_t i = 0; i < 4; i++) {
+        x.push_back(Tensor::randn({8, 64}));
+    }
+
+    QuantizationError error = qlinear.calibrate(linear, x);
+    std::cout << "Max error: " << error.maxAbsError << ", relative error: " << error.relError << std::endl;
+    ASSERT_GT(error.maxAbsError, 0);
+    ASSERT_LT(error.relError, 0.02);
+}
+
+TEST(NNTestFixture, int4Linear1) {
+    std::cout << std::endl << "Int4 linear 1:" << std::endl;
+    Linear linear(64, 16);
+    Int4Linear qlinear(linear);
+    std::vector<TensorPtr> x;
+
+    for (size_t i = 0; i < 4; i++) {
+        x.push_back(Tensor::randn({1, 64}));
+    }
+
+    QuantizationError error = qlinear.calibrate(linear, x);
+    std::cout << "Max error: " << error.maxAbsError << ", relative error: " << error.relError << std::endl;
+    ASSERT_GT(error.maxAbsError, 0);
+    ASSERT_LT(error.relError, 0.15);
+}
+
+TEST(NNTestFixture, conv2dForward1) {
+    std::cout << std::endl << "Conv2d forward 1:" << std::endl;
+    Conv2d conv(3, 4, 3, 2, 1);
+    auto x1 = Tensor::randn({2, 3, 7, 7});
+    auto y1 = conv.forward({x1})->copy(false);
+    auto y2 = conv.forward({x1});
+    ASSERT_EQ(y2->getShape(), Shape({2, 4, 4, 4}));
+    ASSERT_EQ(*y2, *y1);
+    // Pooling the feature maps of a channels last layer keeps the layout
+    Conv2d convLast(3, 4, 3, 1, 1, Layout::CHANNELS_LAST);
+    auto y3 = convLast.forward({Tensor::randn({2, 6, 6, 3})})->maxPool2d(2, 2, 0, Layout::CHANNELS_LAST, false);
+    ASSERT_EQ(y3->getShape(), Shape({2, 3, 3, 4}));
+}
+
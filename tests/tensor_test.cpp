@@ -2,9 +2,12 @@
 // Created by Trung Luu on 7/16/24.
 //
 
+#include <numeric>
 #include "gtest/gtest.h"
 #include "tensors/tensor.h"
 #include "tensors/tensor_graph.h"
+#include "tensors/tensor_plan.h"
+#include "tensors/kernels.h"
 
 using namespace Toygrad::Tensor;
 
@@ -23,6 +26,72 @@ auto assertEqTemplate(const Tensor &actual, const Tensor &expected) {
     ASSERT_EQ(actual, expected);
 }
 
+// Checks conv2d and its gradients with the sum of the outputs as the loss against the sums written out
+void checkConv2d(size_t n, size_t c, size_t h, size_t w, size_t o, size_t k, size_t stride, size_t padding) {
+    auto x = Tensor::randn({n, c, h, w}, false);
+    auto weight = Tensor::randn({o, c, k, k}, false);
+    auto bias = Tensor::randn({o}, false);
+
+    for (auto &t: {x, weight, bias}) {
+        t->setRequiresGrad(true);
+    }
+
+    auto y = x->conv2d(weight, bias, stride, padding);
+    auto loss = y->sum();
+    loss->forward();
+    loss->backward();
+    size_t outHeight = (h + 2 * padding - k) / stride + 1;
+    size_t outWidth = (w + 2 * padding - k) / stride + 1;
+    ASSERT_EQ(y->getShape(), Shape({n, o, outHeight, outWidth}));
+    const Vec &xs = *x->getVec();
+    const Vec &ws = *weight->getVec();
+    std::vector<real> xGrad(n * c * h * w), weightGrad(o * c * k * k);
+
+    for (size_t b = 0; b < n; b++) {
+        for (size_t oc = 0; oc < o; oc++) {
+            for (size_t i = 0; i < outHeight; i++) {
+                for (size_t j = 0; j < outWidth; j++) {
+                    real expected = (*bias->getVec())[oc];
+
+                    for (size_t ic = 0; ic < c; ic++) {
+                        for (size_t p = 0; p < k; p++) {
+                            for (size_t q = 0; q < k; q++) {
+                                int64_t ih = static_cast<int64_t>(i * stride + p) - static_cast<int64_t>(padding);
+                                int64_t iw = static_cast<int64_t>(j * stride + q) - static_cast<int64_t>(padding);
+
+                                if (ih < 0 || iw < 0 || ih >= static_cast<int64_t>(h) ||
+                                    iw >= static_cast<int64_t>(w)) {
+                                    continue;
+                                }
+
+                                size_t xIdx = ((b * c + ic) * h + ih) * w + iw;
+                                size_t wIdx = ((oc * c + ic) * k + p) * k + q;
+                                expected += xs[xIdx] * ws[wIdx];
+                                xGrad[xIdx] += ws[wIdx];
+                                weightGrad[wIdx] += xs[xIdx];
+                            }
+                        }
+                    }
+
+                    ASSERT_NEAR((*y->getVec())[((b * o + oc) * outHeight + i) * outWidth + j], expected, 1e-3);
+                }
+            }
+        }
+    }
+
+    for (size_t i = 0; i < xGrad.size(); i++) {
+        ASSERT_NEAR((*x->getGrad()->getVec())[i], xGrad[i], 1e-3);
+    }
+
+    for (size_t i = 0; i < weightGrad.size(); i++) {
+        ASSERT_NEAR((*weight->getGrad()->getVec())[i], weightGrad[i], 1e-3);
+    }
+
+    for (size_t i = 0; i < o; i++) {
+        ASSERT_NEAR((*bias->getGrad()->getVec())[i], static_cast<real>(n * outHeight * outWidth), 1e-3);
+    }
+}
+
 TEST(TensorTestFixture, indexTensor1) {
     std::cout << std::endl << "Indexing tensor 1:" << std::endl;
     Range r1 = {0, 2, 1};
@@ -74,6 +143,7 @@ TEST(TensorTestFixture, sumTensor1) {
     std::cout << std::endl << "Summing tensor 1:" << std::endl;
     Shape s1({1, 2, 12});
     auto t1 = Tensor::arange(s1, 0, 1);
+    t1->setRequiresGrad(true);
     auto t2 = t1->sum();
     t2->forward();
     t2->backward();
@@ -117,6 +187,7 @@ TEST(TensorTestFixture, sumTensor3) {
 }
 
 void maxHelper(const TensorPtr &t1, const TensorPtr &x2, const TensorPtr &g1) {
+    t1->setRequiresGrad(true);
     auto t2 = t1->max(1);
     auto t3 = t2->sum();
     t3->forward();
@@ -247,6 +318,7 @@ TEST(TensorTestFixture, sumTensorGrad1) {
     std::cout << std::endl << "Sum tensor's gradient 1:" << std::endl;
     Shape s1({2, 3, 4});
     auto t1 = Tensor::arange(s1, 0, 1);
+    t1->setRequiresGrad(true);
     auto t2 = t1->sum(1);
     auto t3 = t2->sum();
     t3->forward();
@@ -471,6 +543,8 @@ TEST(TensorTestFixture, matmul3) {
     auto t1 = Tensor::fromArr({2, 3, 4}, d1);
     real d2[] = {22., 31., 7., 55., 36., 27., 72., 3., 86., 90., 85., 66., 95., 12., 7., 93.};
     auto t2 = Tensor::fromArr({2, 4, 2}, d2);
+    t1->setRequiresGrad(true);
+    t2->setRequiresGrad(true);
     auto t3 = t1->matmul(t2);
     auto t4 = t3->sum();
     t4->forward();
@@ -491,3 +565,1117 @@ TEST(TensorTestFixture, matmul3) {
     g2->forward();
     assertEqTemplate(*t2->getGrad(), *g2);
 }
+
+TEST(TensorTestFixture, matmul4) {
+    std::cout << std::endl << "Matmul 4:" << std::endl;
+    // A few rows take the skinny kernel, which sums in the same order as the general one, but a build for the host CPU
+    // may fuse different multiplications and additions into FMA instructions in the two kernels
+    auto t1 = Tensor::randn({9, 37});
+    auto t2 = Tensor::randn({37, 300});
+    auto t3 = t1->matmul(t2);
+    auto t4 = t1->at({Range{0, 3, 1}, Range{0, 37, 1}})->matmul(t2);
+    auto t5 = t1->at({Range{8, 9, 1}, Range{0, 37, 1}})->matmul(t2);
+    t3->forward();
+    t4->forward();
+    t5->forward();
+    const Vec &x3 = *t3->getVec();
+
+    for (size_t j = 0; j < 300; j++) {
+        for (size_t i = 0; i < 3; i++) {
+            ASSERT_NEAR((*t4->getVec())[i * 300 + j], x3[i * 300 + j], 1e-4);
+        }
+
+        ASSERT_NEAR((*t5->getVec())[j], x3[8 * 300 + j], 1e-4);
+    }
+}
+
+TEST(TensorTestFixture, matmul5) {
+    std::cout << std::endl << "Matmul 5:" << std::endl;
+    // The packed copy of a leaf is reused until the leaf changes, a computed operand is packed on every pass
+    auto t1 = Tensor::randn({20, 37});
+    auto t2 = Tensor::randn({37, 50});
+    auto t3 = t1->matmul(t2);
+    auto t4 = t1->matmul(t2->mul(1.f));
+    t3->forward();
+    t4->forward();
+    ASSERT_EQ(*t3, *t4);
+    t2->add(1.f, false, t2);
+    t3->forward();
+    t4->forward();
+    ASSERT_EQ(*t3, *t4);
+    // A write through a view of the leaf also changes its memory
+    auto t5 = t2->at({Range{0, 1, 1}, Range{0, 50, 1}}, false);
+    t5->add(100.f, false, t5);
+    auto t6 = t1->matmul(t2);
+    auto t7 = t1->matmul(t2->mul(1.f));
+    t6->forward();
+    t7->forward();
+    ASSERT_EQ(*t6, *t7);
+}
+
+TEST(TensorTestFixture, matmul6) {
+    std::cout << std::endl << "Matmul 6:" << std::endl;
+    // Batch dimensions are broadcast, a missing or size 1 dimension reuses the same matrix for every batch
+    auto t1 = Tensor::randn({2, 1, 5, 4}, false);
+    auto t2 = Tensor::randn({3, 4, 6}, false);
+    t1->setRequiresGrad(true);
+    t2->setRequiresGrad(true);
+    auto t3 = t1->matmul(t2);
+    auto t4 = t3->sum();
+    t4->forward();
+    t4->backward();
+    ASSERT_EQ(t3->getShape(), Shape({2, 3, 5, 6}));
+
+    for (size_t i = 0; i < 2; i++) {
+        for (size_t j = 0; j < 3; j++) {
+            ASSERT_EQ(*t3->at({i, j}, false), *t1->at({i, 0}, false)->matmul(t2->at({j}, false), false));
+        }
+    }
+
+    // The gradient of a broadcast operand sums the gradients of every batch that read it
+    const Vec &x = *t1->getVec();
+    const Vec &w = *t2->getVec();
+    const Vec &dx = *t1->getGrad()->getVec();
+    const Vec &dw = *t2->getGrad()->getVec();
+
+    for (size_t p = 0; p < 4; p++) {
+        for (size_t q = 0; q < 6; q++) {
+            for (size_t j = 0; j < 3; j++) {
+                real expected = 0;
+
+                for (size_t r = 0; r < 10; r++) {
+                    expected += x[r * 4 + p];
+                }
+
+                ASSERT_NEAR(dw[(j * 4 + p) * 6 + q], expected, 1e-4);
+            }
+        }
+
+        for (size_t r = 0; r < 10; r++) {
+            real expected = 0;
+
+            for (size_t q = 0; q < 18; q++) {
+                expected += w[(q / 6 * 4 + p) * 6 + q % 6];
+            }
+
+            ASSERT_NEAR(dx[r * 4 + p], expected, 1e-4);
+        }
+    }
+}
+
+TEST(TensorTestFixture, linear1) {
+    std::cout << std::endl << "Linear 1:" << std::endl;
+    // The fused operation matches a matmul, a broadcast add and the activation, gradients included
+    for (Activation activation: {Activation::NONE, Activation::RELU, Activation::SIGMOID}) {
+        auto x1 = Tensor::randn({12, 20}, false);
+        auto w1 = Tensor::randn({20, 9}, false);
+        auto b1 = Tensor::randn({9}, false);
+        auto x2 = x1->copy(false);
+        auto w2 = w1->copy(false);
+        auto b2 = b1->copy(false);
+
+        for (auto &t: {x1, w1, b1, x2, w2, b2}) {
+            t->setRequiresGrad(true);
+        }
+
+        auto y1 = x1->linear(w1, b1, activation);
+        auto s2 = x2->matmul(w2)->add(b2);
+        auto y2 = activation == Activation::RELU ? s2->relu() : activation == Activation::SIGMOID ? s2->sigmoid() : s2;
+        auto z1 = y1->sum();
+        auto z2 = y2->sum();
+        z1->forward();
+        z1->backward();
+        z2->forward();
+        z2->backward();
+        ASSERT_EQ(*y1, *y2);
+        ASSERT_EQ(*x1->getGrad(), *x2->getGrad());
+        ASSERT_EQ(*w1->getGrad(), *w2->getGrad());
+        // The broadcast add does not carry gradients back to b2 so the bias gradient is checked against the rows of
+        // the gradient of the sum
+        auto ds = s2->getGrad();
+
+        for (size_t j = 0; j < 9; j++) {
+            real expected = 0;
+
+            for (size_t i = 0; i < 12; i++) {
+                expected += (*ds->getVec())[ds->getShape().offset + i * 9 + j];
+            }
+
+            ASSERT_NEAR((*b1->getGrad()->getVec())[j], expected, 1e-4);
+        }
+    }
+}
+
+TEST(TensorTestFixture, linear2) {
+    std::cout << std::endl << "Linear 2:" << std::endl;
+    // Outputs bound to slices of a concatenation along a leading dimension cannot be folded into rows so they are
+    // computed into a buffer and copied
+    auto x1 = Tensor::randn({2, 3, 4}, false);
+    auto x2 = Tensor::randn({2, 3, 4}, false);
+    auto w1 = Tensor::randn({4, 5}, false);
+    auto b1 = Tensor::randn({5}, false);
+    auto x3 = x1->copy(false);
+    x1->setRequiresGrad(true);
+    x3->setRequiresGrad(true);
+    auto y1 = Tensor::cat({x1->linear(w1, b1, Activation::SIGMOID), x2->linear(w1, b1, Activation::SIGMOID)}, 1);
+    auto z1 = y1->sum();
+    auto z3 = x3->linear(w1, b1, Activation::SIGMOID)->sum();
+    z1->forward();
+    z1->backward();
+    z3->forward();
+    z3->backward();
+    auto y2 = Tensor::cat({x1->linear(w1, b1, Activation::SIGMOID, false),
+                           x2->linear(w1, b1, Activation::SIGMOID, false)}, 1, false);
+    ASSERT_EQ(*y1, *y2);
+    ASSERT_EQ(*x1->getGrad(), *x3->getGrad());
+}
+
+TEST(TensorTestFixture, einsum1) {
+    std::cout << std::endl << "Einsum 1:" << std::endl;
+    // A matrix product lowers to the matmul itself, gradients included
+    auto t1 = Tensor::randn({5, 4}, false);
+    auto t2 = Tensor::randn({4, 6}, false);
+    auto t3 = t1->copy(false);
+    auto t4 = t2->copy(false);
+
+    for (auto &t: {t1, t2, t3, t4}) {
+        t->setRequiresGrad(true);
+    }
+
+    auto t5 = Tensor::einsum("ij,jk->ik", {t1, t2});
+    auto t6 = t3->matmul(t4);
+    auto t7 = t5->sum();
+    auto t8 = t6->sum();
+    t7->forward();
+    t7->backward();
+    t8->forward();
+    t8->backward();
+    ASSERT_EQ(*t5, *t6);
+    ASSERT_EQ(*t1->getGrad(), *t3->getGrad());
+    ASSERT_EQ(*t2->getGrad(), *t4->getGrad());
+    // Implicit outputs keep the labels that appear once, none for a dot product
+    auto t9 = Tensor::einsum("ij,ij", {t1, t3});
+    auto t10 = Tensor::einsum("ij->j", {t1});
+    t9->forward();
+    t10->forward();
+    ASSERT_EQ(t9->getShape(), Shape({1}));
+    ASSERT_EQ(t10->getShape(), Shape({4}));
+    real dot = 0;
+
+    for (size_t i = 0; i < 20; i++) {
+        dot += (*t1->getVec())[i] * (*t1->getVec())[i];
+    }
+
+    ASSERT_NEAR((*t9->getVec())[0], dot, 1e-4);
+}
+
+TEST(TensorTestFixture, einsum2) {
+    std::cout << std::endl << "Einsum 2:" << std::endl;
+    // Several operands with several contracted labels each, checked against the sums written out
+    auto t1 = Tensor::randn({2, 3, 4}, false);
+    auto t2 = Tensor::randn({3, 4, 5}, false);
+    auto t3 = Tensor::randn({5, 3}, false);
+    t1->setRequiresGrad(true);
+    auto t4 = Tensor::einsum("abc, bcd, de -> ea", {t1, t2, t3});
+    auto t5 = t4->sum();
+    t5->forward();
+    t5->backward();
+    ASSERT_EQ(t4->getShape(), Shape({3, 2}));
+    const Vec &x1 = *t1->getVec();
+    const Vec &x2 = *t2->getVec();
+    const Vec &x3 = *t3->getVec();
+
+    for (size_t a = 0; a < 2; a++) {
+        for (size_t e = 0; e < 3; e++) {
+            real expected = 0;
+
+            for (size_t b = 0; b < 3; b++) {
+                for (size_t c = 0; c < 4; c++) {
+                    for (size_t d = 0; d < 5; d++) {
+                        expected += x1[(a * 3 + b) * 4 + c] * x2[(b * 4 + c) * 5 + d] * x3[d * 3 + e];
+                    }
+                }
+            }
+
+            auto actual = t4->at({e, a}, false);
+            ASSERT_NEAR((*actual->getVec())[actual->getShape().offset], expected, 1e-3);
+        }
+    }
+
+    // The gradient flows back through the merged dimensions
+    for (size_t b = 0; b < 3; b++) {
+        for (size_t c = 0; c < 4; c++) {
+            real expected = 0;
+
+            for (size_t d = 0; d < 5; d++) {
+                for (size_t e = 0; e < 3; e++) {
+                    expected += x2[(b * 4 + c) * 5 + d] * x3[d * 3 + e];
+                }
+            }
+
+            ASSERT_NEAR((*t1->getGrad()->getVec())[b * 4 + c], expected, 1e-3);
+            ASSERT_NEAR((*t1->getGrad()->getVec())[12 + b * 4 + c], expected, 1e-3);
+        }
+    }
+}
+
+TEST(TensorTestFixture, einsum3) {
+    std::cout << std::endl << "Einsum 3:" << std::endl;
+    // A scalar operand has no labels
+    auto t1 = Tensor::fromConst({1}, 2.);
+    auto t2 = Tensor::randn({2, 3}, false);
+    auto t3 = Tensor::einsum(",ij", {t1, t2});
+    auto x3 = t2->mul(2.);
+    t3->forward();
+    x3->forward();
+    assertEqTemplate(*t3, *x3);
+}
+
+TEST(TensorTestFixture, dirtyTracking1) {
+    std::cout << std::endl << "Dirty tracking 1:" << std::endl;
+    auto t1 = Tensor::randn({2, 3});
+    auto t2 = Tensor::arange({2, 3}, 0);
+    auto t3 = t1->add(t2);
+    t3->forward();
+    auto x3 = t3->copy(false);
+    size_t version = t3->getVersion();
+    // Nothing has changed so the random leaf must not be sampled again
+    t3->forward();
+    ASSERT_EQ(t3->getVersion(), version);
+    assertEqTemplate(*t3, *x3);
+    // Reseeding the random leaf recomputes everything downstream of it
+    t1->markDirty();
+    t3->forward();
+    ASSERT_GT(t3->getVersion(), version);
+    ASSERT_NE(*t3, *x3);
+}
+
+TEST(TensorTestFixture, dirtyTracking2) {
+    std::cout << std::endl << "Dirty tracking 2:" << std::endl;
+    auto t1 = Tensor::randn({2, 3});
+    Tensor *t2;
+    TensorPtr t3;
+
+    {
+        // The exponential depends on no input that can change so it is computed once
+        auto t4 = Tensor::arange({2, 3}, 0)->exp();
+        t2 = t4.get();
+        t3 = t1->add(t4->mul(2.));
+    }
+
+    t3->forward();
+    auto vec = t2->getVec();
+    size_t version = t2->getVersion();
+    ASSERT_NE(vec, nullptr);
+    t1->markDirty();
+    t3->forward();
+    ASSERT_EQ(t2->getVersion(), version);
+    ASSERT_EQ(t2->getVec(), vec);
+}
+
+TEST(TensorTestFixture, noGrad1) {
+    std::cout << std::endl << "No grad 1:" << std::endl;
+    // An input read from an array, unlike arange it may change between forward passes
+    real d1[] = {0, 1, 2, 3, 4, 5};
+    auto t1 = Tensor::fromArr({2, 3}, d1);
+    Tensor *t2;
+    TensorPtr t3;
+
+    {
+        NoGradGuard guard;
+        auto t4 = t1->mul(2.);
+        t2 = t4.get();
+        t3 = t4->exp()->sum();
+    }
+
+    t3->forward();
+    t3->backward();
+    real expected = 0;
+
+    for (size_t i = 0; i < 6; i++) {
+        expected += std::exp(static_cast<real>(2 * i));
+    }
+
+    std::cout << "Actual:" << std::endl << *t3 << std::endl;
+    ASSERT_FLOAT_EQ((*t3->getVec())[0], expected);
+    // Intermediates are released once consumed and no gradient is allocated
+    ASSERT_EQ(t2->getVec(), nullptr);
+    ASSERT_EQ(t3->getGrad(), nullptr);
+    ASSERT_EQ(t1->getGrad(), nullptr);
+    // Forwarding again after the input changes recomputes the released intermediates
+    t1->markDirty();
+    t3->forward();
+    ASSERT_FLOAT_EQ((*t3->getVec())[0], expected);
+}
+
+TEST(TensorTestFixture, requiresGrad1) {
+    std::cout << std::endl << "Requires grad 1:" << std::endl;
+    auto t1 = Tensor::arange({2, 3}, 0);
+    auto t2 = Tensor::arange({2, 3}, 1);
+    auto t3 = Tensor::fromConst({2, 3}, 2.);
+    t1->setRequiresGrad(true);
+    auto t4 = t1->mul(t2);
+    auto t5 = t2->mul(t3);
+    auto t6 = t4->add(t5)->sum();
+    ASSERT_TRUE(t4->getRequiresGrad());
+    ASSERT_FALSE(t5->getRequiresGrad());
+    t6->forward();
+    t6->backward();
+    // Gradients only flow into tensors that lead to t1
+    assertEqTemplate(*t1->getGrad(), *t2);
+    ASSERT_EQ(t2->getGrad(), nullptr);
+    ASSERT_EQ(t3->getGrad(), nullptr);
+    ASSERT_EQ(t5->getGrad(), nullptr);
+}
+
+TensorPtr checkpointHelper(const TensorPtr &t1, bool checkpoint, Tensor *&mid) {
+    auto t2 = t1->exp();
+    auto t3 = t2->mul(t2);
+    t2->setCheckpoint(checkpoint);
+    t3->setCheckpoint(checkpoint);
+    mid = t2.get();
+    return t3->sum();
+}
+
+TEST(TensorTestFixture, checkpoint1) {
+    std::cout << std::endl << "Checkpoint 1:" << std::endl;
+    auto t1 = Tensor::arange({2, 3}, 0, 0.5);
+    auto t2 = Tensor::arange({2, 3}, 0, 0.5);
+    t1->setRequiresGrad(true);
+    t2->setRequiresGrad(true);
+    Tensor *mid1;
+    Tensor *mid2;
+    auto t3 = checkpointHelper(t1, false, mid1);
+    auto t4 = checkpointHelper(t2, true, mid2);
+    t3->forward();
+    t4->forward();
+    // Checkpointed intermediates release their memory after forward and after backward
+    ASSERT_NE(mid1->getVec(), nullptr);
+    ASSERT_EQ(mid2->getVec(), nullptr);
+    assertEqTemplate(*t4, *t3);
+    t3->backward();
+    t4->backward();
+    ASSERT_EQ(mid2->getVec(), nullptr);
+    assertEqTemplate(*t2->getGrad(), *t1->getGrad());
+}
+
+TEST(TensorTestFixture, memoryBudget1) {
+    std::cout << std::endl << "Memory budget 1:" << std::endl;
+    auto t1 = Tensor::arange({2, 3}, 0, 0.5);
+    auto t2 = Tensor::arange({2, 3}, 0, 0.5);
+    t1->setRequiresGrad(true);
+    t2->setRequiresGrad(true);
+    Tensor *mid1;
+    Tensor *mid2;
+    auto t3 = checkpointHelper(t1, false, mid1);
+    auto t4 = checkpointHelper(t2, false, mid2);
+    // No memory is left for intermediates so every one of them is checkpointed
+    t4->setMemoryBudget(0);
+    ASSERT_TRUE(mid2->isCheckpoint());
+    t3->forward();
+    t4->forward();
+    ASSERT_EQ(mid2->getVec(), nullptr);
+    t3->backward();
+    t4->backward();
+    assertEqTemplate(*t2->getGrad(), *t1->getGrad());
+}
+
+TEST(TensorTestFixture, savedTensors1) {
+    std::cout << std::endl << "Saved tensors 1:" << std::endl;
+    real d1[] = {1, 2, 3, 4, 5, 6};
+    auto t1 = Tensor::arange({2, 3}, 0);
+    auto t2 = Tensor::fromArr({2, 3}, d1);
+    t1->setRequiresGrad(true);
+    Tensor *mid1;
+    Tensor *mid2;
+    TensorPtr t3;
+
+    {
+        // Backward of add reads no values while backward of mul reads the operand of the other side
+        auto t4 = t1->add(t2);
+        auto t5 = t2->add(t2);
+        mid1 = t4.get();
+        mid2 = t5.get();
+        t3 = t4->mul(t5)->sum();
+    }
+
+    t3->forward();
+    ASSERT_EQ(mid1->getVec(), nullptr);
+    ASSERT_NE(mid2->getVec(), nullptr);
+    t3->backward();
+    ASSERT_EQ(mid2->getVec(), nullptr);
+    auto g1 = t2->mul(2.);
+    g1->forward();
+    assertEqTemplate(*t1->getGrad(), *g1);
+}
+
+TEST(TensorTestFixture, relu1) {
+    std::cout << std::endl << "Relu 1:" << std::endl;
+    auto t1 = Tensor::arange({2, 3}, -2);
+    t1->setRequiresGrad(true);
+    auto t2 = t1->relu();
+    auto t3 = t2->sum();
+    t3->forward();
+    t3->backward();
+    real d1[] = {0, 0, 0, 1, 2, 3};
+    auto x1 = Tensor::fromArr({2, 3}, d1);
+    x1->forward();
+    assertEqTemplate(*t2, *x1);
+    real d2[] = {0, 0, 0, 1, 1, 1};
+    auto g1 = Tensor::fromArr({2, 3}, d2);
+    g1->forward();
+    assertEqTemplate(*t1->getGrad(), *g1);
+}
+
+TEST(TensorTestFixture, savedOutput1) {
+    std::cout << std::endl << "Saved output 1:" << std::endl;
+    auto t1 = Tensor::arange({2, 3}, 0, 0.5);
+    t1->setRequiresGrad(true);
+    Tensor *mid1;
+    Tensor *mid2;
+    TensorPtr t2;
+
+    {
+        // Backward of exp reads its output so its input can be released
+        auto t3 = t1->mul(2.);
+        auto t4 = t3->exp();
+        mid1 = t3.get();
+        mid2 = t4.get();
+        t2 = t4->sum();
+    }
+
+    t2->forward();
+    ASSERT_EQ(mid1->getVec(), nullptr);
+    ASSERT_NE(mid2->getVec(), nullptr);
+    t2->backward();
+    auto g1 = t1->mul(2.)->exp()->mul(2.);
+    g1->forward();
+    assertEqTemplate(*t1->getGrad(), *g1);
+}
+
+TEST(TensorTestFixture, shape1) {
+    std::cout << std::endl << "Shape 1:" << std::endl;
+    // More dimensions than fit inline
+    Shape s1({1, 2, 1, 2, 1, 2, 1, 2, 1, 2});
+    std::vector<size_t> p1(s1.getNumDims());
+    std::iota(p1.rbegin(), p1.rend(), 0);
+    Shape s2 = s1.perm(p1);
+    std::cout << s1 << " " << s2 << std::endl;
+    ASSERT_EQ(s1.getSize(), 32);
+    ASSERT_EQ(s2.getSize(), 32);
+    ASSERT_TRUE(s1.isContiguous());
+    ASSERT_FALSE(s2.isContiguous());
+    ASSERT_EQ(s2.getStrides()[0], 1);
+    auto t1 = Tensor::arange({2, 3}, 0);
+    auto t2 = t1->unsqueeze(1);
+    auto t3 = t1->T();
+    ASSERT_TRUE(t2->isContiguous());
+    ASSERT_FALSE(t3->isContiguous());
+}
+
+TEST(TensorTestFixture, layout1) {
+    std::cout << std::endl << "Layout 1:" << std::endl;
+    auto t1 = Tensor::arange({2, 3, 4}, 0);
+    auto t2 = t1->T();
+    auto t3 = Tensor::arange({3, 1}, 0)->broadcastTo({2, 3, 4});
+    Range r1 = {0, 2, 1};
+    Range r2 = {0, 3, 1};
+    Range r3 = {0, 2, 1};
+    auto t4 = t1->at({r1, r2, r3});
+    ASSERT_TRUE(t1->isContiguous());
+    ASSERT_EQ(t1->getIterView().size(), 1);
+    ASSERT_FALSE(t2->isContiguous());
+    // Broadcast dimensions are not merged with the dimension they repeat
+    ASSERT_EQ(t3->getIterView().size(), 3);
+    ASSERT_EQ(t3->getIterStrides()[0], 0);
+    // The matrices and their rows are merged into one dimension of 6 rows but the rows skip columns
+    ASSERT_EQ(t4->getIterView().size(), 2);
+    t4->forward();
+    real d1[] = {0, 1, 4, 5, 8, 9, 12, 13, 16, 17, 20, 21};
+    auto x4 = Tensor::fromArr({2, 3, 2}, d1);
+    x4->forward();
+    assertEqTemplate(*t4, *x4);
+}
+
+TEST(TensorTestFixture, reshape1) {
+    std::cout << std::endl << "Reshape 1:" << std::endl;
+    auto t1 = Tensor::arange({2, 3, 4}, 0);
+    auto t2 = t1->perm({1, 0, 2});
+    // Splitting the last dimension keeps the view while merging it with the permuted dimension does not
+    ASSERT_TRUE(t2->canReshapeWithoutCopy({3, 2, 2, 2}));
+    ASSERT_FALSE(t2->canReshapeWithoutCopy({3, 8}));
+    auto t3 = t2->reshape({3, 2, 2, 2});
+    auto t4 = t2->reshape({3, 8});
+    t3->forward();
+    t4->forward();
+    ASSERT_EQ(t3->getVec(), t1->getVec());
+    ASSERT_NE(t4->getVec(), t1->getVec());
+    std::vector<real> d1;
+
+    for (size_t i = 0; i < 3; i++) {
+        for (size_t j = 0; j < 2; j++) {
+            for (size_t k = 0; k < 4; k++) {
+                d1.push_back(static_cast<real>(12 * j + 4 * i + k));
+            }
+        }
+    }
+
+    auto x3 = Tensor::fromArr({3, 2, 2, 2}, d1.data());
+    auto x4 = Tensor::fromArr({3, 8}, d1.data());
+    x3->forward();
+    x4->forward();
+    assertEqTemplate(*t3, *x3);
+    assertEqTemplate(*t4, *x4);
+}
+
+TEST(TensorTestFixture, contiguous1) {
+    std::cout << std::endl << "Contiguous 1:" << std::endl;
+    auto t1 = Tensor::arange({2, 300, 130}, 0);
+    auto t2 = t1->contiguous();
+    // Large enough to be copied in tiles by several threads
+    auto t3 = t1->T(1)->contiguous();
+    t3->forward();
+    ASSERT_EQ(t2, t1);
+    ASSERT_TRUE(t3->isContiguous());
+    std::vector<real> d1;
+
+    for (size_t b = 0; b < 2; b++) {
+        for (size_t i = 0; i < 130; i++) {
+            for (size_t j = 0; j < 300; j++) {
+                d1.push_back(static_cast<real>(b * 39000 + j * 130 + i));
+            }
+        }
+    }
+
+    auto x3 = Tensor::fromArr({2, 130, 300}, d1.data());
+    x3->forward();
+    assertEqTemplate(*t3, *x3);
+}
+
+TEST(TensorTestFixture, cat1) {
+    std::cout << std::endl << "Cat 1:" << std::endl;
+    auto t1 = Tensor::arange({2, 3}, 0);
+    auto t2 = Tensor::arange({2, 2}, 6);
+    t1->setRequiresGrad(true);
+    t2->setRequiresGrad(true);
+    Tensor *t3;
+    auto t4 = t2->T();
+    TensorPtr t5;
+
+    {
+        // Only a product that nothing outside the graph holds can be bound to the output
+        auto t7 = t1->mul(*Tensor::fromConst({2, 3}, 2));
+        t3 = t7.get();
+        t5 = Tensor::cat({t7, t4}, 1);
+    }
+
+    auto t6 = t5->sum();
+    t6->forward();
+    // The product is computed directly into its slice of the output while the transpose is copied
+    ASSERT_EQ(t3->getShape().getStrides(), Dims({5, 1}));
+    ASSERT_NE(t4->getVec(), t5->getVec());
+    real d1[] = {0, 2, 4, 6, 8, 6, 8, 10, 7, 9};
+    auto x5 = Tensor::fromArr({2, 5}, d1);
+    x5->forward();
+    assertEqTemplate(*t5, *x5);
+    t6->backward();
+    // The product's gradient has its own memory
+    ASSERT_NE(t3->getGrad()->getVec(), t5->getGrad()->getVec());
+    auto x1 = Tensor::fromConst({2, 3}, 2);
+    auto x2 = Tensor::ones({2, 2});
+    x1->forward();
+    x2->forward();
+    assertEqTemplate(*t1->getGrad(), *x1);
+    assertEqTemplate(*t2->getGrad(), *x2);
+}
+
+TEST(TensorTestFixture, stack1) {
+    std::cout << std::endl << "Stack 1:" << std::endl;
+    auto t1 = Tensor::arange({2, 2}, 0);
+    auto t2 = Tensor::arange({2, 2}, 4);
+    auto t3 = t1->add(*t2);
+    Tensor *t5 = t3.get();
+    auto t4 = Tensor::stack({t1, t2, std::move(t3)}, 1);
+    t4->forward();
+    ASSERT_EQ(t5->getShape().offset, 4);
+    ASSERT_EQ(t5->getShape().getStrides(), Dims({6, 1}));
+    real d1[] = {0, 1, 4, 5, 4, 6, 2, 3, 6, 7, 8, 10};
+    auto x4 = Tensor::fromArr({2, 3, 2}, d1);
+    x4->forward();
+    assertEqTemplate(*t4, *x4);
+}
+
+TEST(TensorTestFixture, cat2) {
+    std::cout << std::endl << "Cat 2:" << std::endl;
+    auto t1 = Tensor::arange({2, 3}, 0, 0.5);
+    auto t2 = Tensor::arange({2, 3}, 0, 0.5);
+    t1->setRequiresGrad(true);
+    t2->setRequiresGrad(true);
+    TensorPtr t3;
+    TensorPtr t4;
+    // A product the caller holds keeps its own contiguous memory and gradient
+    auto t5 = t2->mul(2.f);
+
+    {
+        // The exponent is also read by another concatenation so it is copied and accumulates its own gradient
+        auto t6 = t1->exp();
+        auto t7 = t2->exp();
+        t3 = Tensor::cat({t1->mul(2.f), t6}, 0)->add(*Tensor::cat({t6, t6}, 0))->sum();
+        t4 = Tensor::cat({t5, t7}, 0)->add(*Tensor::cat({t7, t7}, 0))->sum();
+    }
+
+    t3->forward();
+    t4->forward();
+    ASSERT_TRUE(t5->getShape().isContiguous());
+    ASSERT_EQ(t5->getShape(), Shape({2, 3}));
+    assertEqTemplate(*t3, *t4);
+    // Gradients of bound and copied products accumulate the same way over backward passes
+    t3->backward();
+    t4->backward();
+    auto x1 = t1->exp()->mul(3.f)->add(2.f);
+    x1->forward();
+    assertEqTemplate(*t1->getGrad(), *x1);
+    t3->backward();
+    t4->backward();
+    assertEqTemplate(*t1->getGrad(), *t2->getGrad());
+}
+
+TEST(TensorTestFixture, dtype1) {
+    std::cout << std::endl << "Data type 1:" << std::endl;
+    real d1[] = {-1.5, 0, 0.1, 2.5, 65504, 65519};
+    auto t1 = Tensor::fromArr({2, 3}, d1);
+    auto t2 = t1->to(DType::INT64);
+    auto t3 = t1->to(DType::FLOAT16);
+    auto t4 = t1->to(DType::BFLOAT16);
+    auto t5 = t1->to(DType::BOOL);
+    // Views and copies keep the data type of their operand
+    auto t6 = Tensor::cat({t2->T(), t2->T()}, 1)->to(DType::FLOAT32);
+    auto t7 = Tensor::stack({t3->to(DType::FLOAT32), t4->to(DType::FLOAT32), t5->to(DType::FLOAT32)}, 0);
+    t6->forward();
+    t7->forward();
+    ASSERT_EQ(t1->to(DType::FLOAT32), t1);
+    ASSERT_EQ(t2->getDType(), DType::INT64);
+    ASSERT_EQ(t2->getVec()->size * getDTypeSize(t2->getDType()), 48);
+    ASSERT_EQ(t3->getVec()->size * getDTypeSize(t3->getDType()), 12);
+    real d6[] = {-1, 2, -1, 2, 0, 65504, 0, 65504, 0, 65519, 0, 65519};
+    auto x6 = Tensor::fromArr({3, 4}, d6);
+    // Half keeps 11 bits of precision and bfloat16 keeps 8
+    real d7[] = {
+        -1.5, 0, 0.0999755859375, 2.5, 65504, 65504, -1.5, 0, 0.10009765625, 2.5, 65536, 65536, 1, 0, 1, 1, 1, 1
+    };
+    auto x7 = Tensor::fromArr({3, 2, 3}, d7);
+    x6->forward();
+    x7->forward();
+    assertEqTemplate(*t6, *x6);
+    assertEqTemplate(*t7, *x7);
+}
+
+TEST(TensorTestFixture, mask1) {
+    std::cout << std::endl << "Mask 1:" << std::endl;
+    auto t1 = Tensor::arange({2, 5}, 0);
+    auto t2 = Tensor::arange({2, 5}, 10);
+    t1->setRequiresGrad(true);
+    t2->setRequiresGrad(true);
+    auto m1 = t1->lt(3, true, nullptr, DType::BITMASK);
+    auto t3 = Tensor::where(m1, t1, t2);
+    auto t4 = t3->sum();
+    t4->forward();
+    t4->backward();
+    std::cout << *m1 << std::endl;
+    ASSERT_EQ(getNumBytes(m1->getDType(), m1->getVec()->size), 2);
+    real d3[] = {0, 1, 2, 13, 14, 15, 16, 17, 18, 19};
+    auto x3 = Tensor::fromArr({2, 5}, d3);
+    real g1[] = {1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
+    auto x1 = Tensor::fromArr({2, 5}, g1);
+    auto x2 = x1->neg()->add(1);
+    x3->forward();
+    x2->forward();
+    assertEqTemplate(*t3, *x3);
+    assertEqTemplate(*t1->getGrad(), *x1);
+    assertEqTemplate(*t2->getGrad(), *x2);
+    // A bool mask of a transposed view selects in the order of the view
+    auto t5 = t1->T();
+    auto m2 = t5->geq(4, true, nullptr, DType::BOOL);
+    m2->forward();
+    real d6[] = {5, 6, 7, 8, 4, 9};
+    auto x6 = Tensor::fromArr({6}, d6);
+    x6->forward();
+    assertEqTemplate(*t5->maskedSelect(m2), *x6);
+}
+
+TEST(TensorTestFixture, dtype2) {
+    std::cout << std::endl << "Data type 2:" << std::endl;
+    // Small integers are exact in both reduced precision types so the products match float32
+    auto t1 = Tensor::arange({2, 3}, 0);
+    auto t2 = Tensor::arange({3, 2}, 1);
+    auto t3 = t1->to(DType::BFLOAT16);
+    auto t4 = t2->to(DType::FLOAT16);
+    t3->setRequiresGrad(true);
+    t4->setRequiresGrad(true);
+    auto t5 = t3->matmul(t4);
+    auto t6 = t5->sum();
+    t6->forward();
+    t6->backward();
+    auto x5 = t1->matmul(t2);
+    x5->forward();
+    ASSERT_EQ(t5->getDType(), DType::FLOAT32);
+    assertEqTemplate(*t5, *x5);
+    real g3[] = {3, 7, 11, 3, 7, 11};
+    auto x3 = Tensor::fromArr({2, 3}, g3);
+    x3->forward();
+    assertEqTemplate(*t3->getGrad(), *x3);
+    // Rows long enough for the vectorized conversions round like the scalar ones
+    auto t7 = Tensor::arange({37}, 0)->mul(0.1f);
+    auto t8 = t7->to(DType::FLOAT16)->to(DType::FLOAT32);
+    auto t9 = t7->to(DType::BFLOAT16)->to(DType::FLOAT32);
+    t8->forward();
+    t9->forward();
+    std::vector<real> d8, d9;
+
+    for (size_t i = 0; i < 37; i++) {
+        real x = (*t7->getVec())[i];
+        d8.push_back(Half(x));
+        d9.push_back(BFloat16(x));
+    }
+
+    auto x8 = Tensor::fromVec({37}, d8);
+    auto x9 = Tensor::fromVec({37}, d9);
+    x8->forward();
+    x9->forward();
+    assertEqTemplate(*t8, *x8);
+    assertEqTemplate(*t9, *x9);
+}
+
+TEST(TensorTestFixture, dtype3) {
+    std::cout << std::endl << "Data type 3:" << std::endl;
+    // Arithmetic ops, comparisons and reductions read other data types converted to float32, float64 is converted
+    // explicitly
+    auto t1 = Tensor::arange({2, 3}, 0)->to(DType::INT32);
+    auto t2 = Tensor::arange({2, 3}, 1)->to(DType::FLOAT64)->to(DType::FLOAT16);
+    auto t3 = t1->mul(t2)->sum(1);
+    auto t4 = t2->lt(3.f, true, nullptr, DType::BOOL)->max();
+    auto t5 = t1->to(DType::INT64)->neg()->add(*t1->to(DType::BOOL));
+    t3->forward();
+    t4->forward();
+    t5->forward();
+    ASSERT_EQ(t3->getDType(), DType::FLOAT32);
+    real d3[] = {8, 62};
+    auto x3 = Tensor::fromArr({2}, d3);
+    x3->forward();
+    assertEqTemplate(*t3, *x3);
+    ASSERT_EQ((*t4->getVec())[0], 1);
+    real d5[] = {0, 0, -1, -2, -3, -4};
+    auto x5 = Tensor::fromArr({2, 3}, d5);
+    x5->forward();
+    assertEqTemplate(*t5, *x5);
+}
+
+TEST(TensorTestFixture, int8Matmul1) {
+    std::cout << std::endl << "Int8 matmul 1:" << std::endl;
+    // Every row reaches 127 so that the quantization scales are 1 and the int8 products are exact
+    size_t m = 3, n = 5, k = 100;
+    std::vector<real> d1, d2;
+
+    for (size_t i = 0; i < m * k; i++) {
+        d1.push_back(i % k == 0 ? 127 : static_cast<real>(i * 7 % 255) - 127);
+    }
+
+    for (size_t i = 0; i < n * k; i++) {
+        d2.push_back(i % k == 0 ? -127 : static_cast<real>(i * 13 % 255) - 127);
+    }
+
+    auto t1 = Tensor::fromVec({m, k}, d1);
+    auto t2 = Tensor::fromVec({n, k}, d2);
+    auto t3 = Tensor::arange({n}, 0);
+    t2->forward();
+    auto weights = std::make_shared<Int8Matrix>();
+    Workspace workspace;
+    quantizeRows(*t2->getVec(), 0, t2->getShape().getStrides(), n, k, *weights, workspace);
+    auto t4 = t1->matmulInt8(weights, t3);
+    auto x4 = t1->matmul(t2->T())->add(t3);
+    t4->forward();
+    x4->forward();
+    assertEqTemplate(*t4, *x4);
+}
+
+TEST(TensorTestFixture, int4Matmul1) {
+    std::cout << std::endl << "Int4 matmul 1:" << std::endl;
+    // Every group spans [-8, 7] so that the scales are 1 and the zero points 8, which makes the 4-bit weights exact
+    size_t m = 2, n = 3, k = 70, groupSize = 32;
+    std::vector<real> d1, d2;
+
+    for (size_t i = 0; i < m * k; i++) {
+        d1.push_back(static_cast<real>(i % 11) - 5);
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        for (size_t p = 0; p < k; p++) {
+            d2.push_back(p % groupSize == 0 ? -8 : p % groupSize == 1 ? 7 : static_cast<real>((i + p * 5) % 16) - 8);
+        }
+    }
+
+    auto t1 = Tensor::fromVec({m, k}, d1);
+    auto t2 = Tensor::fromVec({n, k}, d2);
+    auto t3 = Tensor::arange({n}, 0);
+    t2->forward();
+    auto weights = std::make_shared<Int4Matrix>();
+    Workspace workspace;
+    quantizeRowsInt4(*t2->getVec(), 0, t2->getShape().getStrides(), n, k, groupSize, *weights, workspace);
+    auto t4 = t1->matmulInt4(weights, t3);
+    auto x4 = t1->matmul(t2->T())->add(t3);
+    t4->forward();
+    x4->forward();
+    ASSERT_EQ(weights->values.size(), n * k / 2);
+    assertEqTemplate(*t4, *x4);
+}
+
+TEST(TensorTestFixture, quantizedMatmul1) {
+    std::cout << std::endl << "Quantized matmul 1:" << std::endl;
+    // Leading dimensions are folded into rows like linear, a layout that cannot be folded is copied first
+    size_t n = 4, k = 16;
+    auto t1 = Tensor::randn({3, 2, k});
+    auto t2 = Tensor::randn({n, k});
+    auto t3 = Tensor::randn({n});
+    t2->forward();
+    Workspace workspace;
+    auto weights = std::make_shared<Int8Matrix>();
+    auto weightsInt4 = std::make_shared<Int4Matrix>();
+    quantizeRows(*t2->getVec(), 0, t2->getShape().getStrides(), n, k, *weights, workspace);
+    quantizeRowsInt4(*t2->getVec(), 0, t2->getShape().getStrides(), n, k, 8, *weightsInt4, workspace);
+    auto t4 = t1->perm({1, 0, 2});
+    auto x4 = t4->copy()->reshape({6, k});
+    auto t5 = t4->matmulInt8(weights, t3);
+    auto t6 = t4->matmulInt4(weightsInt4, t3);
+    auto x5 = x4->matmulInt8(weights, t3)->reshape({2, 3, n});
+    auto x6 = x4->matmulInt4(weightsInt4, t3)->reshape({2, 3, n});
+    t5->forward();
+    t6->forward();
+    x5->forward();
+    x6->forward();
+    ASSERT_EQ(t5->getShape(), Shape({2, 3, n}));
+    assertEqTemplate(*t5, *x5);
+    assertEqTemplate(*t6, *x6);
+}
+
+TEST(TensorTestFixture, conv1) {
+    std::cout << std::endl << "Convolution 1:" << std::endl;
+    // Few products per output are computed directly
+    checkConv2d(2, 3, 7, 6, 5, 3, 1, 1);
+    checkConv2d(1, 2, 5, 5, 10, 1, 2, 0);
+    // More go through im2col and gemm, 1x1 kernels without stride multiply the images in place
+    checkConv2d(2, 8, 9, 8, 4, 3, 2, 1);
+    checkConv2d(2, 70, 4, 5, 3, 1, 1, 0);
+    // 3x3 kernels without stride use Winograd F(2x2, 3x3) on small outputs and F(4x4, 3x3) on larger ones, whose
+    // last tiles are partial here
+    checkConv2d(2, 8, 6, 7, 5, 3, 1, 1);
+    checkConv2d(1, 16, 12, 11, 4, 3, 1, 1);
+}
+
+TEST(TensorTestFixture, conv2) {
+    std::cout << std::endl << "Convolution 2:" << std::endl;
+    // Channels last images give the permuted outputs and gradients of channels first ones
+    auto t1 = Tensor::randn({2, 8, 6, 5}, false);
+    auto t2 = Tensor::randn({4, 8, 3, 3}, false);
+    auto t3 = Tensor::randn({4}, false);
+    auto t4 = t1->perm({0, 2, 3, 1}, false)->copy(false);
+    auto t5 = t2->perm({0, 2, 3, 1}, false)->copy(false);
+    t1->setRequiresGrad(true);
+    t4->setRequiresGrad(true);
+    auto t6 = t1->conv2d(t2, t3, 1, 1);
+    auto t7 = t4->conv2d(t5, t3, 1, 1, Layout::CHANNELS_LAST);
+    auto t8 = t6->sum();
+    auto t9 = t7->sum();
+    t8->forward();
+    t8->backward();
+    t9->forward();
+    t9->backward();
+    auto t10 = t6->perm({0, 2, 3, 1}, false)->copy(false);
+    auto t11 = t1->getGrad()->perm({0, 2, 3, 1}, false)->copy(false);
+    ASSERT_EQ(t7->getShape(), t10->getShape());
+
+    for (size_t i = 0; i < t10->getNumel(); i++) {
+        ASSERT_NEAR((*t7->getVec())[i], (*t10->getVec())[i], 1e-3);
+    }
+
+    for (size_t i = 0; i < t11->getNumel(); i++) {
+        ASSERT_NEAR((*t4->getGrad()->getVec())[i], (*t11->getVec())[i], 1e-3);
+    }
+
+    // Signals are images of height 1
+    auto t12 = Tensor::randn({2, 3, 10}, false);
+    auto t13 = Tensor::randn({4, 3, 3}, false);
+    auto t14 = t12->conv1d(t13, nullptr, 2, 0, Layout::CHANNELS_FIRST, false);
+    auto t15 = t12->reshape({2, 3, 1, 10}, false)->conv2d(t13->reshape({4, 3, 1, 3}, false), nullptr, 2, 0,
+                                                          Layout::CHANNELS_FIRST, false);
+    ASSERT_EQ(t14->getShape(), Shape({2, 4, 4}));
+
+    for (size_t i = 0; i < t14->getNumel(); i++) {
+        ASSERT_NEAR((*t14->getVec())[i], (*t15->getVec())[i], 1e-4);
+    }
+}
+
+TEST(TensorTestFixture, conv3) {
+    std::cout << std::endl << "Convolution 3:" << std::endl;
+    // The Winograd transform of leaf weights is reused until they change, computed weights are transformed every pass
+    auto t1 = Tensor::randn({2, 8, 10, 10});
+    auto t2 = Tensor::randn({4, 8, 3, 3});
+    auto t3 = t1->conv2d(t2, nullptr, 1, 1);
+    auto t4 = t1->conv2d(t2->mul(1.f), nullptr, 1, 1);
+    t3->forward();
+    t4->forward();
+    ASSERT_EQ(*t3, *t4);
+    t2->add(1.f, false, t2);
+    t3->forward();
+    t4->forward();
+    ASSERT_EQ(*t3, *t4);
+    // A write through a view of the leaf also changes its memory
+    auto t5 = t2->at({0}, false);
+    t5->add(5.f, false, t5);
+    auto t6 = t1->conv2d(t2, nullptr, 1, 1);
+    auto t7 = t1->conv2d(t2->mul(1.f), nullptr, 1, 1);
+    t6->forward();
+    t7->forward();
+    ASSERT_EQ(*t6, *t7);
+}
+
+TEST(TensorTestFixture, pool1) {
+    std::cout << std::endl << "Pooling 1:" << std::endl;
+    auto t1 = Tensor::randn({2, 3, 5, 6}, false);
+    t1->setRequiresGrad(true);
+    auto t2 = t1->maxPool2d(3, 2, 1);
+    auto t3 = t1->avgPool2d(3, 2, 1);
+    auto t4 = t2->add(t3)->sum();
+    t4->forward();
+    t4->backward();
+    ASSERT_EQ(t2->getShape(), Shape({2, 3, 3, 3}));
+    const Vec &x = *t1->getVec();
+    std::vector<real> grad(x.size);
+
+    for (size_t plane = 0; plane < 6; plane++) {
+        for (size_t i = 0; i < 3; i++) {
+            for (size_t j = 0; j < 3; j++) {
+                std::vector<size_t> window;
+
+                for (size_t p = 0; p < 3; p++) {
+                    for (size_t q = 0; q < 3; q++) {
+                        // The padding is skipped
+                        if (i * 2 + p >= 1 && i * 2 + p <= 5 && j * 2 + q >= 1 && j * 2 + q <= 6) {
+                            window.push_back((plane * 5 + i * 2 + p - 1) * 6 + j * 2 + q - 1);
+                        }
+                    }
+                }
+
+                size_t argmax = window[0];
+                real sum = 0;
+
+                for (size_t idx: window) {
+                    argmax = x[idx] > x[argmax] ? idx : argmax;
+                    sum += x[idx];
+                    grad[idx] += 1.f / static_cast<real>(window.size());
+                }
+
+                grad[argmax] += 1;
+                size_t outIdx = (plane * 3 + i) * 3 + j;
+                ASSERT_EQ((*t2->getVec())[outIdx], x[argmax]);
+                ASSERT_NEAR((*t3->getVec())[outIdx], sum / static_cast<real>(window.size()), 1e-5);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < grad.size(); i++) {
+        ASSERT_NEAR((*t1->getGrad()->getVec())[i], grad[i], 1e-5);
+    }
+
+    // Channels last images pool to the permuted outputs
+    auto t5 = t1->perm({0, 2, 3, 1}, false)->copy(false)->maxPool2d(3, 2, 1, Layout::CHANNELS_LAST, false);
+    auto t6 = t2->perm({0, 2, 3, 1}, false)->copy(false);
+    ASSERT_EQ(*t5, *t6);
+}
+
+
+TEST(TensorTestFixture, buffer1) {
+    std::cout << std::endl << "Buffer 1:" << std::endl;
+    // A tensor over borrowed memory reads it through its strides and releases it with its last view
+    auto data = std::make_shared<std::vector<real> >(12);
+
+    for (size_t i = 0; i < data->size(); i++) {
+        (*data)[i] = static_cast<real>(i);
+    }
+
+    auto vec = std::make_shared<Vec>(data->size(), DType::FLOAT32, reinterpret_cast<std::byte *>(data->data()), data);
+    auto t1 = Tensor::fromBuffer(vec, Shape(1, {3, 2}, {4, 1}));
+    vec.reset();
+    auto t2 = t1->add(1.f);
+    t2->forward();
+    real x2[] = {2, 3, 6, 7, 10, 11};
+    auto t3 = Tensor::fromArr({3, 2}, x2);
+    t3->forward();
+    assertEqTemplate(*t2, *t3);
+    (*data)[1] = 100;
+    ASSERT_EQ((*t1->getVec())[1], 100);
+    std::weak_ptr<std::vector<real> > owner = data;
+    data.reset();
+    ASSERT_FALSE(owner.expired());
+    t1.reset();
+    t2.reset();
+    ASSERT_TRUE(owner.expired());
+}
+
+TEST(TensorTestFixture, buffer2) {
+    std::cout << std::endl << "Buffer 2:" << std::endl;
+    // Values written into a tensor's memory are seen once the tensor is marked as modified, its leaf op is not rerun
+    auto t1 = Tensor::randn({16, 8});
+    auto t2 = Tensor::randn({16, 8});
+    auto t3 = t1->matmul(t2->T());
+    t3->forward();
+    auto vec = t2->getVec();
+
+    for (size_t i = 0; i < vec->size; i++) {
+        (*vec)[i] = 0;
+    }
+
+    t2->markModified();
+    t1->markDirty();
+    t3->forward();
+    auto x3 = Tensor::fromConst({16, 16}, 0.);
+    x3->forward();
+    assertEqTemplate(*t3, *x3);
+    // Refilling the memory of an input
+    auto data = std::make_shared<std::vector<real> >(4, 1.f);
+    auto t4 = Tensor::fromBuffer(std::make_shared<Vec>(data->size(), DType::FLOAT32,
+                                                       reinterpret_cast<std::byte *>(data->data()), data), Shape({4}));
+    auto t5 = t4->sum();
+    t5->forward();
+    ASSERT_FLOAT_EQ((*t5->getVec())[0], 4);
+    std::ranges::fill(*data, 2.f);
+    t4->markModified();
+    t5->forward();
+    ASSERT_FLOAT_EQ((*t5->getVec())[0], 8);
+}
+
+TEST(TensorTestFixture, plan1) {
+    std::cout << std::endl << "Plan 1:" << std::endl;
+    NoGradGuard guard;
+    auto t1 = Tensor::randn({1, 8, 6, 6});
+    auto t2 = Tensor::randn({1, 8, 6, 6});
+    auto t3 = Tensor::randn({4, 8, 3, 3});
+    t1->forward();
+    t2->forward();
+    // The convolution is released by the forward pass in inference mode, the plan recomputes and keeps it
+    auto t4 = t1->conv2d(t3, nullptr, 1, 1);
+    auto t5 = t4->relu()->sum();
+    std::weak_ptr<Tensor> step = t4;
+    t4 = nullptr;
+    TensorPlan plan(t5, {t1});
+    auto vec = step.lock()->getVec();
+    ASSERT_NE(vec, nullptr);
+    plan.replay({t2});
+    ASSERT_EQ(step.lock()->getVec(), vec);
+    auto x5 = t2->conv2d(t3, nullptr, 1, 1)->relu()->sum();
+    x5->forward();
+    assertEqTemplate(*t5, *x5);
+    plan.replay({t1});
+    auto x6 = t1->conv2d(t3, nullptr, 1, 1)->relu()->sum();
+    x6->forward();
+    assertEqTemplate(*t5, *x6);
+}